@@ -1,9 +1,28 @@
 #include "Engine.h"
+#include "Root\Engine\Jobs\JobSystem.h"
 #include <iostream>
 
-Engine::Engine(void* moduleHandle)
+namespace
+{
+    FrameScheduler::INIT_DESC DefaultScheduling()
+    {
+        FrameScheduler::INIT_DESC desc;
+        desc.tickRate = 60.0;
+        desc.maxFrameRate = 120.0;
+        desc.maxTicksPerFrame = 8;
+        return desc;
+    }
+}
+
+Engine::Engine(void* moduleHandle) :
+    m_Scheduler(DefaultScheduling())
 {
     m_End = false;
+
+    // workers are up before any module is loaded so the game can use them
+    // from Initialize() on
+    m_Jobs.reset(new JobSystem());
+
     m_GuiLib = LoadLib(".\\bin\\Debug\\Sentiment_SFMLGui");
 
     if(m_GuiLib != nullptr)
@@ -52,6 +71,7 @@ Engine::~Engine()
     m_GuiManager.reset();
     m_Renderer.reset();
     m_RenderUtility.reset();
+    m_Jobs.reset();
 
     if(m_GameLib != nullptr)
     {
@@ -76,7 +96,15 @@ void Engine::run()
 {
     while(!m_End)
     {
+        m_Scheduler.BeginFrame();
+
+        while(m_Scheduler.Tick())
+            m_Game->Frame();
+
+        m_Game->PreDraw();
+        m_Game->PostDraw();
 
+        m_Scheduler.EndFrame();
     }
 }
 
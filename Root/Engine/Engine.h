@@ -9,6 +9,9 @@
 
 #include "Root\Utility\LoadLib\LoadLib.h"
 
+#include "Root\Engine\Time\FrameScheduler.h"
+#include "Root\Engine\Jobs\IJobSystem.h"
+
 class Engine
 {
 public:
@@ -26,6 +29,20 @@ public:
 
     const std::shared_ptr<IRenderUtility> RenderUtility() {return m_RenderUtility;}
 
+    const std::shared_ptr<IJobSystem> Jobs() {return m_Jobs;}
+
+    // timing of the last completed frame
+    const FrameStats& Stats() const {return m_Scheduler.Stats();}
+
+    // interpolation factor between the previous and current simulation tick
+    double Alpha() const {return m_Scheduler.Alpha();}
+
+    // fixed simulation step in seconds
+    double TickLength() const {return m_Scheduler.TickLength();}
+
+    // 0 disables the frame limiter
+    void SetFrameLimit(double framesPerSecond) {m_Scheduler.SetFrameLimit(framesPerSecond);}
+
 private:
     void * m_GuiLib;
     void * m_RenderLib;
@@ -35,6 +52,9 @@ private:
     std::shared_ptr<IRenderer> m_Renderer;
     std::shared_ptr<IRenderUtility> m_RenderUtility;
     std::shared_ptr<IGame> m_Game;
+    std::shared_ptr<IJobSystem> m_Jobs;
+
+    FrameScheduler m_Scheduler;
 
     bool m_End;
 };
@@ -0,0 +1,484 @@
+#include "Archetype.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+const std::size_t Archetype::CHUNK_SIZE;
+const std::size_t Archetype::COLUMN_ALIGN;
+
+namespace
+{
+    std::mutex& RegistryLock()
+    {
+        static std::mutex lock;
+        return lock;
+    }
+
+    std::map<std::string, const ComponentInfo*>& Registry()
+    {
+        static std::map<std::string, const ComponentInfo*> registry;
+        return registry;
+    }
+
+    std::map<TypeHash, const ComponentInfo*>& RegistryByID()
+    {
+        static std::map<TypeHash, const ComponentInfo*> registry;
+        return registry;
+    }
+}
+
+const ComponentInfo* ComponentInfo::Register(ComponentInfo* info)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    std::map<TypeHash, const ComponentInfo*>::iterator it = RegistryByID().find(info->typeID);
+
+    if(it != RegistryByID().end())
+    {
+        if(std::strcmp(it->second->name, info->name) != 0)
+            throw std::logic_error(std::string("Type id of ") + info->name + " collides with " + it->second->name);
+
+        return it->second;
+    }
+
+    info->index = (unsigned int)RegistryByID().size();
+
+    RegistryByID()[info->typeID] = info;
+    Registry()[info->name] = info;
+
+    return info;
+}
+
+const ComponentInfo* ComponentInfo::Find(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    std::map<std::string, const ComponentInfo*>::const_iterator it = Registry().find(name);
+
+    return (it != Registry().end()) ? it->second : nullptr;
+}
+
+const ComponentInfo* ComponentInfo::Find(TypeHash typeID)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    std::map<TypeHash, const ComponentInfo*>::const_iterator it = RegistryByID().find(typeID);
+
+    return (it != RegistryByID().end()) ? it->second : nullptr;
+}
+
+unsigned int ComponentInfo::Count()
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+
+    return (unsigned int)RegistryByID().size();
+}
+
+namespace
+{
+    std::map<TypeHash, const TagInfo*>& TagsByID()
+    {
+        static std::map<TypeHash, const TagInfo*> registry;
+        return registry;
+    }
+
+    std::vector<const TagInfo*>& TagsByIndex()
+    {
+        static std::vector<const TagInfo*> registry;
+        return registry;
+    }
+}
+
+const unsigned int TagInfo::MAX_TAGS;
+
+const TagInfo* TagInfo::Register(TagInfo* info)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    std::map<TypeHash, const TagInfo*>::iterator it = TagsByID().find(info->typeID);
+
+    if(it != TagsByID().end())
+    {
+        if(std::strcmp(it->second->name, info->name) != 0)
+            throw std::logic_error(std::string("Type id of ") + info->name + " collides with " + it->second->name);
+
+        return it->second;
+    }
+
+    if(TagsByIndex().size() == MAX_TAGS)
+        throw std::logic_error(std::string("Too many tag types for ") + info->name);
+
+    info->index = (unsigned int)TagsByIndex().size();
+
+    TagsByID()[info->typeID] = info;
+    TagsByIndex().push_back(info);
+
+    return info;
+}
+
+const TagInfo* TagInfo::Find(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+
+    for(unsigned int i = 0; i < TagsByIndex().size(); ++i)
+        if(name == TagsByIndex()[i]->name)
+            return TagsByIndex()[i];
+
+    return nullptr;
+}
+
+const TagInfo* TagInfo::Find(TypeHash typeID)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    std::map<TypeHash, const TagInfo*>::const_iterator it = TagsByID().find(typeID);
+
+    return (it != TagsByID().end()) ? it->second : nullptr;
+}
+
+const TagInfo* TagInfo::Find(unsigned int index)
+{
+    std::lock_guard<std::mutex> lock(RegistryLock());
+
+    return (index < TagsByIndex().size()) ? TagsByIndex()[index] : nullptr;
+}
+
+namespace
+{
+    std::size_t AlignUp(std::size_t value, std::size_t align)
+    {
+        return (value + align - 1) & ~(align - 1);
+    }
+
+    // bytes needed to lay out the columns of capacity rows
+    std::size_t LayoutSize(const std::vector<const ComponentInfo*>& types, long capacity, std::vector<std::size_t>* offsets)
+    {
+        std::size_t offset = AlignUp(sizeof(EntityHandle) * capacity, Archetype::COLUMN_ALIGN);
+
+        for(unsigned int i = 0; i < types.size(); ++i)
+        {
+            std::size_t align = std::max(types[i]->align, Archetype::COLUMN_ALIGN);
+            offset = AlignUp(offset, align);
+
+            if(offsets != nullptr)
+                offsets->push_back(offset);
+
+            offset += types[i]->size * capacity;
+        }
+
+        return offset;
+    }
+}
+
+Archetype::Archetype(const std::vector<const ComponentInfo*>& types) :
+    m_Types(types),
+    m_ChunkBytes(CHUNK_SIZE),
+    m_Capacity(0),
+    m_Size(0)
+{
+    for(unsigned int i = 0; i < m_Types.size(); ++i)
+        m_Signature.push_back(m_Types[i]->typeID);
+
+    std::size_t rowBytes = sizeof(EntityHandle);
+    for(unsigned int i = 0; i < m_Types.size(); ++i)
+        rowBytes += m_Types[i]->size;
+
+    // start from the unpadded estimate and back off until the padding fits
+    m_Capacity = long(CHUNK_SIZE / rowBytes);
+    while(m_Capacity > 1 && LayoutSize(m_Types, m_Capacity, nullptr) > CHUNK_SIZE)
+        --m_Capacity;
+
+    if(m_Capacity < 1)
+        m_Capacity = 1;
+
+    // oversized components get a chunk that holds a single row
+    m_ChunkBytes = std::max(CHUNK_SIZE, LayoutSize(m_Types, m_Capacity, &m_Offsets));
+}
+
+Archetype::~Archetype()
+{
+    for(long i = 0; i < ChunkCount(); ++i)
+    {
+        Chunk* chunk = m_Chunks[i];
+
+        for(long row = 0; row < chunk->count; ++row)
+            for(unsigned int column = 0; column < m_Types.size(); ++column)
+                m_Types[column]->destroy(Get(chunk, column, row));
+    }
+
+    for(unsigned int i = 0; i < m_Chunks.size(); ++i)
+    {
+        if(!m_Chunks[i]->borrowed)
+            FreeBlock(m_Chunks[i]->data);
+
+        delete m_Chunks[i];
+    }
+}
+
+int Archetype::ColumnIndex(TypeHash typeID) const
+{
+    std::vector<TypeHash>::const_iterator it = std::lower_bound(m_Signature.begin(), m_Signature.end(), typeID);
+
+    if(it == m_Signature.end() || *it != typeID)
+        return -1;
+
+    return int(it - m_Signature.begin());
+}
+
+void Archetype::Allocate(EntityHandle entity, Chunk*& chunk, long& row)
+{
+    long index = m_Size / m_Capacity;
+
+    if(index == long(m_Chunks.size()))
+        NewChunk();
+
+    chunk = m_Chunks[index];
+    row = chunk->count++;
+    Entities(chunk)[row] = entity;
+    m_Size++;
+}
+
+long Archetype::AllocateRange(long count, Chunk*& chunk, long& first)
+{
+    long index = m_Size / m_Capacity;
+
+    if(index == long(m_Chunks.size()))
+        NewChunk();
+
+    chunk = m_Chunks[index];
+    first = chunk->count;
+
+    long added = std::min(count, m_Capacity - first);
+    chunk->count += added;
+    m_Size += added;
+
+    return added;
+}
+
+void Archetype::Reserve(long count)
+{
+    long needed = (m_Size + count + m_Capacity - 1) / m_Capacity;
+
+    m_Chunks.reserve(needed);
+
+    while(long(m_Chunks.size()) < needed)
+        NewChunk();
+}
+
+void Archetype::SetTag(Chunk* chunk, unsigned int tag, long row, bool value) const
+{
+    SetBit(chunk->tags[tag], row, value);
+}
+
+void Archetype::SetBit(std::unique_ptr<std::uint64_t[]>& bits, long row, bool value) const
+{
+    if(bits == nullptr)
+    {
+        if(!value)
+            return;
+
+        bits.reset(new std::uint64_t[TagWords()]());
+    }
+
+    std::uint64_t bit = std::uint64_t(1) << (row % 64);
+
+    if(value)
+        bits[row / 64] |= bit;
+    else
+        bits[row / 64] &= ~bit;
+}
+
+bool Archetype::SleepRow(Chunk* chunk, long row, std::uint32_t version) const
+{
+    // per chunk versions cannot say which row was written, so a write
+    // anywhere in the chunk counts against every mark
+    bool stale = chunk->drowsy == 0;
+
+    for(unsigned int column = 0; column < chunk->versions.size() && !stale; ++column)
+        stale = ChangedSince(chunk->versions[column], chunk->drowsy);
+
+    if(stale)
+    {
+        if(chunk->idle != nullptr)
+            std::fill(chunk->idle.get(), chunk->idle.get() + TagWords(), std::uint64_t(0));
+
+        chunk->drowsy = version;
+    }
+
+    SetBit(chunk->idle, row, true);
+
+    for(long word = 0; word * 64 < chunk->count; ++word)
+    {
+        long rows = std::min(chunk->count - word * 64, 64L);
+        std::uint64_t full = (rows == 64) ? ~std::uint64_t(0) : (std::uint64_t(1) << rows) - 1;
+
+        if(chunk->idle[word] != full)
+            return false;
+    }
+
+    Sleep(chunk, version);
+
+    return true;
+}
+
+long Archetype::ReleaseSpare(long count)
+{
+    long released = 0;
+
+    while(released < count && SpareCount() > 0)
+    {
+        Chunk* spare = m_Chunks.back();
+        m_Chunks.pop_back();
+
+        if(!spare->borrowed)
+            FreeBlock(spare->data);
+
+        delete spare;
+        released++;
+    }
+
+    if(SpareCount() == 0)
+        m_Chunks.shrink_to_fit();
+
+    return released;
+}
+
+void Archetype::NewChunk()
+{
+    Chunk* fresh = new Chunk;
+    fresh->data = AllocateBlock(m_ChunkBytes);
+    fresh->count = 0;
+    fresh->versions.assign(m_Types.size(), 0);
+    fresh->asleep = 0;
+    std::fill(fresh->tagVersions, fresh->tagVersions + TagInfo::MAX_TAGS, std::uint32_t(0));
+    fresh->drowsy = 0;
+    fresh->borrowed = false;
+    m_Chunks.push_back(fresh);
+}
+
+Chunk* Archetype::AdoptChunk(unsigned char* data, long count)
+{
+    if(m_Size % m_Capacity != 0 || count < 1 || count > m_Capacity)
+        throw std::logic_error("Chunk cannot be adopted here");
+
+    Chunk* adopted = new Chunk;
+    adopted->data = data;
+    adopted->count = count;
+    adopted->versions.assign(m_Types.size(), 0);
+    adopted->asleep = 0;
+    std::fill(adopted->tagVersions, adopted->tagVersions + TagInfo::MAX_TAGS, std::uint32_t(0));
+    adopted->drowsy = 0;
+    adopted->borrowed = true;
+
+    // empty chunks kept for reuse stay behind the ones in use
+    m_Chunks.insert(m_Chunks.begin() + ChunkCount(), adopted);
+    m_Size += count;
+
+    return adopted;
+}
+
+EntityHandle Archetype::Remove(Chunk* chunk, long row)
+{
+    for(unsigned int column = 0; column < m_Types.size(); ++column)
+        m_Types[column]->destroy(Get(chunk, column, row));
+
+    return Release(chunk, row);
+}
+
+EntityHandle Archetype::Release(Chunk* chunk, long row)
+{
+    Chunk* last = m_Chunks[(m_Size - 1) / m_Capacity];
+    long lastRow = last->count - 1;
+    EntityHandle moved;
+
+    // keep the storage dense by moving the very last row into the gap
+    if(last != chunk || lastRow != row)
+    {
+        for(unsigned int column = 0; column < m_Types.size(); ++column)
+        {
+            const ComponentInfo* info = m_Types[column];
+            void* src = Get(last, column, lastRow);
+            void* dst = Get(chunk, column, row);
+
+            if(info->trivial)
+                std::memcpy(dst, src, info->size);
+            else
+            {
+                info->moveConstruct(dst, src);
+                info->destroy(src);
+            }
+        }
+
+        moved = Entities(last)[lastRow];
+        Entities(chunk)[row] = moved;
+    }
+
+    for(unsigned int tag = 0; tag < TagInfo::MAX_TAGS; ++tag)
+    {
+        if(last->tags[tag] == nullptr && chunk->tags[tag] == nullptr)
+            continue;
+
+        SetTag(chunk, tag, row, HasTag(last, tag, lastRow));
+        SetTag(last, tag, lastRow, false);
+    }
+
+    if(last->idle != nullptr || chunk->idle != nullptr)
+    {
+        SetBit(chunk->idle, row, GetBit(last->idle, lastRow));
+        SetBit(last->idle, lastRow, false);
+    }
+
+    last->count--;
+    m_Size--;
+
+    return moved;
+}
+
+void Archetype::MoveRow(Chunk* chunk, long row, Archetype& dest, Chunk* destChunk, long destRow)
+{
+    for(unsigned int column = 0; column < m_Types.size(); ++column)
+    {
+        const ComponentInfo* info = m_Types[column];
+        void* src = Get(chunk, column, row);
+        int destColumn = dest.ColumnIndex(info->typeID);
+
+        if(destColumn >= 0)
+        {
+            void* dst = dest.Get(destChunk, destColumn, destRow);
+
+            if(info->trivial)
+            {
+                std::memcpy(dst, src, info->size);
+                continue;
+            }
+
+            info->moveConstruct(dst, src);
+        }
+
+        info->destroy(src);
+    }
+
+    // the destination row is fresh, so only set bits need copying
+    for(unsigned int tag = 0; tag < TagInfo::MAX_TAGS; ++tag)
+        if(HasTag(chunk, tag, row))
+            dest.SetTag(destChunk, tag, destRow, true);
+}
+
+unsigned char* Archetype::AllocateBlock(std::size_t size)
+{
+    // over allocate and stash the original pointer just before the block
+    unsigned char* raw = static_cast<unsigned char*>(std::malloc(size + COLUMN_ALIGN + sizeof(void*)));
+
+    if(raw == nullptr)
+        throw std::bad_alloc();
+
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw + sizeof(void*));
+    unsigned char* block = reinterpret_cast<unsigned char*>(AlignUp(start, COLUMN_ALIGN));
+    reinterpret_cast<void**>(block)[-1] = raw;
+
+    return block;
+}
+
+void Archetype::FreeBlock(unsigned char* block)
+{
+    std::free(reinterpret_cast<void**>(block)[-1]);
+}
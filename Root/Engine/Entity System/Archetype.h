@@ -0,0 +1,404 @@
+// File: Archetype.h
+// Storage for the component data of the World. Every distinct set of
+// component types an entity can have is an archetype, and all entities of an
+// archetype live together in fixed size chunks. Inside a chunk each component
+// type gets its own contiguous, cache line aligned column, so iterating one
+// type walks linear memory instead of chasing pointers.
+
+#ifndef SENTIMENT_ARCHETYPE_H
+#define SENTIMENT_ARCHETYPE_H
+
+#include "Handle.h"
+#include "TypeID.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+// StaticRegistration
+//     Get<T>() of ComponentInfo and TagInfo touches info, so every type the
+//     program instantiates Get<T>() for anywhere is registered during static
+//     initialization. A snapshot can then find its types by id in a process
+//     that has not used them yet.
+//------------------------------------------------------------------------------------------
+template<class TInfo, class T>
+struct StaticRegistration
+{
+    static const TInfo* const info;
+};
+
+template<class TInfo, class T>
+const TInfo* const StaticRegistration<TInfo, T>::info = TInfo::template Get<T>();
+
+//------------------------------------------------------------------------------------------
+// ComponentInfo
+//     everything the storage needs to know to move and destroy a component
+//     type without knowing the type itself.
+//------------------------------------------------------------------------------------------
+struct ComponentInfo
+{
+    TypeHash typeID;
+
+    // dense number handed out in the order types are first used, for tables
+    // indexed by type. it differs between runs, persist typeID or name
+    unsigned int index;
+
+    // compiler generated type name, for messages. persist typeID instead
+    const char* name;
+    std::size_t size;
+    std::size_t align;
+
+    // trivially copyable types are relocated with memcpy
+    bool trivial;
+
+    // constructs dst from src, src is destroyed separately afterwards
+    void (*moveConstruct)(void* dst, void* src);
+
+    // nullptr if the type cannot be copied
+    void (*copyConstruct)(void* dst, const void* src);
+
+    void (*destroy)(void* object);
+
+    template<class T>
+    static const ComponentInfo* Get();
+
+    // info of a type the program uses anywhere, or nullptr. see
+    // StaticRegistration
+    static const ComponentInfo* Find(const std::string& name);
+
+    static const ComponentInfo* Find(TypeHash typeID);
+
+    // number of dense indices handed out so far
+    static unsigned int Count();
+
+private:
+    template<class T>
+    static void MoveConstruct(void* dst, void* src) {new(dst) T(std::move(*static_cast<T*>(src)));}
+
+    template<class T>
+    static void CopyConstruct(void* dst, const void* src) {new(dst) T(*static_cast<const T*>(src));}
+
+    template<class T>
+    static void Destroy(void* object) {static_cast<T*>(object)->~T();}
+
+    typedef void (*COPY_CONSTRUCT)(void* dst, const void* src);
+
+    template<class T>
+    static COPY_CONSTRUCT CopyFunction(std::true_type) {return &CopyConstruct<T>;}
+
+    template<class T>
+    static COPY_CONSTRUCT CopyFunction(std::false_type) {return nullptr;}
+
+    // returns the info registered first for the type id, so every module
+    // ends up sharing one, and assigns the index of new ones. throws
+    // std::logic_error if two different types hash to the same id
+    static const ComponentInfo* Register(ComponentInfo* info);
+};
+
+template<class T>
+const ComponentInfo* ComponentInfo::Get()
+{
+    static ComponentInfo info =
+    {
+        T::TypeID(),
+        0,
+        typeid(T).name(),
+        sizeof(T),
+        std::alignment_of<T>::value,
+        std::is_trivially_copyable<T>::value,
+        &MoveConstruct<T>,
+        CopyFunction<T>(std::is_copy_constructible<T>()),
+        &Destroy<T>
+    };
+
+    static const ComponentInfo* registered = Register(&info);
+
+    (void)StaticRegistration<ComponentInfo, T>::info;
+
+    return registered;
+}
+
+//------------------------------------------------------------------------------------------
+// TagInfo
+//     a marker type without any data. Tags are not part of the archetype,
+//     every chunk keeps a bit per row for each tag instead, so tagging an
+//     entity costs a bit and does not move it.
+//------------------------------------------------------------------------------------------
+struct TagInfo
+{
+    // tag types a program can use, each one gets a bit column
+    static const unsigned int MAX_TAGS = 32;
+
+    TypeHash typeID;
+
+    // dense number below MAX_TAGS, the bit column of the tag. like
+    // ComponentInfo::index it differs between runs
+    unsigned int index;
+
+    const char* name;
+
+    template<class T>
+    static const TagInfo* Get();
+
+    // info of a tag the program uses anywhere, or nullptr. see
+    // StaticRegistration
+    static const TagInfo* Find(const std::string& name);
+
+    static const TagInfo* Find(TypeHash typeID);
+
+    static const TagInfo* Find(unsigned int index);
+
+private:
+    // as ComponentInfo::Register(), and also throws std::logic_error once
+    // MAX_TAGS tags are in use
+    static const TagInfo* Register(TagInfo* info);
+};
+
+template<class T>
+const TagInfo* TagInfo::Get()
+{
+    static TagInfo info = {T::TypeID(), 0, typeid(T).name()};
+
+    static const TagInfo* registered = Register(&info);
+
+    (void)StaticRegistration<TagInfo, T>::info;
+
+    return registered;
+}
+
+//------------------------------------------------------------------------------------------
+// Chunk
+//     one fixed size block of an archetype. The first column holds the
+//     entity handle of every row, the rest hold one component type each.
+//     Every component column carries the World version it was last written
+//     at, so systems can skip chunks nothing has touched. A chunk can also be
+//     put to sleep, and queries that ask for it skip it until it is written
+//     again.
+//------------------------------------------------------------------------------------------
+struct Chunk
+{
+    unsigned char* data;
+    long count;
+    std::vector<std::uint32_t> versions;
+
+    // World version the chunk was put to sleep at, 0 if it never was. any
+    // column written at or after it wakes the chunk
+    std::uint32_t asleep;
+
+    // a bit per row marked idle by Archetype::SleepRow(), and the version
+    // the oldest of those marks was made at. nullptr until a row is first
+    // marked. rows past count are always clear
+    std::unique_ptr<std::uint64_t[]> idle;
+    std::uint32_t drowsy;
+
+    // data points into memory the archetype does not own, a loaded snapshot
+    bool borrowed;
+
+    // a bit per row for every tag, by TagInfo::index. nullptr until a row
+    // of the chunk first gets the tag. rows past count are always clear
+    std::unique_ptr<std::uint64_t[]> tags[TagInfo::MAX_TAGS];
+
+    // World version a row last gained or lost each tag at, like versions
+    std::uint32_t tagVersions[TagInfo::MAX_TAGS];
+};
+
+// true if a change stamped with version happened at or after since. versions
+// wrap around, so they are compared by distance. a since of 0 means never,
+// and everything has changed since then
+inline bool ChangedSince(std::uint32_t version, std::uint32_t since)
+{
+    return since == 0 || std::int32_t(version - since) >= 0;
+}
+
+class Archetype
+{
+public:
+    // bytes per chunk, sized to sit comfortably in L1/L2 while iterating
+    static const std::size_t CHUNK_SIZE = 16 * 1024;
+
+    // alignment of every column, enough for any SIMD load
+    static const std::size_t COLUMN_ALIGN = 64;
+
+public:
+    // types must be sorted by type id
+    Archetype(const std::vector<const ComponentInfo*>& types);
+
+    ~Archetype();
+
+    const std::vector<TypeHash>& Signature() const {return m_Signature;}
+
+    const std::vector<const ComponentInfo*>& Types() const {return m_Types;}
+
+    // column of the given type, or -1 if the archetype does not have it
+    int ColumnIndex(TypeHash typeID) const;
+
+    bool Has(TypeHash typeID) const {return ColumnIndex(typeID) >= 0;}
+
+    // rows per chunk
+    long Capacity() const {return m_Capacity;}
+
+    // entities stored across all chunks
+    long Size() const {return m_Size;}
+
+    // chunks that hold at least one entity
+    long ChunkCount() const {return (m_Size + m_Capacity - 1) / m_Capacity;}
+
+    Chunk* GetChunk(long index) const {return m_Chunks[index];}
+
+    EntityHandle* Entities(const Chunk* chunk) const {return reinterpret_cast<EntityHandle*>(chunk->data);}
+
+    void* Column(const Chunk* chunk, int column) const {return chunk->data + m_Offsets[column];}
+
+    // byte offset of a column inside every chunk
+    std::size_t ColumnOffset(int column) const {return m_Offsets[column];}
+
+    // bytes per chunk, CHUNK_SIZE unless a row does not fit into that
+    std::size_t ChunkBytes() const {return m_ChunkBytes;}
+
+    void* Get(const Chunk* chunk, int column, long row) const {return chunk->data + m_Offsets[column] + m_Types[column]->size * row;}
+
+    template<class T>
+    T* Column(const Chunk* chunk) const {return static_cast<T*>(Column(chunk, ColumnIndex(T::TypeID())));}
+
+    std::uint32_t ChangeVersion(const Chunk* chunk, int column) const {return chunk->versions[column];}
+
+    void MarkChanged(Chunk* chunk, int column, std::uint32_t version) const {chunk->versions[column] = version;}
+
+    // marks every column and tag, for rows that were just moved or filled in
+    void MarkChanged(Chunk* chunk, std::uint32_t version) const
+    {
+        chunk->versions.assign(m_Types.size(), version);
+        std::fill(chunk->tagVersions, chunk->tagVersions + TagInfo::MAX_TAGS, version);
+    }
+
+    std::uint32_t TagChangeVersion(const Chunk* chunk, unsigned int tag) const {return chunk->tagVersions[tag];}
+
+    void MarkTagChanged(Chunk* chunk, unsigned int tag, std::uint32_t version) const {chunk->tagVersions[tag] = version;}
+
+    // words of tag bits per chunk
+    long TagWords() const {return (m_Capacity + 63) / 64;}
+
+    // nullptr if no row of the chunk ever had the tag
+    const std::uint64_t* TagBits(const Chunk* chunk, unsigned int tag) const {return chunk->tags[tag].get();}
+
+    bool HasTag(const Chunk* chunk, unsigned int tag, long row) const
+    {
+        const std::uint64_t* bits = chunk->tags[tag].get();
+
+        return bits != nullptr && (bits[row / 64] >> (row % 64) & 1) != 0;
+    }
+
+    void SetTag(Chunk* chunk, unsigned int tag, long row, bool value) const;
+
+    // puts the whole chunk to sleep. version must be newer than every
+    // column version of the chunk
+    void Sleep(Chunk* chunk, std::uint32_t version) const {chunk->asleep = version;}
+
+    // marks a row idle, and puts the chunk to sleep once every row of it is
+    // marked with nothing written to the chunk since the first mark. marks
+    // made before a write are dropped. version as for Sleep(). returns true
+    // if the chunk went to sleep
+    bool SleepRow(Chunk* chunk, long row, std::uint32_t version) const;
+
+    // also drops the idle marks
+    void Wake(Chunk* chunk) const
+    {
+        chunk->asleep = 0;
+        chunk->drowsy = 0;
+    }
+
+    bool IsAsleep(const Chunk* chunk) const
+    {
+        if(chunk->asleep == 0)
+            return false;
+
+        for(unsigned int column = 0; column < chunk->versions.size(); ++column)
+            if(ChangedSince(chunk->versions[column], chunk->asleep))
+                return false;
+
+        return true;
+    }
+
+    // appends a row for entity, its components are left unconstructed
+    void Allocate(EntityHandle entity, Chunk*& chunk, long& row);
+
+    // appends up to count rows to the last chunk in use, or a fresh one if
+    // it is full, and returns how many it appended starting at row first.
+    // neither the entity handles nor the components are filled in
+    long AllocateRange(long count, Chunk*& chunk, long& first);
+
+    // makes room for count more rows without allocating on the way
+    void Reserve(long count);
+
+    // empty chunks kept behind the ones in use for reuse
+    long SpareCount() const {return long(m_Chunks.size()) - ChunkCount();}
+
+    // frees up to count spare chunks, the last ones first, and returns how
+    // many. borrowed chunks are only dropped, their memory is not ours
+    long ReleaseSpare(long count);
+
+    // appends a chunk laid out by this archetype whose memory is owned by
+    // someone else and must outlive it. the last chunk in use must be full
+    Chunk* AdoptChunk(unsigned char* data, long count);
+
+    // destroys every component of the row and closes the gap. returns the
+    // entity that was moved into the row, or a null handle if the row was
+    // the last one
+    EntityHandle Remove(Chunk* chunk, long row);
+
+    // closes the gap of a row whose components were already destroyed or
+    // moved out. same return as Remove()
+    EntityHandle Release(Chunk* chunk, long row);
+
+    // moves the components both archetypes share from a row of this one into
+    // a row of dest, and destroys the rest. tags go along. the source row
+    // still needs Release()
+    void MoveRow(Chunk* chunk, long row, Archetype& dest, Chunk* destChunk, long destRow);
+
+    // cached neighbours in the archetype graph, one type added or removed
+    std::map<TypeHash, Archetype*> addEdges;
+    std::map<TypeHash, Archetype*> removeEdges;
+
+private:
+    Archetype(const Archetype&);
+    Archetype& operator=(const Archetype&);
+
+    // appends an empty chunk
+    void NewChunk();
+
+    // sets or clears the bit of row in a tag or idle bit column, allocating
+    // the column when the first bit is set
+    void SetBit(std::unique_ptr<std::uint64_t[]>& bits, long row, bool value) const;
+
+    static bool GetBit(const std::unique_ptr<std::uint64_t[]>& bits, long row)
+    {
+        return bits != nullptr && (bits[row / 64] >> (row % 64) & 1) != 0;
+    }
+
+    static unsigned char* AllocateBlock(std::size_t size);
+
+    static void FreeBlock(unsigned char* block);
+
+private:
+    std::vector<TypeHash> m_Signature;
+    std::vector<const ComponentInfo*> m_Types;
+    std::vector<std::size_t> m_Offsets;
+
+    std::size_t m_ChunkBytes;
+    long m_Capacity;
+    long m_Size;
+
+    // chunks are filled front to back, empty ones at the end are kept for reuse
+    std::vector<Chunk*> m_Chunks;
+};
+
+#endif
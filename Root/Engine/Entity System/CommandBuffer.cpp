@@ -0,0 +1,81 @@
+#include "CommandBuffer.h"
+
+#include <cstdint>
+#include <utility>
+
+const std::size_t CommandBuffer::BLOCK_SIZE;
+
+CommandBuffer::CommandBuffer() :
+    m_Created(0),
+    m_CurrentBlock(0),
+    m_Used(0)
+{
+}
+
+CommandBuffer::~CommandBuffer()
+{
+    Clear();
+}
+
+EntityHandle CommandBuffer::CreateEntity()
+{
+    // pending handles count from 1 so they are never null
+    EntityHandle entity(++m_Created, 0);
+    Record(CREATE_ENTITY, entity, nullptr, nullptr);
+
+    return entity;
+}
+
+void CommandBuffer::RemoveEntity(EntityHandle entity)
+{
+    Record(REMOVE_ENTITY, entity, nullptr, nullptr);
+}
+
+void CommandBuffer::Clear()
+{
+    for(unsigned int i = 0; i < m_Commands.size(); ++i)
+        if(m_Commands[i].payload != nullptr)
+            m_Commands[i].info->destroy(m_Commands[i].payload);
+
+    m_Commands.clear();
+    m_Created = 0;
+    m_CurrentBlock = 0;
+    m_Used = 0;
+}
+
+void CommandBuffer::Record(COMMAND_TYPE type, EntityHandle entity, const ComponentInfo* info, void* payload)
+{
+    Command command = {type, entity, info, payload};
+    m_Commands.push_back(command);
+}
+
+void* CommandBuffer::Allocate(std::size_t size, std::size_t align)
+{
+    for(;;)
+    {
+        while(m_CurrentBlock < m_Blocks.size())
+        {
+            Block& block = m_Blocks[m_CurrentBlock];
+            std::uintptr_t start = reinterpret_cast<std::uintptr_t>(block.data.get());
+            std::uintptr_t offset = (start + m_Used + align - 1) & ~std::uintptr_t(align - 1);
+
+            if(offset + size <= start + block.size)
+            {
+                m_Used = offset + size - start;
+                return reinterpret_cast<void*>(offset);
+            }
+
+            m_CurrentBlock++;
+            m_Used = 0;
+        }
+
+        // only reached when every block is used up, so the new one is current
+        Block block;
+        block.size = (size + align > BLOCK_SIZE) ? size + align : BLOCK_SIZE;
+        block.data.reset(new unsigned char[block.size]);
+
+        m_Blocks.push_back(std::move(block));
+        m_CurrentBlock = (unsigned int)m_Blocks.size() - 1;
+        m_Used = 0;
+    }
+}
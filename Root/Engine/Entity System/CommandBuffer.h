@@ -0,0 +1,125 @@
+// File: CommandBuffer.h
+// Deferred structural changes. Creating or removing entities and components
+// moves rows between archetypes, which must never happen while a system is
+// walking those archetypes. Systems record the changes into a command buffer
+// instead, and the World applies every buffer in one batch at its next sync
+// point, folding all changes to an entity into a single move.
+
+#ifndef SENTIMENT_COMMANDBUFFER_H
+#define SENTIMENT_COMMANDBUFFER_H
+
+#include "Archetype.h"
+#include "Handle.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+// CommandBuffer
+//     records create/remove operations for a World without touching it. A
+//     buffer is not thread safe, use World::Commands() to get the one that
+//     belongs to the calling thread.
+//
+//     CreateEntity() returns a pending handle: its generation is 0, so the
+//     World treats it as stale, but the other calls on the same buffer accept
+//     it and the World swaps in the real entity when the buffer is applied.
+//------------------------------------------------------------------------------------------
+class CommandBuffer
+{
+public:
+    CommandBuffer();
+
+    ~CommandBuffer();
+
+    EntityHandle CreateEntity();
+
+    // drops everything else recorded for the entity
+    void RemoveEntity(EntityHandle entity);
+
+    // if the entity already has a T by the time the buffer is applied, its
+    // value is replaced
+    template<class T, class ... Args>
+    void AddComponent(EntityHandle entity, const Args&... params);
+
+    template<class T>
+    void RemoveComponent(EntityHandle entity);
+
+    static bool IsPending(EntityHandle entity) {return !entity.IsNull() && entity.Generation() == 0;}
+
+    long Size() const {return long(m_Commands.size());}
+
+    bool Empty() const {return m_Commands.empty();}
+
+    // throws away everything recorded so far, the memory is kept for reuse
+    void Clear();
+
+private:
+    friend class World;
+
+    CommandBuffer(const CommandBuffer&);
+    CommandBuffer& operator=(const CommandBuffer&);
+
+    enum COMMAND_TYPE
+    {
+        CREATE_ENTITY,
+        REMOVE_ENTITY,
+        ADD_COMPONENT,
+        REMOVE_COMPONENT
+    };
+
+    struct Command
+    {
+        COMMAND_TYPE type;
+        EntityHandle entity;
+        const ComponentInfo* info;
+
+        // the constructed component of ADD_COMPONENT, reset to nullptr once
+        // the World has moved it out
+        void* payload;
+    };
+
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size;
+    };
+
+    void Record(COMMAND_TYPE type, EntityHandle entity, const ComponentInfo* info, void* payload);
+
+    // uninitialized storage that stays put until Clear()
+    void* Allocate(std::size_t size, std::size_t align);
+
+    // bytes per payload block, bigger components get a block of their own
+    static const std::size_t BLOCK_SIZE = 4096;
+
+private:
+    std::vector<Command> m_Commands;
+
+    // entities created so far, the index of the next pending handle
+    std::uint32_t m_Created;
+
+    std::vector<Block> m_Blocks;
+    unsigned int m_CurrentBlock;
+    std::size_t m_Used;
+};
+
+template<class T, class ... Args>
+void CommandBuffer::AddComponent(EntityHandle entity, const Args&... params)
+{
+    const ComponentInfo* info = ComponentInfo::Get<T>();
+    void* payload = new(Allocate(sizeof(T), std::alignment_of<T>::value)) T(params...);
+
+    Record(ADD_COMPONENT, entity, info, payload);
+}
+
+template<class T>
+void CommandBuffer::RemoveComponent(EntityHandle entity)
+{
+    Record(REMOVE_COMPONENT, entity, ComponentInfo::Get<T>(), nullptr);
+}
+
+#endif
@@ -0,0 +1,36 @@
+// File: Bounds.h
+// The Bounds component, the box an entity occupies in the SpatialIndex of
+// its World.
+
+#ifndef SENTIMENT_BOUNDS_H
+#define SENTIMENT_BOUNDS_H
+
+#include "../Entity_Engine.h"
+#include "../SpatialIndex.h"
+
+// world space bounds. the World keeps every entity that has them in its
+// SpatialIndex, picking up changes when its systems have run
+class Bounds :
+    public component<Bounds>
+{
+public:
+    Bounds() :
+        isStatic(false)
+    {
+        box.min[0] = box.min[1] = box.min[2] = 0.0f;
+        box.max[0] = box.max[1] = box.max[2] = 0.0f;
+    }
+
+    Bounds(const AABB& ibox, bool iStatic = false) :
+        box(ibox),
+        isStatic(iStatic)
+        {}
+
+    AABB box;
+
+    // static entities are kept in the grid, which is cheaper to query but
+    // slower to move things in
+    bool isStatic;
+};
+
+#endif
@@ -0,0 +1,1220 @@
+#include "Entity_Engine.h"
+#include "Components/Bounds.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#if defined(__GLIBC__) || defined(_WIN32)
+#include <malloc.h>
+#endif
+
+long base_node::m_nextUniqueID = 0;
+
+namespace
+{
+    bool CompareTypes(const ComponentInfo* lhs, const ComponentInfo* rhs)
+    {
+        return lhs->typeID < rhs->typeID;
+    }
+
+    // only net changes are delivered. an entity that gained and lost a type
+    // since the last dispatch is left in neither list
+    void NetChanges(std::vector<EntityHandle>& added, std::vector<EntityHandle>& removed, std::vector<std::pair<EntityHandle, int> >& net)
+    {
+        // additions and removals of one entity alternate, so they cancel out
+        // in pairs and whatever is left over is the net change
+        net.clear();
+
+        for(unsigned int e = 0; e < added.size(); ++e)
+            net.push_back(std::make_pair(added[e], 1));
+
+        for(unsigned int e = 0; e < removed.size(); ++e)
+            net.push_back(std::make_pair(removed[e], -1));
+
+        std::sort(net.begin(), net.end());
+
+        added.clear();
+        removed.clear();
+
+        for(unsigned int e = 0; e < net.size(); )
+        {
+            EntityHandle entity = net[e].first;
+            int count = 0;
+
+            for( ; e < net.size() && net[e].first == entity; ++e)
+                count += net[e].second;
+
+            if(count > 0)
+                added.push_back(entity);
+            else if(count < 0)
+                removed.push_back(entity);
+        }
+    }
+}
+
+World::World(IJobSystem * jobs) :
+    m_Jobs(nullptr),
+    m_PendingSize(0),
+    m_Version(1),
+    m_NextObserverID(1),
+    m_ObservedTags(TagInfo::MAX_TAGS, 0),
+    m_TagEvents(TagInfo::MAX_TAGS),
+    m_SpatialSince(0),
+    m_CompactCursor(0)
+{
+    m_EmptyArchetype = GetArchetype(std::vector<const ComponentInfo*>());
+
+    SetJobSystem(jobs);
+}
+
+World::~World()
+{
+    for(std::map<TypeHash, std::vector<base_node *> >::iterator it = m_Nodes.begin(); it != m_Nodes.end(); ++it)
+        for(unsigned int i = 0; i < it->second.size(); ++i)
+            delete it->second[i];
+
+    m_Nodes.clear();
+
+    // payloads still in the buffers are destroyed by the buffers
+    m_Commands.clear();
+
+    // archetypes destroy the components they still hold
+    m_Archetypes.clear();
+}
+
+void World::SetJobSystem(IJobSystem * jobs)
+{
+    m_Jobs = jobs;
+
+    // buffers are only ever added so nothing recorded so far is lost
+    unsigned int threads = (jobs != nullptr) ? jobs->WorkerCount() + 1 : 1;
+
+    while(m_Commands.size() < threads)
+        m_Commands.push_back(std::unique_ptr<CommandBuffer>(new CommandBuffer()));
+}
+
+EntityHandle World::CreateEntity(const std::string& name)
+{
+    // checked up front, SetName throwing would leave the entity behind
+    if(!name.empty() && m_EntityByName.count(name) != 0)
+        throw std::runtime_error("Entity '" + name + "' already exists");
+
+    EntityRecord record = {m_EmptyArchetype, nullptr, 0};
+    EntityHandle entity = m_Entities.Create(record);
+
+    if(entity.IsNull())
+        throw std::runtime_error("Out of entity handles");
+
+    EntityRecord& stored = m_Entities[entity];
+    m_EmptyArchetype->Allocate(entity, stored.chunk, stored.row);
+
+    if(!name.empty())
+        SetName(entity, name);
+
+    return entity;
+}
+
+void World::Instantiate(const Prefab& prefab, long count, EntityHandle * entities)
+{
+    if(count <= 0)
+        return;
+
+    const std::vector<const ComponentInfo*>& types = prefab.Types();
+
+    for(unsigned int i = 0; i < types.size(); ++i)
+        if(types[i]->copyConstruct == nullptr)
+            throw std::runtime_error("Prefab component is not copyable");
+
+    if(m_Entities.Size() + (long long)count > m_Entities.Capacity())
+        throw std::runtime_error("Out of entity handles");
+
+    Archetype * archetype = GetArchetype(types);
+    std::uint32_t version = Version();
+
+    m_Entities.Reserve(m_Entities.Size() + count);
+    archetype->Reserve(count);
+
+    for(long done = 0; done < count; )
+    {
+        Chunk * chunk;
+        long first;
+        long added = archetype->AllocateRange(count - done, chunk, first);
+
+        EntityHandle * handles = archetype->Entities(chunk);
+
+        for(long i = 0; i < added; ++i)
+        {
+            EntityRecord record = {archetype, chunk, first + i};
+            handles[first + i] = m_Entities.Create(record);
+        }
+
+        if(entities != nullptr)
+            std::copy(handles + first, handles + first + added, entities + done);
+
+        // fill column by column, so every column is written front to back
+        unsigned int column = 0;
+        long built = 0;
+
+        try
+        {
+            for(; column < types.size(); ++column)
+            {
+                const ComponentInfo* info = types[column];
+                unsigned char* dst = static_cast<unsigned char*>(archetype->Get(chunk, column, first));
+
+                if(info->trivial)
+                {
+                    // one copy of the prefab, then keep doubling what is there
+                    std::memcpy(dst, prefab.Value(column), info->size);
+
+                    for(long filled = 1; filled < added; )
+                    {
+                        long step = std::min(filled, added - filled);
+                        std::memcpy(dst + filled * info->size, dst, step * info->size);
+                        filled += step;
+                    }
+                }
+                else
+                {
+                    for(built = 0; built < added; ++built)
+                        info->copyConstruct(dst + built * info->size, prefab.Value(column));
+                }
+            }
+        }
+        catch(...)
+        {
+            // only copy constructors throw, so the columns before the one
+            // that did are whole and that one has its first built rows
+            for(unsigned int c = 0; c <= column; ++c)
+            {
+                if(types[c]->trivial)
+                    continue;
+
+                for(long i = 0; i < (c < column ? added : built); ++i)
+                    types[c]->destroy(archetype->Get(chunk, c, first + i));
+            }
+
+            // the rows are the last of the archetype, so nothing moves
+            for(long i = added - 1; i >= 0; --i)
+            {
+                m_Entities.Destroy(handles[first + i]);
+                archetype->Release(chunk, first + i);
+            }
+
+            // the entities of the batches before are whole and now at the
+            // end of the archetype
+            for(long i = 0; i < done; ++i)
+            {
+                Chunk * last = archetype->GetChunk(archetype->ChunkCount() - 1);
+                RemoveEntity(archetype->Entities(last)[last->count - 1]);
+            }
+
+            throw;
+        }
+
+        archetype->MarkChanged(chunk, version);
+        QueueAdded(archetype, handles + first, added);
+        done += added;
+    }
+}
+
+EntityHandle World::Instantiate(const Prefab& prefab)
+{
+    EntityHandle entity;
+    Instantiate(prefab, 1, &entity);
+
+    return entity;
+}
+
+bool World::RemoveEntity(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record == nullptr)
+        return false;
+
+    Chunk * chunk = record->chunk;
+    long row = record->row;
+
+    if(record->archetype->Has(Bounds::TypeID()))
+        m_Spatial.Remove(entity);
+
+    m_Transforms.Remove(entity);
+
+    QueueEvents(entity, record->archetype, nullptr);
+
+    for(unsigned int tag = 0; tag < TagInfo::MAX_TAGS; ++tag)
+        if(IsTagTracked(tag) && record->archetype->HasTag(chunk, tag, row))
+            m_TagEvents[tag].removed.push_back(entity);
+
+    Relocated(record->archetype->Remove(chunk, row), chunk, row);
+
+    m_Entities.Destroy(entity);
+
+    std::map<EntityHandle, std::string>::iterator name = m_Names.find(entity);
+    if(name != m_Names.end())
+    {
+        m_EntityByName.erase(name->second);
+        m_Names.erase(name);
+    }
+
+    return true;
+}
+
+void World::SetName(EntityHandle entity, const std::string& name)
+{
+    if(!m_Entities.IsAlive(entity))
+        throw std::out_of_range("Stale entity handle");
+
+    // a clash keeps the old name
+    std::map<std::string, EntityHandle>::iterator owner = m_EntityByName.find(name);
+    if(owner != m_EntityByName.end() && owner->second != entity)
+        throw std::runtime_error("Entity '" + name + "' already exists");
+
+    std::map<EntityHandle, std::string>::iterator old = m_Names.find(entity);
+    if(old != m_Names.end())
+    {
+        m_EntityByName.erase(old->second);
+        m_Names.erase(old);
+    }
+
+    if(name.empty())
+        return;
+
+    m_Names.insert(std::make_pair(entity, name));
+    m_EntityByName.insert(std::make_pair(name, entity));
+}
+
+const std::string& World::GetName(EntityHandle entity) const
+{
+    static const std::string unnamed;
+
+    std::map<EntityHandle, std::string>::const_iterator it = m_Names.find(entity);
+
+    return (it != m_Names.end()) ? it->second : unnamed;
+}
+
+EntityHandle World::FindEntity(const std::string& name) const
+{
+    std::map<std::string, EntityHandle>::const_iterator it = m_EntityByName.find(name);
+
+    return (it != m_EntityByName.end()) ? it->second : EntityHandle();
+}
+
+World::EntityRecord& World::Record(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record == nullptr)
+        throw std::out_of_range("Stale entity handle");
+
+    return *record;
+}
+
+Archetype * World::GetArchetype(const std::vector<const ComponentInfo*>& types)
+{
+    std::vector<TypeHash> signature;
+    for(unsigned int i = 0; i < types.size(); ++i)
+        signature.push_back(types[i]->typeID);
+
+    std::map<std::vector<TypeHash>, Archetype*>::iterator it = m_ArchetypeBySignature.find(signature);
+
+    if(it != m_ArchetypeBySignature.end())
+        return it->second;
+
+    Archetype * archetype = new Archetype(types);
+    m_Archetypes.push_back(std::unique_ptr<Archetype>(archetype));
+    m_ArchetypeBySignature.insert(std::make_pair(signature, archetype));
+
+    // archetypes are the only thing queries match against, so this is the
+    // one place they need updating
+    std::lock_guard<std::mutex> lock(m_QueryLock);
+
+    for(unsigned int i = 0; i < m_Queries.size(); ++i)
+        m_Queries[i]->Consider(archetype);
+
+    return archetype;
+}
+
+Query& World::GetQuery(const std::vector<TypeHash>& types)
+{
+    std::lock_guard<std::mutex> lock(m_QueryLock);
+
+    std::map<std::vector<TypeHash>, Query*>::iterator it = m_QueryByTypes.find(types);
+
+    if(it != m_QueryByTypes.end())
+        return *it->second;
+
+    Query * query = new Query(types, m_Version);
+    m_Queries.push_back(std::unique_ptr<Query>(query));
+    m_QueryByTypes.insert(std::make_pair(types, query));
+
+    for(unsigned int i = 0; i < m_Archetypes.size(); ++i)
+        query->Consider(m_Archetypes[i].get());
+
+    return *query;
+}
+
+Archetype * World::AddType(Archetype * from, const ComponentInfo* info)
+{
+    std::map<TypeHash, Archetype*>::iterator edge = from->addEdges.find(info->typeID);
+
+    if(edge != from->addEdges.end())
+        return edge->second;
+
+    std::vector<const ComponentInfo*> types = from->Types();
+    types.insert(std::lower_bound(types.begin(), types.end(), info, CompareTypes), info);
+
+    Archetype * to = GetArchetype(types);
+    from->addEdges[info->typeID] = to;
+    to->removeEdges[info->typeID] = from;
+
+    return to;
+}
+
+Archetype * World::RemoveType(Archetype * from, TypeHash typeID)
+{
+    std::map<TypeHash, Archetype*>::iterator edge = from->removeEdges.find(typeID);
+
+    if(edge != from->removeEdges.end())
+        return edge->second;
+
+    std::vector<const ComponentInfo*> types = from->Types();
+    types.erase(types.begin() + from->ColumnIndex(typeID));
+
+    Archetype * to = GetArchetype(types);
+    from->removeEdges[typeID] = to;
+    to->addEdges[typeID] = from;
+
+    return to;
+}
+
+void World::MoveEntity(EntityHandle entity, Archetype * dest)
+{
+    EntityRecord& record = m_Entities[entity];
+    Archetype * from = record.archetype;
+    Chunk * chunk = record.chunk;
+    long row = record.row;
+
+    // additions are picked up by UpdateSpatial() through change tracking,
+    // removals are not visible there
+    if(from->Has(Bounds::TypeID()) && !dest->Has(Bounds::TypeID()))
+        m_Spatial.Remove(entity);
+
+    QueueEvents(entity, from, dest);
+
+    Chunk * destChunk;
+    long destRow;
+    dest->Allocate(entity, destChunk, destRow);
+
+    from->MoveRow(chunk, row, *dest, destChunk, destRow);
+
+    record.archetype = dest;
+    record.chunk = destChunk;
+    record.row = destRow;
+
+    // a structural change counts as a write to everything the entity has
+    dest->MarkChanged(destChunk, Version());
+
+    Relocated(from->Release(chunk, row), chunk, row);
+}
+
+void World::Relocated(EntityHandle entity, Chunk * chunk, long row)
+{
+    // the last row of the archetype was moved into the gap that was left
+    if(entity.IsNull())
+        return;
+
+    EntityRecord& record = m_Entities[entity];
+    record.chunk = chunk;
+    record.row = row;
+
+    record.archetype->MarkChanged(chunk, Version());
+}
+
+void World::AddSystem(const std::string& name, const std::shared_ptr<ISystem>& system)
+{
+    for(unsigned int i = 0; i < m_Systems.size(); ++i)
+        if(m_Systems[i].name == name)
+            throw std::runtime_error("System '" + name + "' already exists");
+
+    SystemEntry entry;
+    entry.name = name;
+    entry.system = system;
+    entry.dependencies = 0;
+
+    SystemStats stats = {0.0, 0.0, 0, 0.0, 0};
+    entry.stats = stats;
+
+    m_Systems.push_back(entry);
+}
+
+void World::RemoveNode(const std::string& name)
+{
+    intrusive::hash_map<std::string, base_node>::iterator found = m_NodeByName.find(name);
+
+    if(found == m_NodeByName.end())
+        return;
+
+    base_node * removed = &*found;
+    std::vector<base_node *>& nodes = m_Nodes[removed->GetTypeID()];
+
+    nodes.erase(std::find(nodes.begin(), nodes.end(), removed));
+
+    if(nodes.empty())
+        m_Nodes.erase(removed->GetTypeID());
+
+    // leaves the name index on its own
+    delete removed;
+}
+
+void World::RemoveSystem(const std::string& name)
+{
+    for(unsigned int i = 0; i < m_Systems.size(); ++i)
+    {
+        if(m_Systems[i].name == name)
+        {
+            m_Systems.erase(m_Systems.begin() + i);
+            return;
+        }
+    }
+}
+
+const World::SystemStats& World::GetSystemStats(const std::string& name) const
+{
+    for(unsigned int i = 0; i < m_Systems.size(); ++i)
+        if(m_Systems[i].name == name)
+            return m_Systems[i].stats;
+
+    throw std::out_of_range("System '" + name + "' does not exist");
+}
+
+void World::ResetSystemPeaks()
+{
+    for(unsigned int i = 0; i < m_Systems.size(); ++i)
+        m_Systems[i].stats.peakTime = 0.0;
+}
+
+void World::Update()
+{
+    BuildSystemGraph();
+
+    if(m_Jobs == nullptr || m_Systems.size() < 2)
+    {
+        for(unsigned int i = 0; i < m_Systems.size(); ++i)
+            RunSystem(m_Systems[i]);
+
+        ApplyCommands();
+        m_Transforms.Update(m_Jobs);
+        UpdateSpatial();
+        DispatchEvents();
+        return;
+    }
+
+    if(m_PendingSize < m_Systems.size())
+    {
+        m_PendingSize = (unsigned int)m_Systems.size();
+        m_Pending.reset(new std::atomic<int>[m_PendingSize]);
+    }
+
+    std::vector<Job> roots;
+
+    for(unsigned int i = 0; i < m_Systems.size(); ++i)
+    {
+        m_Pending[i].store(m_Systems[i].dependencies, std::memory_order_relaxed);
+
+        if(m_Systems[i].dependencies == 0)
+        {
+            Job job = {&World::SystemJob, this, long(i), long(i) + 1, nullptr};
+            roots.push_back(job);
+        }
+    }
+
+    // successors are submitted against the same counter by the job that
+    // releases them, before that job itself finishes, so the counter only
+    // reaches zero once the whole graph has run
+    m_Jobs->Submit(roots.data(), long(roots.size()), &m_SystemsDone);
+    m_Jobs->Wait(m_SystemsDone);
+
+    ApplyCommands();
+    m_Transforms.Update(m_Jobs);
+    UpdateSpatial();
+    DispatchEvents();
+}
+
+void World::Sleep(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record == nullptr)
+        throw std::out_of_range("Stale entity handle");
+
+    record->archetype->SleepRow(record->chunk, record->row, AdvanceVersion());
+}
+
+void World::Wake(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record != nullptr)
+        record->archetype->Wake(record->chunk);
+}
+
+bool World::IsAsleep(EntityHandle entity) const
+{
+    const EntityRecord* record = m_Entities.Get(entity);
+
+    return record != nullptr && record->archetype->IsAsleep(record->chunk);
+}
+
+long World::SleepIdle(std::uint32_t since)
+{
+    // everything from here on is newer than what the chunks hold
+    std::uint32_t version = AdvanceVersion();
+    long slept = 0;
+
+    for(unsigned int i = 0; i < m_Archetypes.size(); ++i)
+    {
+        Archetype& archetype = *m_Archetypes[i];
+
+        for(long c = 0; c < archetype.ChunkCount(); ++c)
+        {
+            Chunk * chunk = archetype.GetChunk(c);
+
+            if(archetype.IsAsleep(chunk))
+                continue;
+
+            bool idle = true;
+
+            for(unsigned int column = 0; column < chunk->versions.size() && idle; ++column)
+                idle = !ChangedSince(chunk->versions[column], since);
+
+            if(idle)
+            {
+                archetype.Sleep(chunk, version);
+                slept++;
+            }
+        }
+    }
+
+    return slept;
+}
+
+World::MemoryStats World::GetMemoryStats() const
+{
+    MemoryStats stats = {m_Entities.Size(), long(m_Archetypes.size()), 0, 0, 0, 0, 0, 1.0, m_Entities.SlotCount(), m_Entities.FreeCount(), m_Entities.MemoryBytes()};
+    long rows = 0;
+
+    for(unsigned int i = 0; i < m_Archetypes.size(); ++i)
+    {
+        const Archetype& archetype = *m_Archetypes[i];
+
+        if(archetype.Size() == 0)
+            stats.emptyArchetypes++;
+
+        stats.chunkCount += archetype.ChunkCount();
+        stats.spareChunks += archetype.SpareCount();
+        rows += archetype.ChunkCount() * archetype.Capacity();
+
+        long total = archetype.ChunkCount() + archetype.SpareCount();
+
+        for(long c = 0; c < total; ++c)
+        {
+            if(archetype.GetChunk(c)->borrowed)
+                continue;
+
+            stats.chunkBytes += archetype.ChunkBytes();
+
+            if(c >= archetype.ChunkCount())
+                stats.spareBytes += archetype.ChunkBytes();
+        }
+    }
+
+    if(rows != 0)
+        stats.density = double(stats.entityCount) / double(rows);
+
+    return stats;
+}
+
+bool World::Compact(long maxChunks)
+{
+    // no budget, one slice does the whole pass
+    if(maxChunks <= 0)
+        maxChunks = std::numeric_limits<long>::max();
+
+    long released = 0;
+
+    while(m_CompactCursor < m_Archetypes.size())
+    {
+        Archetype& archetype = *m_Archetypes[m_CompactCursor];
+        released += archetype.ReleaseSpare(maxChunks - released);
+
+        if(archetype.SpareCount() != 0)
+            return false;
+
+        m_CompactCursor++;
+    }
+
+    m_CompactCursor = 0;
+    m_Entities.Compact();
+
+    // chunks are below the mmap threshold of glibc and the large block
+    // threshold of the windows heap, so freeing them only returns them to
+    // the heap. elsewhere the memory stays with the process until the heap
+    // gives it back by itself
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#elif defined(_WIN32)
+    _heapmin();
+#endif
+
+    return true;
+}
+
+void World::UpdateSpatial()
+{
+    std::uint32_t since = m_SpatialSince;
+    m_SpatialSince = Version();
+
+    query<const Bounds>().Changed<Bounds>(since).EachEntity([this](EntityHandle entity, const Bounds& bounds)
+    {
+        m_Spatial.Set(entity, bounds.box, bounds.isStatic);
+    });
+}
+
+CommandBuffer& World::Commands()
+{
+    unsigned int index = (m_Jobs != nullptr) ? m_Jobs->ThreadIndex() : 0;
+
+    if(index >= m_Commands.size())
+        index = (unsigned int)m_Commands.size() - 1;
+
+    return *m_Commands[index];
+}
+
+void World::ApplyCommands()
+{
+    std::vector<CommandBuffer*> buffers;
+
+    for(unsigned int i = 0; i < m_Commands.size(); ++i)
+        if(!m_Commands[i]->Empty())
+            buffers.push_back(m_Commands[i].get());
+
+    if(!buffers.empty())
+        Apply(buffers.data(), (unsigned int)buffers.size());
+}
+
+void World::ApplyCommands(CommandBuffer& buffer)
+{
+    CommandBuffer * buffers[] = {&buffer};
+
+    if(!buffer.Empty())
+        Apply(buffers, 1);
+}
+
+void World::Apply(CommandBuffer * const * buffers, unsigned int count)
+{
+    typedef CommandBuffer::Command Command;
+
+    // every command that targets an entity, paired with that entity. pending
+    // handles are swapped for the entities created for them on the way
+    std::vector<std::pair<EntityHandle, Command*> > commands;
+
+    for(unsigned int b = 0; b < count; ++b)
+    {
+        std::vector<EntityHandle> created;
+
+        for(unsigned int i = 0; i < buffers[b]->m_Commands.size(); ++i)
+        {
+            Command& command = buffers[b]->m_Commands[i];
+
+            if(command.type == CommandBuffer::CREATE_ENTITY)
+            {
+                created.push_back(CreateEntity());
+                continue;
+            }
+
+            EntityHandle entity = command.entity;
+
+            if(CommandBuffer::IsPending(entity))
+            {
+                EntityHandle::value_type index = entity.Index();
+                entity = (index >= 1 && index <= created.size()) ? created[index - 1] : EntityHandle();
+            }
+
+            commands.push_back(std::make_pair(entity, &command));
+        }
+    }
+
+    // group by entity, keeping the order things were recorded in
+    std::stable_sort(commands.begin(), commands.end(), [](const std::pair<EntityHandle, Command*>& lhs, const std::pair<EntityHandle, Command*>& rhs)
+    {
+        return lhs.first < rhs.first;
+    });
+
+    std::vector<Change> changes;
+    std::vector<Plan> plans;
+    std::vector<EntityHandle> removed;
+
+    for(unsigned int begin = 0, end = 0; begin < commands.size(); begin = end)
+    {
+        EntityHandle entity = commands[begin].first;
+        bool remove = false;
+        unsigned int first = (unsigned int)changes.size();
+
+        for(end = begin; end < commands.size() && commands[end].first == entity; ++end)
+        {
+            Command& command = *commands[end].second;
+
+            if(command.type == CommandBuffer::REMOVE_ENTITY)
+                remove = true;
+
+            if(remove)
+                continue;
+
+            // a later change to the same type replaces the earlier one, the
+            // replaced payload is left for the buffer to destroy
+            unsigned int c = first;
+            while(c < changes.size() && changes[c].info != command.info)
+                ++c;
+
+            Change change = {command.info, (command.type == CommandBuffer::ADD_COMPONENT) ? &command : nullptr};
+
+            if(c == changes.size())
+                changes.push_back(change);
+            else
+                changes[c] = change;
+        }
+
+        // stale handles are skipped, the entity may have been removed by an
+        // earlier batch or directly
+        if(!m_Entities.IsAlive(entity) || remove)
+        {
+            changes.resize(first);
+
+            if(remove)
+                removed.push_back(entity);
+
+            continue;
+        }
+
+        Archetype * from = m_Entities[entity].archetype;
+        Archetype * to = from;
+
+        for(unsigned int c = first; c < changes.size(); ++c)
+        {
+            TypeHash typeID = changes[c].info->typeID;
+
+            if(changes[c].add != nullptr && !to->Has(typeID))
+                to = AddType(to, changes[c].info);
+            else if(changes[c].add == nullptr && to->Has(typeID))
+                to = RemoveType(to, typeID);
+        }
+
+        Plan plan = {entity, from, to, first, (unsigned int)changes.size() - first};
+        plans.push_back(plan);
+    }
+
+    for(unsigned int i = 0; i < removed.size(); ++i)
+        RemoveEntity(removed[i]);
+
+    // entities moving between the same pair of archetypes are handled back
+    // to back, so the rows they leave and fill stay in cache
+    std::stable_sort(plans.begin(), plans.end());
+
+    for(unsigned int p = 0; p < plans.size(); ++p)
+    {
+        const Plan& plan = plans[p];
+
+        if(plan.to != plan.from)
+            MoveEntity(plan.entity, plan.to);
+
+        const EntityRecord& record = m_Entities[plan.entity];
+
+        for(unsigned int c = plan.first; c < plan.first + plan.count; ++c)
+        {
+            Command * add = changes[c].add;
+
+            if(add == nullptr)
+                continue;
+
+            const ComponentInfo* info = add->info;
+            void* slot = plan.to->Get(record.chunk, plan.to->ColumnIndex(info->typeID), record.row);
+
+            // the entity had one already, it was carried over by the move
+            if(plan.from->Has(info->typeID))
+                info->destroy(slot);
+
+            info->moveConstruct(slot, add->payload);
+            info->destroy(add->payload);
+            add->payload = nullptr;
+
+            plan.to->MarkChanged(record.chunk, plan.to->ColumnIndex(info->typeID), Version());
+        }
+    }
+
+    for(unsigned int b = 0; b < count; ++b)
+        buffers[b]->Clear();
+}
+
+void World::BuildSystemGraph()
+{
+    for(unsigned int i = 0; i < m_Systems.size(); ++i)
+    {
+        SystemEntry& entry = m_Systems[i];
+        entry.access.Clear();
+        entry.system->Declare(entry.access);
+        entry.successors.clear();
+        entry.dependencies = 0;
+    }
+
+    // registration order breaks every conflict, which keeps the result
+    // deterministic no matter how the workers pick the jobs up
+    for(unsigned int later = 1; later < m_Systems.size(); ++later)
+    {
+        for(unsigned int earlier = 0; earlier < later; ++earlier)
+        {
+            if(m_Systems[earlier].access.Conflicts(m_Systems[later].access))
+            {
+                m_Systems[earlier].successors.push_back(int(later));
+                m_Systems[later].dependencies++;
+            }
+        }
+    }
+}
+
+void World::RunSystem(SystemEntry& entry)
+{
+    ISystem& system = *entry.system;
+
+    ISystem::clock::time_point start = ISystem::clock::now();
+
+    if(system.m_Budget > 0.0)
+        system.m_Deadline = start + std::chrono::duration_cast<ISystem::clock::duration>(std::chrono::duration<double>(system.m_Budget));
+
+    system.Update(*this);
+
+    // what the run wrote is stamped before this version and what anyone
+    // writes from here on at or after it. systems running at the same time
+    // cannot write what this one looks at, their access would conflict
+    system.m_LastRun = AdvanceVersion();
+
+    // only this job touches the entry until Update() is done
+    SystemStats& stats = entry.stats;
+    stats.lastTime = std::chrono::duration<double>(ISystem::clock::now() - start).count();
+    stats.peakTime = std::max(stats.peakTime, stats.lastTime);
+    stats.runCount++;
+
+    if(system.m_Budget > 0.0 && stats.lastTime > system.m_Budget)
+    {
+        stats.overBudgetCount++;
+        stats.lastOverrun = stats.lastTime - system.m_Budget;
+    }
+}
+
+std::uint32_t World::AdvanceVersion()
+{
+    std::uint32_t version = m_Version.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // 0 is reserved for never
+    if(version == 0)
+        version = m_Version.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    return version;
+}
+
+unsigned int World::AddObserver(const ComponentInfo* info, const TagInfo* tag, EVENT event, const OBSERVER& handler)
+{
+    // changes are only reported from here on
+    Observer observer = {m_NextObserverID++, info, tag, event, handler, AdvanceVersion()};
+    m_Observers.push_back(observer);
+
+    if(tag != nullptr)
+        m_ObservedTags[tag->index] |= std::uint8_t(1 << event);
+    else
+    {
+        if(info->index >= m_Observed.size())
+            m_Observed.resize(info->index + 1, 0);
+
+        m_Observed[info->index] |= std::uint8_t(1 << event);
+    }
+
+    return observer.id;
+}
+
+void World::ChangeTag(EntityHandle entity, EntityRecord& record, unsigned int tag, bool value)
+{
+    if(record.archetype->HasTag(record.chunk, tag, record.row) == value)
+        return;
+
+    record.archetype->SetTag(record.chunk, tag, record.row, value);
+    record.archetype->MarkTagChanged(record.chunk, tag, Version());
+
+    // sleep only looks at the columns, so the chunk is woken by hand
+    record.archetype->Wake(record.chunk);
+
+    if(IsTagTracked(tag))
+    {
+        if(value)
+            m_TagEvents[tag].added.push_back(entity);
+        else
+            m_TagEvents[tag].removed.push_back(entity);
+    }
+}
+
+void World::Unobserve(unsigned int id)
+{
+    for(unsigned int i = 0; i < m_Observers.size(); ++i)
+    {
+        if(m_Observers[i].id != id)
+            continue;
+
+        m_Observers.erase(m_Observers.begin() + i);
+
+        // queued events of types nobody observes any more are dropped
+        std::fill(m_Observed.begin(), m_Observed.end(), 0);
+        std::fill(m_ObservedTags.begin(), m_ObservedTags.end(), 0);
+
+        for(unsigned int j = 0; j < m_Observers.size(); ++j)
+        {
+            if(m_Observers[j].tag != nullptr)
+                m_ObservedTags[m_Observers[j].tag->index] |= std::uint8_t(1 << m_Observers[j].event);
+            else
+                m_Observed[m_Observers[j].info->index] |= std::uint8_t(1 << m_Observers[j].event);
+        }
+
+        for(unsigned int j = 0; j < m_Events.size(); ++j)
+        {
+            if(j >= m_Observed.size() || (m_Observed[j] & ((1 << ON_ADD) | (1 << ON_REMOVE))) == 0)
+            {
+                m_Events[j].added.clear();
+                m_Events[j].removed.clear();
+            }
+        }
+
+        for(unsigned int j = 0; j < TagInfo::MAX_TAGS; ++j)
+        {
+            if(!IsTagTracked(j))
+            {
+                m_TagEvents[j].added.clear();
+                m_TagEvents[j].removed.clear();
+            }
+        }
+
+        return;
+    }
+}
+
+void World::QueueEvents(EntityHandle entity, const Archetype * from, const Archetype * to)
+{
+    if(m_Observers.empty())
+        return;
+
+    static const std::vector<const ComponentInfo*> none;
+    const std::vector<const ComponentInfo*>& lost = (from != nullptr) ? from->Types() : none;
+    const std::vector<const ComponentInfo*>& gained = (to != nullptr) ? to->Types() : none;
+
+    // both are sorted by type id
+    unsigned int l = 0;
+    unsigned int g = 0;
+
+    while(l < lost.size() || g < gained.size())
+    {
+        if(g == gained.size() || (l < lost.size() && lost[l]->typeID < gained[g]->typeID))
+        {
+            if(IsTracked(lost[l]))
+            {
+                if(lost[l]->index >= m_Events.size())
+                    m_Events.resize(lost[l]->index + 1);
+
+                m_Events[lost[l]->index].removed.push_back(entity);
+            }
+
+            ++l;
+        }
+        else if(l == lost.size() || gained[g]->typeID < lost[l]->typeID)
+        {
+            if(IsTracked(gained[g]))
+            {
+                if(gained[g]->index >= m_Events.size())
+                    m_Events.resize(gained[g]->index + 1);
+
+                m_Events[gained[g]->index].added.push_back(entity);
+            }
+
+            ++g;
+        }
+        else
+        {
+            ++l;
+            ++g;
+        }
+    }
+}
+
+void World::QueueAdded(const Archetype * archetype, const EntityHandle * entities, long count)
+{
+    if(m_Observers.empty())
+        return;
+
+    const std::vector<const ComponentInfo*>& types = archetype->Types();
+
+    for(unsigned int i = 0; i < types.size(); ++i)
+    {
+        if(!IsTracked(types[i]))
+            continue;
+
+        if(types[i]->index >= m_Events.size())
+            m_Events.resize(types[i]->index + 1);
+
+        std::vector<EntityHandle>& added = m_Events[types[i]->index].added;
+        added.insert(added.end(), entities, entities + count);
+    }
+}
+
+void World::DispatchEvents()
+{
+    if(m_Observers.empty())
+        return;
+
+    // handlers queue into fresh lists, which wait for the next dispatch
+    std::vector<EventQueue> events(m_Events.size());
+    events.swap(m_Events);
+
+    std::vector<EventQueue> tagEvents(TagInfo::MAX_TAGS);
+    tagEvents.swap(m_TagEvents);
+
+    std::vector<std::uint8_t> filtered(events.size(), 0);
+    std::vector<std::uint8_t> filteredTags(TagInfo::MAX_TAGS, 0);
+    std::vector<std::pair<EntityHandle, int> > net;
+
+    for(unsigned int i = 0; i < m_Observers.size(); ++i)
+    {
+        const Observer& observer = m_Observers[i];
+
+        if(observer.event == ON_CHANGE)
+            continue;
+
+        if(observer.tag != nullptr)
+        {
+            if(!filteredTags[observer.tag->index])
+            {
+                filteredTags[observer.tag->index] = 1;
+                NetChanges(tagEvents[observer.tag->index].added, tagEvents[observer.tag->index].removed, net);
+            }
+        }
+        else if(observer.info->index < events.size() && !filtered[observer.info->index])
+        {
+            filtered[observer.info->index] = 1;
+            NetChanges(events[observer.info->index].added, events[observer.info->index].removed, net);
+        }
+    }
+
+    std::uint32_t now = AdvanceVersion();
+    std::vector<unsigned int> ids;
+
+    for(unsigned int i = 0; i < m_Observers.size(); ++i)
+        ids.push_back(m_Observers[i].id);
+
+    std::vector<EntityHandle> changed;
+
+    for(unsigned int i = 0; i < ids.size(); ++i)
+    {
+        // looked up every time, handlers may add and remove observers
+        unsigned int o = 0;
+        while(o < m_Observers.size() && m_Observers[o].id != ids[i])
+            ++o;
+
+        if(o == m_Observers.size())
+            continue;
+
+        Observer observer = m_Observers[o];
+        const std::vector<EntityHandle>* batch = nullptr;
+
+        if(observer.event == ON_CHANGE)
+        {
+            changed.clear();
+
+            if(observer.tag != nullptr)
+            {
+                // tags are in every archetype
+                for(unsigned int a = 0; a < m_Archetypes.size(); ++a)
+                {
+                    Archetype& archetype = *m_Archetypes[a];
+
+                    for(long c = 0; c < archetype.ChunkCount(); ++c)
+                    {
+                        Chunk * chunk = archetype.GetChunk(c);
+                        std::uint32_t version = archetype.TagChangeVersion(chunk, observer.tag->index);
+
+                        if(ChangedSince(version, observer.since) && !ChangedSince(version, now))
+                        {
+                            const EntityHandle* entities = archetype.Entities(chunk);
+                            changed.insert(changed.end(), entities, entities + chunk->count);
+                        }
+                    }
+                }
+            }
+            else
+            {
+                std::vector<TypeHash> types(1, observer.info->typeID);
+                const std::vector<Archetype*>& archetypes = GetQuery(types).Archetypes();
+
+                for(unsigned int a = 0; a < archetypes.size(); ++a)
+                {
+                    Archetype& archetype = *archetypes[a];
+                    int column = archetype.ColumnIndex(observer.info->typeID);
+
+                    for(long c = 0; c < archetype.ChunkCount(); ++c)
+                    {
+                        Chunk * chunk = archetype.GetChunk(c);
+
+                        // the dispatch version itself belongs to the next round
+                        if(ChangedSince(archetype.ChangeVersion(chunk, column), observer.since) &&
+                           !ChangedSince(archetype.ChangeVersion(chunk, column), now))
+                        {
+                            const EntityHandle* entities = archetype.Entities(chunk);
+                            changed.insert(changed.end(), entities, entities + chunk->count);
+                        }
+                    }
+                }
+            }
+
+            m_Observers[o].since = now;
+            batch = &changed;
+        }
+        else if(observer.tag != nullptr)
+        {
+            EventQueue& queue = tagEvents[observer.tag->index];
+            batch = (observer.event == ON_ADD) ? &queue.added : &queue.removed;
+        }
+        else if(observer.info->index < events.size())
+        {
+            batch = (observer.event == ON_ADD) ? &events[observer.info->index].added : &events[observer.info->index].removed;
+        }
+
+        if(batch != nullptr && !batch->empty())
+            observer.handler(*this, batch->data(), long(batch->size()));
+    }
+}
+
+void World::SystemJob(void * data, long begin, long)
+{
+    World * world = static_cast<World*>(data);
+    SystemEntry& entry = world->m_Systems[begin];
+
+    world->RunSystem(entry);
+
+    for(unsigned int i = 0; i < entry.successors.size(); ++i)
+    {
+        int next = entry.successors[i];
+
+        if(world->m_Pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            Job job = {&World::SystemJob, world, long(next), long(next) + 1, nullptr};
+            world->m_Jobs->Submit(&job, 1, &world->m_SystemsDone);
+        }
+    }
+}
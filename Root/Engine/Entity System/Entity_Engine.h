@@ -3,8 +3,27 @@
 #define ENTITY_ENGINE_H
 
 #include "Root/Utility/Intrusive/Intrusive_list.h"
-#include "Root/Utility/Intrusive/Intrusive_map.h"
+#include "Root/Utility/Intrusive/Intrusive_hash_map.h"
+#include "Root/Engine/Jobs/IJobSystem.h"
+#include "Root/Engine/System/ISystem.h"
+#include "Root/Utility/MappedFile/MappedFile.h"
+#include "Root/Utility/SlabAllocator/SlabAllocator.h"
+#include "Archetype.h"
+#include "CommandBuffer.h"
+#include "Handle.h"
+#include "Prefab.h"
+#include "Query.h"
+#include "SpatialIndex.h"
+#include "TransformHierarchy.h"
+#include "TypeID.h"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 class World;
@@ -13,15 +32,23 @@ class base_node :
     public intrusive::dynamic_node
 {
 public:
-    virtual long GetTypeID() const = 0;
+    virtual TypeHash GetTypeID() const = 0;
 
     virtual long GetUniqueID() const = 0;
 
     virtual const std::string& GetUniqueName() const = 0;
 
-private:
-    static long m_nextTypeID;
+    // the entity the node was created for. nodes are not removed with
+    // their entity, so this may be stale
+    EntityHandle GetEntity() const {return m_Entity;}
+
+protected:
     static long m_nextUniqueID;
+
+private:
+    friend class World;
+
+    EntityHandle m_Entity;
 };
 
 
@@ -36,68 +63,100 @@ public:
         m_uniqueName(uniqueName)
         {}
 
-    long GetTypeID() const final {return m_typeID;}
+    // the same in every module, see TypeID.h
+    static constexpr TypeHash TypeID() {return TypeHashOf<TDerived>();}
+
+    TypeHash GetTypeID() const final {return TypeID();}
 
     long GetUniqueID() const final {return m_uniqueID;}
 
     const std::string& GetUniqueName() const final {return m_uniqueName;}
 
+    // nodes of one type are carved out of a slab of their own, keyed by the
+    // type id, through the cache of the allocating thread. types deriving
+    // further from TDerived are a different size and go to the heap
+    static void* operator new(std::size_t size);
+
+    static void operator delete(void* object, std::size_t size);
+
 private:
-    static const long m_typeID;
+    static SlabAllocator& Slab();
+
     const long m_uniqueID;
     const std::string m_uniqueName;
 };
 
 
-class base_component :
-    public intrusive::dynamic_node
+class base_component
 {
-public:
-    virtual long GetTypeID() const = 0;
-
-    virtual long GetUniqueID() const = 0;
-
-    virtual const std::string& GetUniqueName() const = 0;
-
-private:
-    static long m_nextTypeID;
-    static long m_nextUniqueID;
-    intrusive::list<base_node> m_DependantNodes;
 };
 
 
+// components are plain data. They are not allocated individually, the World
+// stores them by value in the columns of its archetypes, so they must be
+// movable and should not hold on to their own address.
 template<class TDerived>
 class component :
     public base_component
 {
 public:
-    component(const std::string& uniqueName, const std::string& entityName) :
-        m_uniqueID(m_nextUniqueID++),
-        m_uniqueName(uniqueName)
-        {}
-
-    long GetTypeID() const final {return m_typeID;}
-
-    long GetUniqueID() const final {return m_uniqueID;}
+    // the same in every module and usable as a template argument, see
+    // TypeID.h
+    static constexpr TypeHash TypeID() {return TypeHashOf<TDerived>();}
+};
 
-    const std::string& GetUniqueName() const = 0;
 
-private:
-    static const long m_typeID;
-    const long m_uniqueID;
-    const std::string m_uniqueName;
+// tags are markers without data, like Selected or Static. They are never
+// constructed, each entity has a bit per tag type instead, see TagInfo.
+template<class TDerived>
+class tag
+{
+public:
+    static constexpr TypeHash TypeID() {return TypeHashOf<TDerived>();}
 };
 
 
+// thin convenience wrapper pairing a handle with the world it belongs to.
+// copying it is free and it stays safe to use after the entity is removed.
 class Entity
 {
-protected:
+public:
+    Entity() :
+        m_World(nullptr)
+        {}
 
+    Entity(World * world, EntityHandle handle) :
+        m_World(world),
+        m_Handle(handle)
+        {}
+
+    EntityHandle Handle() const {return m_Handle;}
+
+    bool IsAlive() const;
+
+    template<class T, class ... Args>
+    T& Add(const Args&... params);
+
+    // nullptr if the entity is gone or does not have a T
+    template<class T>
+    T* Get() const;
+
+    template<class T>
+    void Remove();
+
+    template<class T>
+    void Tag();
+
+    template<class T>
+    void Untag();
+
+    // false if the entity is gone
+    template<class T>
+    bool HasTag() const;
 
 private:
     World * m_World;
-    intrusive::map<std::string, base_node> m_Nodes;
-    intrusive::map<std::string, base_component> m_Components;
+    EntityHandle m_Handle;
 };
 
 
@@ -105,43 +164,678 @@ private:
 class World
 {
 public:
-    void CreateEntity(const std::string& name);
+    enum EVENT
+    {
+        ON_ADD,
+        ON_REMOVE,
+        ON_CHANGE
+    };
+
+    // called with a batch of entities an event happened to
+    typedef std::function<void(World& world, const EntityHandle* entities, long count)> OBSERVER;
+
+public:
+    // without a job system, systems run one after another on the calling thread
+    World(IJobSystem * jobs = nullptr);
+
+    ~World();
+
+    void SetJobSystem(IJobSystem * jobs);
+
+    // the name is optional and only kept in a debug side table
+    EntityHandle CreateEntity(const std::string& name = std::string());
+
+    // creates count entities with a copy of every component of the prefab.
+    // entities, if given, receives their handles. throws std::runtime_error
+    // if the handles would run out, before anything is created. if copying
+    // a component throws, the entities created so far are removed again
+    void Instantiate(const Prefab& prefab, long count, EntityHandle * entities = nullptr);
+
+    EntityHandle Instantiate(const Prefab& prefab);
 
+    // returns false if the handle was stale
+    bool RemoveEntity(EntityHandle entity);
+
+    bool IsAlive(EntityHandle entity) const {return m_Entities.IsAlive(entity);}
+
+    Entity Wrap(EntityHandle entity) {return Entity(this, entity);}
+
+    long EntityCount() const {return m_Entities.Size();}
+
+    // throws std::out_of_range for stale handles and std::runtime_error if
+    // the entity already has a T
     template<class T, class ... Args>
-    void CreateComponent(const std::string& name, const std::string& entity, const Args&... params);
+    T& CreateComponent(EntityHandle entity, const Args&... params);
+
+    // nullptr for stale handles or if the entity has no T. the component is
+    // marked as changed, since the pointer allows writing to it
+    template<class T>
+    T* GetComponent(EntityHandle entity);
+
+    template<class T>
+    bool HasComponent(EntityHandle entity) const;
 
+    // does nothing for stale handles or if the entity has no T
+    template<class T>
+    void RemoveComponent(EntityHandle entity);
+
+    // tags are set and cleared in place, without moving the entity. systems
+    // doing so should declare Write<T>() access. throws std::out_of_range
+    // for stale handles
+    template<class T>
+    void AddTag(EntityHandle entity);
+
+    // does nothing for stale handles
+    template<class T>
+    void RemoveTag(EntityHandle entity);
+
+    // false for stale handles
+    template<class T>
+    bool HasTag(EntityHandle entity) const;
+
+    // builds T(name, params...) for entity. the World owns the node until
+    // RemoveNode() or its own destruction. names must be unique
     template<class T, class ... Args>
-    void CreateNode(const std::string& name, const std::string& entity, const Args&... params);
+    void CreateNode(const std::string& name, EntityHandle entity, const Args&... params);
 
+    // systems run in registration order unless their declared access lets
+    // them run concurrently. names must be unique
     template<class T, class ... Args>
-    void CreateSystem(const std::string& name);
+    T& CreateSystem(const std::string& name, const Args&... params);
 
-    void RemoveComponent(const std::string& name);
+    // for systems built by a SYSTEM_CONSTRUCTOR in another module
+    void AddSystem(const std::string& name, const std::shared_ptr<ISystem>& system);
 
+    // destroys the node, does nothing if there is none by that name
     void RemoveNode(const std::string& name);
 
-    void RemoveEntity(const std::string& name);
-
+    // must not be called from inside Update()
     void RemoveSystem(const std::string& name);
 
+    // timing of one system, all times are in seconds
+    struct SystemStats
+    {
+        // time the last run took
+        double lastTime;
+        // longest run since the stats were last reset
+        double peakTime;
+        // runs of a system with a budget that took longer than it, and the
+        // time the last of them went over by
+        unsigned long long overBudgetCount;
+        double lastOverrun;
+        unsigned long long runCount;
+    };
+
+    // throws std::out_of_range for unknown names
+    const SystemStats& GetSystemStats(const std::string& name) const;
+
+    void ResetSystemPeaks();
+
+    // runs every system once. systems whose access does not conflict run at
+    // the same time, conflicting ones in the order they were added. the
+    // command buffers are applied once all of them have finished, then the
+    // world matrices and the spatial index are brought up to date
+    void Update();
+
+    // idle entities can be put to sleep, and update systems that ask for it
+    // with QueryView::SkipSleeping() then spend nothing on them. every
+    // other query, such as rendering or the spatial index, still sees them.
+    // sleep is kept per chunk. a chunk wakes by itself when one of its
+    // columns is written, through GetComponent() or a query, when entities
+    // move in or out or when a tag of one of its entities changes. none of
+    // these are synchronized, so systems that call them should declare
+    // Exclusive() access
+
+    // marks the entity idle. its chunk goes to sleep once every entity in
+    // it is marked with nothing written to the chunk in between, so a busy
+    // neighbour keeps it awake. call it every frame the entity stays idle.
+    // throws std::out_of_range for stale handles
+    void Sleep(EntityHandle entity);
+
+    // wakes the chunk holding the entity and drops the idle marks of the
+    // entities in it. does nothing for stale handles
+    void Wake(EntityHandle entity);
+
+    // true if the chunk holding the entity sleeps. false for stale handles
+    bool IsAsleep(EntityHandle entity) const;
+
+    // puts every chunk to sleep that had nothing written at or after since,
+    // a Version() taken some frames ago, and returns how many
+    long SleepIdle(std::uint32_t since);
+
+    // parent/child transforms. entities are added to it explicitly and
+    // dropped when they are removed. it is not synchronized, so systems that
+    // change it should declare Exclusive() access
+    TransformHierarchy& Transforms() {return m_Transforms;}
+
+    const TransformHierarchy& Transforms() const {return m_Transforms;}
+
+    // every entity with a Bounds component, by its bounds. kept up to date
+    // by Update(), call UpdateSpatial() to pick up changes made outside it
+    const SpatialIndex& Spatial() const {return m_Spatial;}
+
+    // moves every entity whose Bounds changed since the last call
+    void UpdateSpatial();
+
+    // queues T events for handler, which gets them in one batch per
+    // DispatchEvents() instead of one call per entity. ON_ADD lists the
+    // entities that have a T they did not have at the last dispatch, and
+    // ON_REMOVE the ones that lost theirs or were removed, so their handles
+    // may be stale. ON_CHANGE lists every entity in a chunk whose T column
+    // was written, which includes additions. returns an id for Unobserve()
+    template<class T>
+    unsigned int Observe(EVENT event, const OBSERVER& handler);
+
+    // queues events of the tag T the way Observe() does for components.
+    // ON_ADD and ON_REMOVE list the entities that gained or lost the tag,
+    // removed entities included, and ON_CHANGE every entity in a chunk where
+    // a row gained or lost it
+    template<class T>
+    unsigned int ObserveTag(EVENT event, const OBSERVER& handler);
+
+    void Unobserve(unsigned int id);
+
+    // delivers the queued events, called by Update() once everything else
+    // is done. events caused by the handlers wait for the next dispatch
+    void DispatchEvents();
+
+    // command buffer of the calling thread. structural changes made from
+    // inside a system should go through it instead of the World
+    CommandBuffer& Commands();
+
+    // applies and clears the command buffers of every thread. must not be
+    // called while systems are running
+    void ApplyCommands();
+
+    // applies and clears a buffer owned by the caller
+    void ApplyCommands(CommandBuffer& buffer);
+
+    // writes every entity and component to a binary snapshot. components
+    // must be trivially copyable, std::runtime_error is thrown otherwise
+    void SaveSnapshot(const std::string& fileName) const;
+
+    // loads a snapshot into an empty World. the file is mapped and its chunks
+    // are used in place whenever this build lays them out the same way, so
+    // nothing is copied until it is written to. handles saved with the
+    // snapshot stay valid
+    void LoadSnapshot(const std::string& fileName);
+
+    // how well the storage is used. entities are kept packed in their
+    // archetype, so waste is the tail of the last chunk of each archetype,
+    // the empty chunks kept for reuse and the dead handle slots
+    struct MemoryStats
+    {
+        long entityCount;
+        long archetypeCount;
+        long emptyArchetypes;
+        // chunks holding entities, and empty ones kept for reuse
+        long chunkCount;
+        long spareChunks;
+        // bytes of chunk memory owned by the World, snapshot mappings not
+        // included, and the part of it in spare chunks
+        std::size_t chunkBytes;
+        std::size_t spareBytes;
+        // live rows over the rows of the chunks in use, 1 when fully packed
+        double density;
+        long handleSlots;
+        long deadSlots;
+        // bytes allocated by the entity handle pool
+        std::size_t handleBytes;
+    };
+
+    MemoryStats GetMemoryStats() const;
+
+    // one slice of a compaction pass. frees up to maxChunks spare chunks,
+    // carrying on from where the last slice stopped, and once every
+    // archetype has been visited trims the entity handle pool and returns
+    // true. a maxChunks of 0 or less frees everything in one go. nothing
+    // that is in use moves, so handles and pointers into chunks holding
+    // entities stay valid. must not be called from inside Update()
+    bool Compact(long maxChunks = 64);
+
+    // debug names. lookups by name are O(log n) and meant for tools and
+    // logging, gameplay code should hold on to handles
+    void SetName(EntityHandle entity, const std::string& name);
+
+    const std::string& GetName(EntityHandle entity) const;
+
+    // null handle if no live entity has that name
+    EntityHandle FindEntity(const std::string& name) const;
+
+    // change counter, advanced after every system's Update(), which becomes
+    // the version the system last ran at, and also by Sleep(), SleepIdle(),
+    // adding an observer and DispatchEvents() while there are observers.
+    // Compact() leaves it alone. writes through queries, GetComponent() and
+    // structural changes stamp the chunk columns they touch with it
+    std::uint32_t Version() const {return m_Version.load(std::memory_order_relaxed);}
+
+    // cached query for every entity that has all of T. the query is created
+    // on first use and kept up to date from then on, so iterating it only
+    // ever visits matching chunks. safe from systems running at the same time
+    template<class ... T>
+    QueryView<T...> query();
+
+    // calls func(T* components, const EntityHandle* entities, long count) for
+    // every chunk that stores T
+    template<class T, class TFunc>
+    void EachChunk(const TFunc& func);
+
+    // calls func(T&) for every component of type T
+    template<class T, class TFunc>
+    void Each(const TFunc& func);
+
 private:
-    std::map<long, std::vector<base_component *> > m_Components;
-    std::map<long, std::vector<base_node *> > m_Nodes;
-    intrusive::map<std::string, base_component> m_ComponentByName;
-    intrusive::map<std::string, base_node> m_NodeByName;
-    std::map<std::string, Entity> m_EntityList;
+    // where the components of an entity currently live
+    struct EntityRecord
+    {
+        Archetype * archetype;
+        Chunk * chunk;
+        long row;
+    };
+
+    // throws std::out_of_range for stale handles
+    EntityRecord& Record(EntityHandle entity);
+
+    // types must be sorted by type id
+    Archetype * GetArchetype(const std::vector<const ComponentInfo*>& types);
+
+    Archetype * AddType(Archetype * from, const ComponentInfo* info);
+
+    Archetype * RemoveType(Archetype * from, TypeHash typeID);
+
+    // moves every component the destination shares into a new row there
+    void MoveEntity(EntityHandle entity, Archetype * dest);
+
+    // fixes up the record of an entity that was moved to fill a gap
+    void Relocated(EntityHandle entity, Chunk * chunk, long row);
+
+    // types must be sorted and unique
+    Query& GetQuery(const std::vector<TypeHash>& types);
+
+    // bumps the version and returns it, skipping 0
+    std::uint32_t AdvanceVersion();
+
+    // one of info and tag is nullptr
+    unsigned int AddObserver(const ComponentInfo* info, const TagInfo* tag, EVENT event, const OBSERVER& handler);
+
+    // additions and removals of a type are queued if either is observed,
+    // the net change needs both
+    bool IsTracked(const ComponentInfo* info) const
+    {
+        return info->index < m_Observed.size() && (m_Observed[info->index] & ((1 << ON_ADD) | (1 << ON_REMOVE))) != 0;
+    }
+
+    // queues ON_ADD and ON_REMOVE events for the types an entity gains and
+    // loses moving from one archetype to the other. either may be nullptr
+    void QueueEvents(EntityHandle entity, const Archetype * from, const Archetype * to);
+
+    bool IsTagTracked(unsigned int tag) const
+    {
+        return (m_ObservedTags[tag] & ((1 << ON_ADD) | (1 << ON_REMOVE))) != 0;
+    }
+
+    // sets or clears a tag of the entity in place. a change is stamped on
+    // the chunk, wakes it and is queued for the observers of the tag
+    void ChangeTag(EntityHandle entity, EntityRecord& record, unsigned int tag, bool value);
+
+    // queues ON_ADD events for entities created straight into archetype
+    void QueueAdded(const Archetype * archetype, const EntityHandle * entities, long count);
+
+    // one component type an entity gains or loses in a batch of commands
+    struct Change
+    {
+        const ComponentInfo* info;
+
+        // the command holding the new value, nullptr for a removal
+        CommandBuffer::Command * add;
+    };
+
+    // where an entity goes in a batch of commands, and the changes it gets
+    struct Plan
+    {
+        EntityHandle entity;
+        Archetype * from;
+        Archetype * to;
+        unsigned int first;
+        unsigned int count;
+
+        bool operator<(const Plan& rhs) const {return (from != rhs.from) ? from < rhs.from : to < rhs.to;}
+    };
+
+    // folds the commands of every buffer into at most one archetype move per
+    // entity and applies them grouped by archetype
+    void Apply(CommandBuffer * const * buffers, unsigned int count);
+
+    // asks every system for its access and links each one to the earlier
+    // systems it conflicts with
+    void BuildSystemGraph();
+
+    // job entry point, begin is the index of the system
+    static void SystemJob(void * world, long begin, long end);
+
+private:
+    struct SystemEntry
+    {
+        std::string name;
+        std::shared_ptr<ISystem> system;
+        ISystem::Access access;
+
+        // later systems that have to wait for this one
+        std::vector<int> successors;
+        int dependencies;
+
+        SystemStats stats;
+    };
+
+    // advances the version, runs one system and times it
+    void RunSystem(SystemEntry& entry);
+
+    IJobSystem * m_Jobs;
+    std::vector<SystemEntry> m_Systems;
+
+    // per system count of unfinished dependencies during Update()
+    std::unique_ptr<std::atomic<int>[]> m_Pending;
+    unsigned int m_PendingSize;
+    JobCounter m_SystemsDone;
+
+    // one per worker plus one for the thread driving the World
+    std::vector<std::unique_ptr<CommandBuffer> > m_Commands;
+
+    std::atomic<std::uint32_t> m_Version;
+
+    TransformHierarchy m_Transforms;
+
+    struct Observer
+    {
+        unsigned int id;
+
+        // the observed component type or tag, the other one is nullptr
+        const ComponentInfo* info;
+        const TagInfo* tag;
+        EVENT event;
+        OBSERVER handler;
+
+        // ON_CHANGE only, the version of the last dispatch
+        std::uint32_t since;
+    };
+
+    // entities waiting for delivery, for one component type or tag
+    struct EventQueue
+    {
+        std::vector<EntityHandle> added;
+        std::vector<EntityHandle> removed;
+    };
+
+    std::vector<Observer> m_Observers;
+    unsigned int m_NextObserverID;
+
+    // indexed by ComponentInfo::index. a bit per event someone observes
+    std::vector<std::uint8_t> m_Observed;
+    std::vector<EventQueue> m_Events;
+
+    // the same for tags, MAX_TAGS long and indexed by TagInfo::index
+    std::vector<std::uint8_t> m_ObservedTags;
+    std::vector<EventQueue> m_TagEvents;
+
+    SpatialIndex m_Spatial;
+    std::uint32_t m_SpatialSince;
+
+    // next archetype the compaction pass looks at
+    unsigned int m_CompactCursor;
+
+    // files whose pages loaded chunks point into, outlive the archetypes
+    std::vector<std::unique_ptr<MappedFile> > m_Snapshots;
+
+    std::vector<std::unique_ptr<Archetype> > m_Archetypes;
+    std::map<std::vector<TypeHash>, Archetype*> m_ArchetypeBySignature;
+    Archetype * m_EmptyArchetype;
+
+    // systems running at the same time create queries on first use, so the
+    // query tables are only touched under this lock. queries live on the
+    // heap and stay put once handed out
+    std::mutex m_QueryLock;
+    std::vector<std::unique_ptr<Query> > m_Queries;
+    std::map<std::vector<TypeHash>, Query*> m_QueryByTypes;
+
+    HandlePool<EntityHandle, EntityRecord> m_Entities;
+
+    std::map<EntityHandle, std::string> m_Names;
+    std::map<std::string, EntityHandle> m_EntityByName;
+
+    // the nodes by type, which own them, and by name
+    std::map<TypeHash, std::vector<base_node *> > m_Nodes;
+    intrusive::hash_map<std::string, base_node> m_NodeByName;
 };
 
 
 
-long base_node::m_nextTypeID = 0;
-long base_node::m_nextUniqueID = 0;
 template<class TDerived>
-const long node<TDerived>::m_typeID = m_nextTypeID++;
-long base_component::m_nextTypeID = 0;
-long base_component::m_nextUniqueID = 0;
+SlabAllocator& node<TDerived>::Slab()
+{
+    static SlabAllocator& slab = SlabAllocator::ForType(TypeID(), sizeof(TDerived), alignof(TDerived));
+
+    return slab;
+}
+
+template<class TDerived>
+void* node<TDerived>::operator new(std::size_t size)
+{
+    if(size != sizeof(TDerived))
+        return ::operator new(size);
+
+    return Slab().AllocateCached();
+}
+
 template<class TDerived>
-const long component<TDerived>::m_typeID = m_nextTypeID++;
+void node<TDerived>::operator delete(void* object, std::size_t size)
+{
+    if(object == nullptr)
+        return;
+
+    if(size != sizeof(TDerived))
+        ::operator delete(object);
+    else
+        Slab().DeallocateCached(object);
+}
+
+
+inline bool Entity::IsAlive() const
+{
+    return m_World != nullptr && m_World->IsAlive(m_Handle);
+}
+
+template<class T, class ... Args>
+T& Entity::Add(const Args&... params)
+{
+    return m_World->CreateComponent<T>(m_Handle, params...);
+}
+
+template<class T>
+T* Entity::Get() const
+{
+    return m_World != nullptr ? m_World->GetComponent<T>(m_Handle) : nullptr;
+}
+
+template<class T>
+void Entity::Remove()
+{
+    if(m_World != nullptr)
+        m_World->RemoveComponent<T>(m_Handle);
+}
+
+template<class T>
+void Entity::Tag()
+{
+    m_World->AddTag<T>(m_Handle);
+}
+
+template<class T>
+void Entity::Untag()
+{
+    if(m_World != nullptr)
+        m_World->RemoveTag<T>(m_Handle);
+}
+
+template<class T>
+bool Entity::HasTag() const
+{
+    return m_World != nullptr && m_World->HasTag<T>(m_Handle);
+}
+
+
+template<class T, class ... Args>
+T& World::CreateComponent(EntityHandle entity, const Args&... params)
+{
+    const ComponentInfo* info = ComponentInfo::Get<T>();
+    Archetype * from = Record(entity).archetype;
+
+    if(from->Has(info->typeID))
+        throw std::runtime_error("Entity already has this component");
+
+    // build the value before the entity moves, so a throwing constructor
+    // leaves it where it was. moving it in afterwards cannot throw, chunk
+    // storage moves components around on that assumption anyway
+    T value(params...);
+
+    MoveEntity(entity, AddType(from, info));
+
+    EntityRecord& record = m_Entities[entity];
+    void* slot = record.archetype->Get(record.chunk, record.archetype->ColumnIndex(info->typeID), record.row);
+
+    return *new(slot) T(std::move(value));
+}
+
+template<class T>
+T* World::GetComponent(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record == nullptr)
+        return nullptr;
+
+    int column = record->archetype->ColumnIndex(T::TypeID());
+
+    if(column < 0)
+        return nullptr;
+
+    record->archetype->MarkChanged(record->chunk, column, Version());
+
+    return static_cast<T*>(record->archetype->Get(record->chunk, column, record->row));
+}
+
+template<class T, class ... Args>
+void World::CreateNode(const std::string& name, EntityHandle entity, const Args&... params)
+{
+    if(!IsAlive(entity))
+        throw std::out_of_range("Stale entity handle");
+
+    if(m_NodeByName.count(name) != 0)
+        throw std::runtime_error("Node '" + name + "' already exists");
+
+    std::unique_ptr<T> created(new T(name, params...));
+    created->m_Entity = entity;
+
+    // destroying the node takes it out of the name index again
+    m_NodeByName.insert(name, *created);
+    m_Nodes[T::TypeID()].push_back(created.get());
+
+    created.release();
+}
+
+template<class T, class ... Args>
+T& World::CreateSystem(const std::string& name, const Args&... params)
+{
+    T * system = new T(params...);
+    AddSystem(name, std::shared_ptr<ISystem>(system));
+
+    return *system;
+}
+
+template<class T>
+bool World::HasComponent(EntityHandle entity) const
+{
+    const EntityRecord* record = m_Entities.Get(entity);
+
+    return record != nullptr && record->archetype->Has(T::TypeID());
+}
+
+template<class T>
+void World::AddTag(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record == nullptr)
+        throw std::out_of_range("Stale entity handle");
+
+    ChangeTag(entity, *record, TagInfo::Get<T>()->index, true);
+}
+
+template<class T>
+void World::RemoveTag(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record != nullptr)
+        ChangeTag(entity, *record, TagInfo::Get<T>()->index, false);
+}
+
+template<class T>
+bool World::HasTag(EntityHandle entity) const
+{
+    const EntityRecord* record = m_Entities.Get(entity);
+
+    return record != nullptr && record->archetype->HasTag(record->chunk, TagInfo::Get<T>()->index, record->row);
+}
+
+template<class T>
+void World::RemoveComponent(EntityHandle entity)
+{
+    EntityRecord* record = m_Entities.Get(entity);
+
+    if(record == nullptr || !record->archetype->Has(T::TypeID()))
+        return;
+
+    MoveEntity(entity, RemoveType(record->archetype, T::TypeID()));
+}
+
+template<class T>
+unsigned int World::Observe(EVENT event, const OBSERVER& handler)
+{
+    return AddObserver(ComponentInfo::Get<T>(), nullptr, event, handler);
+}
+
+template<class T>
+unsigned int World::ObserveTag(EVENT event, const OBSERVER& handler)
+{
+    return AddObserver(nullptr, TagInfo::Get<T>(), event, handler);
+}
+
+template<class ... T>
+QueryView<T...> World::query()
+{
+    TypeHash ids[] = {T::TypeID()...};
+    std::vector<TypeHash> types(ids, ids + sizeof...(T));
+
+    std::sort(types.begin(), types.end());
+    types.erase(std::unique(types.begin(), types.end()), types.end());
+
+    return QueryView<T...>(GetQuery(types));
+}
+
+template<class T, class TFunc>
+void World::EachChunk(const TFunc& func)
+{
+    query<T>().EachChunk([&](long count, const EntityHandle* entities, T* components)
+    {
+        func(components, entities, count);
+    });
+}
+
+template<class T, class TFunc>
+void World::Each(const TFunc& func)
+{
+    query<T>().Each(func);
+}
 
 
 #endif
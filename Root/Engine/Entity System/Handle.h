@@ -0,0 +1,286 @@
+// File: Handle.h
+// Generational handles and the sparse set pool that hands them out. A handle
+// packs a slot index with the generation of that slot. Destroying an object
+// bumps the generation of its slot, so handles that are still floating around
+// can be detected as stale instead of silently aliasing whatever is created
+// in the slot next.
+
+#ifndef SENTIMENT_HANDLE_H
+#define SENTIMENT_HANDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//------------------------------------------------------------------------------------------
+// basic_handle
+//     IndexBits of the integer are the slot, the rest the generation. A
+//     generation of 0 is never handed out, so a zeroed handle is always null.
+//------------------------------------------------------------------------------------------
+template<class TInt, unsigned int IndexBits>
+class basic_handle
+{
+public:
+    typedef TInt value_type;
+
+    static const unsigned int INDEX_BITS = IndexBits;
+    static const unsigned int GENERATION_BITS = sizeof(TInt) * 8 - IndexBits;
+    static const TInt INDEX_MASK = (TInt(1) << IndexBits) - 1;
+    static const TInt GENERATION_MASK = (TInt(1) << GENERATION_BITS) - 1;
+
+    basic_handle() :
+        m_Value(0)
+        {}
+
+    basic_handle(TInt index, TInt generation) :
+        m_Value((generation << IndexBits) | (index & INDEX_MASK))
+        {}
+
+    static basic_handle FromValue(TInt value) {basic_handle handle; handle.m_Value = value; return handle;}
+
+    TInt Index() const {return m_Value & INDEX_MASK;}
+
+    TInt Generation() const {return m_Value >> IndexBits;}
+
+    // the packed form, usable as a key or for serialization
+    TInt Value() const {return m_Value;}
+
+    bool IsNull() const {return m_Value == 0;}
+
+    bool operator==(const basic_handle& rhs) const {return m_Value == rhs.m_Value;}
+    bool operator!=(const basic_handle& rhs) const {return m_Value != rhs.m_Value;}
+    bool operator<(const basic_handle& rhs) const {return m_Value < rhs.m_Value;}
+
+private:
+    TInt m_Value;
+};
+
+// 20 bit index, 12 bit generation. For pools that stay under a million
+// objects and want to fit twice as many handles in a cache line.
+typedef basic_handle<std::uint32_t, 20> Handle32;
+
+// 32 bit index, 32 bit generation
+typedef basic_handle<std::uint64_t, 32> Handle64;
+
+typedef Handle64 EntityHandle;
+
+//------------------------------------------------------------------------------------------
+// HandlePool
+//     sparse set of T keyed by handle. The sparse side is indexed by the
+//     handle index and holds the generation and the position in the dense
+//     side. The dense side holds the live handles and values packed together,
+//     so create, destroy and lookup are O(1) and iterating all live values is
+//     a linear walk.
+//------------------------------------------------------------------------------------------
+template<class THandle, class T>
+class HandlePool
+{
+    typedef typename THandle::value_type value_type;
+
+    static const std::uint32_t NONE = 0xFFFFFFFFu;
+
+    struct Slot
+    {
+        value_type generation;
+        // position in the dense arrays while alive, next free slot while dead
+        std::uint32_t dense;
+    };
+
+public:
+    HandlePool() :
+        m_FreeHead(NONE)
+        {}
+
+    THandle Create(const T& value)
+    {
+        std::uint32_t index;
+
+        if(m_FreeHead != NONE)
+        {
+            index = m_FreeHead;
+            m_FreeHead = m_Sparse[index].dense;
+        }
+        else
+        {
+            index = std::uint32_t(m_Sparse.size());
+
+            if(index > THandle::INDEX_MASK)
+                return THandle();
+
+            Slot slot = {1, NONE};
+            m_Sparse.push_back(slot);
+        }
+
+        Slot& slot = m_Sparse[index];
+        slot.dense = std::uint32_t(m_Dense.size());
+
+        THandle handle(index, slot.generation);
+        m_Dense.push_back(handle);
+        m_Values.push_back(value);
+
+        return handle;
+    }
+
+    bool Destroy(THandle handle)
+    {
+        if(!IsAlive(handle))
+            return false;
+
+        Slot& slot = m_Sparse[handle.Index()];
+        std::uint32_t dense = slot.dense;
+        std::uint32_t last = std::uint32_t(m_Dense.size() - 1);
+
+        // keep the dense side packed by moving the last element into the gap
+        if(dense != last)
+        {
+            m_Dense[dense] = m_Dense[last];
+            m_Values[dense] = m_Values[last];
+            m_Sparse[m_Dense[dense].Index()].dense = dense;
+        }
+
+        m_Dense.pop_back();
+        m_Values.pop_back();
+
+        slot.generation = (slot.generation + 1) & THandle::GENERATION_MASK;
+        if(slot.generation == 0)
+            slot.generation = 1;
+
+        slot.dense = m_FreeHead;
+        m_FreeHead = std::uint32_t(handle.Index());
+
+        return true;
+    }
+
+    bool IsAlive(THandle handle) const
+    {
+        value_type index = handle.Index();
+
+        return index < m_Sparse.size() &&
+               m_Sparse[index].generation == handle.Generation() &&
+               m_Sparse[index].dense < m_Dense.size() &&
+               m_Dense[m_Sparse[index].dense] == handle;
+    }
+
+    // returns nullptr for null or stale handles
+    T* Get(THandle handle)
+    {
+        return IsAlive(handle) ? &m_Values[m_Sparse[handle.Index()].dense] : nullptr;
+    }
+
+    const T* Get(THandle handle) const
+    {
+        return IsAlive(handle) ? &m_Values[m_Sparse[handle.Index()].dense] : nullptr;
+    }
+
+    // unchecked access for handles already known to be alive
+    T& operator[](THandle handle) {return m_Values[m_Sparse[handle.Index()].dense];}
+
+    const T& operator[](THandle handle) const {return m_Values[m_Sparse[handle.Index()].dense];}
+
+    long Size() const {return long(m_Dense.size());}
+
+    // most values the pool can hold at once
+    static long long Capacity() {return (long long)THandle::INDEX_MASK + 1;}
+
+    // live handles and values in dense order, invalidated by Create/Destroy
+    THandle DenseHandle(long i) const {return m_Dense[i];}
+
+    T& DenseValue(long i) {return m_Values[i];}
+
+    const T& DenseValue(long i) const {return m_Values[i];}
+
+    // slots ever handed out, alive or not, and the generation each is at.
+    // together with the live handles this is the whole state of the pool
+    long SlotCount() const {return long(m_Sparse.size());}
+
+    value_type SlotGeneration(long index) const {return m_Sparse[index].generation;}
+
+    // replaces the contents with slotCount slots at the given generations
+    // and the given live handles and values. every live handle must match
+    // the generation of its slot and appear once
+    void Restore(const value_type* generations, long slotCount, const THandle* live, const T* values, long liveCount)
+    {
+        m_Sparse.assign(slotCount, Slot());
+        m_Dense.assign(live, live + liveCount);
+        m_Values.assign(values, values + liveCount);
+
+        for(long i = 0; i < slotCount; ++i)
+        {
+            m_Sparse[i].generation = generations[i];
+            m_Sparse[i].dense = NONE;
+        }
+
+        for(long i = 0; i < liveCount; ++i)
+            m_Sparse[live[i].Index()].dense = std::uint32_t(i);
+
+        // dead slots are reused lowest index first
+        m_FreeHead = NONE;
+        for(long i = slotCount - 1; i >= 0; --i)
+        {
+            if(m_Sparse[i].dense == NONE)
+            {
+                m_Sparse[i].dense = m_FreeHead;
+                m_FreeHead = std::uint32_t(i);
+            }
+        }
+    }
+
+    void Reserve(long count)
+    {
+        m_Sparse.reserve(count);
+        m_Dense.reserve(count);
+        m_Values.reserve(count);
+    }
+
+    // slots that are dead and wait to be reused
+    long FreeCount() const {return SlotCount() - Size();}
+
+    // bytes the three arrays have allocated, spare capacity included
+    std::size_t MemoryBytes() const
+    {
+        return m_Sparse.capacity() * sizeof(Slot) +
+               m_Dense.capacity() * sizeof(THandle) +
+               m_Values.capacity() * sizeof(T);
+    }
+
+    // gives back what the dense side grew to beyond twice its size, and
+    // relinks the dead slots lowest index first so new handles fill the
+    // front of the sparse side instead of wherever the last frees were
+    void Compact()
+    {
+        if(m_Dense.capacity() > 2 * m_Dense.size())
+        {
+            m_Dense.shrink_to_fit();
+            m_Values.shrink_to_fit();
+        }
+
+        std::uint32_t* link = &m_FreeHead;
+
+        for(std::uint32_t i = 0; i < m_Sparse.size(); ++i)
+        {
+            if(IsFree(i))
+            {
+                *link = i;
+                link = &m_Sparse[i].dense;
+            }
+        }
+
+        *link = NONE;
+    }
+
+private:
+    bool IsFree(std::uint32_t index) const
+    {
+        std::uint32_t dense = m_Sparse[index].dense;
+
+        return dense >= m_Dense.size() || m_Dense[dense].Index() != index;
+    }
+
+private:
+    std::vector<Slot> m_Sparse;
+    std::vector<THandle> m_Dense;
+    std::vector<T> m_Values;
+    std::uint32_t m_FreeHead;
+};
+
+#endif
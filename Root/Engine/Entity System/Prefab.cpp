@@ -0,0 +1,46 @@
+#include "Prefab.h"
+
+#include <cstdint>
+
+Prefab::~Prefab()
+{
+    for(unsigned int i = 0; i < m_Types.size(); ++i)
+        m_Types[i]->destroy(m_Values[i].object);
+}
+
+unsigned int Prefab::Find(TypeHash typeID) const
+{
+    unsigned int first = 0;
+    unsigned int last = (unsigned int)m_Types.size();
+
+    while(first < last)
+    {
+        unsigned int middle = (first + last) / 2;
+
+        if(m_Types[middle]->typeID < typeID)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return first;
+}
+
+Prefab::Slot Prefab::Allocate(const ComponentInfo* info)
+{
+    Slot value;
+    value.storage.reset(new unsigned char[info->size + info->align]);
+
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(value.storage.get());
+    value.object = reinterpret_cast<void*>((start + info->align - 1) & ~std::uintptr_t(info->align - 1));
+
+    return value;
+}
+
+void Prefab::Erase(unsigned int index)
+{
+    m_Types[index]->destroy(m_Values[index].object);
+
+    m_Types.erase(m_Types.begin() + index);
+    m_Values.erase(m_Values.begin() + index);
+}
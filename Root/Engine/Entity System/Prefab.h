@@ -0,0 +1,121 @@
+// File: Prefab.h
+// Entity templates. A prefab holds one value of every component an entity
+// should start out with, and World::Instantiate() stamps out copies of it in
+// bulk: the storage is reserved once, whole chunks are filled column by
+// column and trivially copyable components are copied with memcpy.
+
+#ifndef SENTIMENT_PREFAB_H
+#define SENTIMENT_PREFAB_H
+
+#include "Archetype.h"
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Prefab
+{
+public:
+    Prefab() {}
+
+    ~Prefab();
+
+    // sets the value new instances get, replacing any earlier one. prefab
+    // components are copied into every instance, so they must be copyable
+    template<class T, class ... Args>
+    T& Add(const Args&... params);
+
+    // nullptr if the prefab has no T
+    template<class T>
+    T* Get();
+
+    template<class T>
+    void Remove();
+
+    // sorted by type id
+    const std::vector<const ComponentInfo*>& Types() const {return m_Types;}
+
+    // the value of Types()[index]
+    const void* Value(unsigned int index) const {return m_Values[index].object;}
+
+private:
+    Prefab(const Prefab&);
+    Prefab& operator=(const Prefab&);
+
+    struct Slot
+    {
+        std::unique_ptr<unsigned char[]> storage;
+        void* object;
+    };
+
+    // index of the type, or of where it would be inserted
+    unsigned int Find(TypeHash typeID) const;
+
+    // uninitialized, suitably aligned storage for one value of info
+    static Slot Allocate(const ComponentInfo* info);
+
+    void Erase(unsigned int index);
+
+private:
+    std::vector<const ComponentInfo*> m_Types;
+    std::vector<Slot> m_Values;
+};
+
+template<class T, class ... Args>
+T& Prefab::Add(const Args&... params)
+{
+    static_assert(std::is_copy_constructible<T>::value, "Prefab components must be copy constructible");
+
+    const ComponentInfo* info = ComponentInfo::Get<T>();
+    unsigned int index = Find(info->typeID);
+    bool replace = index < m_Types.size() && m_Types[index] == info;
+
+    // room first, so nothing after the constructor can throw
+    if(!replace)
+    {
+        m_Types.reserve(m_Types.size() + 1);
+        m_Values.reserve(m_Values.size() + 1);
+    }
+
+    // built on the side, so a throwing constructor leaves the prefab,
+    // including the value being replaced, as it was
+    Slot value = Allocate(info);
+    T& object = *new(value.object) T(params...);
+
+    if(replace)
+    {
+        info->destroy(m_Values[index].object);
+        m_Values[index] = std::move(value);
+    }
+    else
+    {
+        m_Types.insert(m_Types.begin() + index, info);
+        m_Values.insert(m_Values.begin() + index, std::move(value));
+    }
+
+    return object;
+}
+
+template<class T>
+T* Prefab::Get()
+{
+    unsigned int index = Find(T::TypeID());
+
+    if(index == m_Types.size() || m_Types[index]->typeID != T::TypeID())
+        return nullptr;
+
+    return static_cast<T*>(m_Values[index].object);
+}
+
+template<class T>
+void Prefab::Remove()
+{
+    unsigned int index = Find(T::TypeID());
+
+    if(index < m_Types.size() && m_Types[index]->typeID == T::TypeID())
+        Erase(index);
+}
+
+#endif
@@ -0,0 +1,501 @@
+// File: Query.h
+// Cached entity queries. A query is the set of archetypes holding every
+// component type it asks for, which is exactly what a node<TDerived> stands
+// for: all entities that have a given set of components. The World keeps each
+// query up to date as archetypes are created, and since entities only ever
+// move between archetypes, no per entity bookkeeping is needed when
+// components come and go. Iterating costs the matching chunks and nothing
+// else.
+//
+// Iterating a query marks the columns it hands out as non const references
+// as changed. Ask for const T to read a type without marking it, and filter a
+// view with Changed<T>() to skip the chunks whose T nobody wrote. With<T>()
+// and Without<T>() filter on tags, 64 rows at a time against the tag bits.
+
+#ifndef SENTIMENT_QUERY_H
+#define SENTIMENT_QUERY_H
+
+#include "Archetype.h"
+#include "Root/Engine/Jobs/IJobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, bits must not be 0
+inline unsigned int LowestBit(std::uint64_t bits)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+
+    return (unsigned int)index;
+#elif defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(bits);
+#else
+    unsigned int index = 0;
+
+    while((bits & 1) == 0)
+    {
+        bits >>= 1;
+        ++index;
+    }
+
+    return index;
+#endif
+}
+
+class Query
+{
+public:
+    // types must be sorted and unique. version is the change counter of the
+    // World, used to stamp the columns that are written through the query
+    Query(const std::vector<TypeHash>& types, const std::atomic<std::uint32_t>& version) :
+        m_Types(types),
+        m_Version(&version)
+        {}
+
+    const std::vector<TypeHash>& Types() const {return m_Types;}
+
+    std::uint32_t Version() const {return m_Version->load(std::memory_order_relaxed);}
+
+    bool Matches(const Archetype& archetype) const
+    {
+        for(unsigned int i = 0; i < m_Types.size(); ++i)
+            if(!archetype.Has(m_Types[i]))
+                return false;
+
+        return true;
+    }
+
+    // called by the World for every archetype it creates
+    void Consider(Archetype * archetype)
+    {
+        if(Matches(*archetype))
+            m_Matches.push_back(archetype);
+    }
+
+    const std::vector<Archetype*>& Archetypes() const {return m_Matches;}
+
+    // number of matching entities
+    long Count() const
+    {
+        long count = 0;
+
+        for(unsigned int i = 0; i < m_Matches.size(); ++i)
+            count += m_Matches[i]->Size();
+
+        return count;
+    }
+
+private:
+    std::vector<TypeHash> m_Types;
+    std::vector<Archetype*> m_Matches;
+    const std::atomic<std::uint32_t>* m_Version;
+};
+
+//------------------------------------------------------------------------------------------
+// QueryView
+//     typed front end to a cached Query, handed out by World::query<T...>().
+//     It is only a pointer and a filter, so keep it around or fetch it every
+//     frame.
+//------------------------------------------------------------------------------------------
+template<class ... T>
+class QueryView
+{
+public:
+    QueryView(Query& query) :
+        m_Query(&query),
+        m_Filter(0),
+        m_Since(0),
+        m_SkipSleeping(false),
+        m_With(0),
+        m_Without(0)
+        {}
+
+    long Count() const {return m_Query->Count();}
+
+    const Query& GetQuery() const {return *m_Query;}
+
+    // a view that only visits chunks whose TChanged column was written at or
+    // after since, usually ISystem::LastRunVersion(). filtering is per chunk,
+    // so unchanged entities that share a chunk with changed ones are visited
+    // as well
+    template<class TChanged>
+    QueryView Changed(std::uint32_t since) const
+    {
+        QueryView view(*this);
+        view.m_Filter = TChanged::TypeID();
+        view.m_Since = since;
+
+        return view;
+    }
+
+    // a view that only visits entities that have the tag TTag, or that do
+    // not. both can be chained. Each(), EachEntity() and ParallelEach() skip
+    // the rows that fail. EachChunk() and EachChunkFrom() hand out every run
+    // of consecutive rows that pass as if it were a chunk of its own
+    template<class TTag>
+    QueryView With() const
+    {
+        QueryView view(*this);
+        view.m_With |= std::uint32_t(1) << TagInfo::Get<TTag>()->index;
+
+        return view;
+    }
+
+    template<class TTag>
+    QueryView Without() const
+    {
+        QueryView view(*this);
+        view.m_Without |= std::uint32_t(1) << TagInfo::Get<TTag>()->index;
+
+        return view;
+    }
+
+    // a view that leaves out sleeping chunks, for systems that only update
+    // entities that are doing something. views without it visit sleeping
+    // chunks as well, and wake the ones they may write to
+    QueryView SkipSleeping() const
+    {
+        QueryView view(*this);
+        view.m_SkipSleeping = true;
+
+        return view;
+    }
+
+    // func(T&...) for every matching entity
+    template<class TFunc>
+    void Each(const TFunc& func) const
+    {
+        const std::vector<Archetype*>& matches = m_Query->Archetypes();
+        std::uint32_t version = m_Query->Version();
+
+        for(unsigned int i = 0; i < matches.size(); ++i)
+        {
+            Archetype& archetype = *matches[i];
+
+            for(long c = 0; c < archetype.ChunkCount(); ++c)
+            {
+                Chunk * chunk = archetype.GetChunk(c);
+
+                if(!Visit(archetype, chunk, version))
+                    continue;
+
+                if(IsTagged())
+                    RunTagged(func, archetype, chunk, archetype.template Column<T>(chunk)...);
+                else
+                    RunChunk(func, chunk->count, archetype.template Column<T>(chunk)...);
+            }
+        }
+    }
+
+    // func(EntityHandle, T&...) for every matching entity
+    template<class TFunc>
+    void EachEntity(const TFunc& func) const
+    {
+        const std::vector<Archetype*>& matches = m_Query->Archetypes();
+        std::uint32_t version = m_Query->Version();
+
+        for(unsigned int i = 0; i < matches.size(); ++i)
+        {
+            Archetype& archetype = *matches[i];
+
+            for(long c = 0; c < archetype.ChunkCount(); ++c)
+            {
+                Chunk * chunk = archetype.GetChunk(c);
+
+                if(!Visit(archetype, chunk, version))
+                    continue;
+
+                if(IsTagged())
+                    RunTaggedEntities(func, archetype, chunk, archetype.Entities(chunk), archetype.template Column<T>(chunk)...);
+                else
+                    RunChunkEntities(func, chunk->count, archetype.Entities(chunk), archetype.template Column<T>(chunk)...);
+            }
+        }
+    }
+
+    // func(long count, const EntityHandle* entities, T*... columns) once per
+    // matching chunk, for loops that want to work on whole columns. with tag
+    // filters once per run of matching rows, see With()
+    template<class TFunc>
+    void EachChunk(const TFunc& func) const
+    {
+        const std::vector<Archetype*>& matches = m_Query->Archetypes();
+        std::uint32_t version = m_Query->Version();
+
+        for(unsigned int i = 0; i < matches.size(); ++i)
+        {
+            Archetype& archetype = *matches[i];
+
+            for(long c = 0; c < archetype.ChunkCount(); ++c)
+            {
+                Chunk * chunk = archetype.GetChunk(c);
+
+                if(Visit(archetype, chunk, version))
+                    RunRanges(func, archetype, chunk, archetype.template Column<T>(chunk)...);
+            }
+        }
+    }
+
+    // EachChunk() in slices. starts at the first-th matching chunk and stops
+    // before the next one once done() returns true, having visited at least
+    // one. returns where to start the next slice, 0 after the last chunk.
+    // chunks created or freed in between shift the position, so a slice may
+    // skip or repeat a few. meant for ISystem::Cursor() and OutOfBudget()
+    template<class TFunc, class TDone>
+    long EachChunkFrom(long first, const TFunc& func, const TDone& done) const
+    {
+        const std::vector<Archetype*>& matches = m_Query->Archetypes();
+        std::uint32_t version = m_Query->Version();
+
+        long position = 0;
+        bool visited = false;
+
+        for(unsigned int i = 0; i < matches.size(); ++i)
+        {
+            Archetype& archetype = *matches[i];
+
+            // whole archetypes before the cursor are skipped without a look
+            if(position + archetype.ChunkCount() <= first)
+            {
+                position += archetype.ChunkCount();
+                continue;
+            }
+
+            for(long c = 0; c < archetype.ChunkCount(); ++c, ++position)
+            {
+                if(position < first)
+                    continue;
+
+                if(visited && done())
+                    return position;
+
+                Chunk * chunk = archetype.GetChunk(c);
+
+                if(Visit(archetype, chunk, version))
+                {
+                    RunRanges(func, archetype, chunk, archetype.template Column<T>(chunk)...);
+                    visited = true;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    // Each() spread over the workers one chunk per slice. func runs
+    // concurrently, so it may only touch the entity it is given
+    template<class TFunc>
+    void ParallelEach(IJobSystem& jobs, const TFunc& func) const
+    {
+        std::vector<std::pair<Archetype*, Chunk*> > chunks;
+        const std::vector<Archetype*>& matches = m_Query->Archetypes();
+        std::uint32_t version = m_Query->Version();
+
+        // filtering and marking happen up front, on this thread
+        for(unsigned int i = 0; i < matches.size(); ++i)
+            for(long c = 0; c < matches[i]->ChunkCount(); ++c)
+                if(Visit(*matches[i], matches[i]->GetChunk(c), version))
+                    chunks.push_back(std::make_pair(matches[i], matches[i]->GetChunk(c)));
+
+        jobs.parallel_for(0, long(chunks.size()), 1, [&](long index)
+        {
+            Archetype& archetype = *chunks[index].first;
+            Chunk * chunk = chunks[index].second;
+
+            if(IsTagged())
+                RunTagged(func, archetype, chunk, archetype.template Column<T>(chunk)...);
+            else
+                RunChunk(func, chunk->count, archetype.template Column<T>(chunk)...);
+        });
+    }
+
+private:
+    bool IsTagged() const {return (m_With | m_Without) != 0;}
+
+    // the rows [64 * word, 64 * word + 64) of the chunk that pass the tag
+    // filters, as bits
+    std::uint64_t RowMask(const Archetype& archetype, const Chunk * chunk, long word) const
+    {
+        long rows = chunk->count - word * 64;
+        std::uint64_t mask = (rows >= 64) ? ~std::uint64_t(0) : (std::uint64_t(1) << rows) - 1;
+
+        for(unsigned int tag = 0; (m_With >> tag) != 0; ++tag)
+        {
+            if((m_With >> tag & 1) != 0)
+            {
+                const std::uint64_t* bits = archetype.TagBits(chunk, tag);
+                mask &= (bits != nullptr) ? bits[word] : 0;
+            }
+        }
+
+        for(unsigned int tag = 0; (m_Without >> tag) != 0; ++tag)
+        {
+            if((m_Without >> tag & 1) != 0)
+            {
+                const std::uint64_t* bits = archetype.TagBits(chunk, tag);
+
+                if(bits != nullptr)
+                    mask &= ~bits[word];
+            }
+        }
+
+        return mask;
+    }
+
+    // applies the sleep, tag and change filters, and marks the writable
+    // columns of chunks that pass them
+    bool Visit(const Archetype& archetype, Chunk * chunk, std::uint32_t version) const
+    {
+        if(m_SkipSleeping && archetype.IsAsleep(chunk))
+            return false;
+
+        if(IsTagged())
+        {
+            bool any = false;
+
+            for(long word = 0; word * 64 < chunk->count && !any; ++word)
+                any = RowMask(archetype, chunk, word) != 0;
+
+            if(!any)
+                return false;
+        }
+
+        if(m_Filter != 0)
+        {
+            int column = archetype.ColumnIndex(m_Filter);
+
+            if(column < 0 || !ChangedSince(archetype.ChangeVersion(chunk, column), m_Since))
+                return false;
+        }
+
+        int expand[] = {0, (Mark<T>(archetype, chunk, version), 0)...};
+        (void)expand;
+
+        return true;
+    }
+
+    template<class TColumn>
+    static void Mark(const Archetype& archetype, Chunk * chunk, std::uint32_t version)
+    {
+        if(!std::is_const<TColumn>::value)
+            archetype.MarkChanged(chunk, archetype.ColumnIndex(TColumn::TypeID()), version);
+    }
+
+    template<class TFunc>
+    static void RunChunk(const TFunc& func, long count, T*... columns)
+    {
+        for(long row = 0; row < count; ++row)
+            func(columns[row]...);
+    }
+
+    template<class TFunc>
+    static void RunChunkEntities(const TFunc& func, long count, const EntityHandle* entities, T*... columns)
+    {
+        for(long row = 0; row < count; ++row)
+            func(entities[row], columns[row]...);
+    }
+
+    template<class TFunc>
+    void RunTagged(const TFunc& func, const Archetype& archetype, const Chunk * chunk, T*... columns) const
+    {
+        for(long word = 0; word * 64 < chunk->count; ++word)
+        {
+            for(std::uint64_t mask = RowMask(archetype, chunk, word); mask != 0; mask &= mask - 1)
+            {
+                long row = word * 64 + LowestBit(mask);
+                func(columns[row]...);
+            }
+        }
+    }
+
+    // the whole chunk, or each run of rows passing the tag filters
+    template<class TFunc>
+    void RunRanges(const TFunc& func, const Archetype& archetype, const Chunk * chunk, T*... columns) const
+    {
+        const EntityHandle* entities = archetype.Entities(chunk);
+
+        if(!IsTagged())
+        {
+            func(chunk->count, entities, columns...);
+            return;
+        }
+
+        // start of a run still open at the end of the last word, or -1
+        long start = -1;
+
+        for(long word = 0; word * 64 < chunk->count; ++word)
+        {
+            std::uint64_t mask = RowMask(archetype, chunk, word);
+            unsigned int bit = 0;
+
+            while(bit < 64)
+            {
+                if(start < 0)
+                {
+                    if((mask >> bit) == 0)
+                        break;
+
+                    bit += LowestBit(mask >> bit);
+                    start = word * 64 + bit;
+                }
+
+                // the run goes on into the next word if every bit left is set
+                std::uint64_t gaps = ~(mask >> bit) & (~std::uint64_t(0) >> bit);
+
+                if(gaps == 0)
+                    break;
+
+                bit += LowestBit(gaps);
+
+                long end = word * 64 + bit;
+                func(end - start, entities + start, (columns + start)...);
+                start = -1;
+            }
+        }
+
+        // rows past count never pass, so only a chunk ending on a word
+        // boundary can leave a run open
+        if(start >= 0)
+            func(chunk->count - start, entities + start, (columns + start)...);
+    }
+
+    template<class TFunc>
+    void RunTaggedEntities(const TFunc& func, const Archetype& archetype, const Chunk * chunk, const EntityHandle* entities, T*... columns) const
+    {
+        for(long word = 0; word * 64 < chunk->count; ++word)
+        {
+            for(std::uint64_t mask = RowMask(archetype, chunk, word); mask != 0; mask &= mask - 1)
+            {
+                long row = word * 64 + LowestBit(mask);
+                func(entities[row], columns[row]...);
+            }
+        }
+    }
+
+private:
+    Query * m_Query;
+
+    // type id of the change filter, 0 for none
+    TypeHash m_Filter;
+    std::uint32_t m_Since;
+
+    bool m_SkipSleeping;
+
+    static_assert(TagInfo::MAX_TAGS <= 32, "tag filters are 32 bit masks");
+
+    // TagInfo::index bits of the tags rows must have, and must not have
+    std::uint32_t m_With;
+    std::uint32_t m_Without;
+};
+
+#endif
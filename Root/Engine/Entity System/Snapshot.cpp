@@ -0,0 +1,680 @@
+// File: Snapshot.cpp
+// World::SaveSnapshot and World::LoadSnapshot. A snapshot is the raw chunk
+// memory of every archetype behind a small header and a table saying where
+// each chunk lives in the file, so loading can map the file and hand the
+// chunks to the archetypes as they are. Layout, in native byte order:
+//
+//     SnapshotHeader
+//     type table          per type: SnapshotType, then the type name
+//     slot generations    one EntityHandle::value_type per handle slot
+//     archetype table     per archetype: SnapshotArchetype, typeCount
+//                         SnapshotColumn, then chunkCount SnapshotChunk
+//     name table          per name: SnapshotName, then the name
+//     tag type table      per tag: SnapshotTagType, then the tag name
+//     tag table           per chunk and tag any of its rows has: SnapshotTag,
+//                         then a word of tag bits per 64 rows
+//     chunks              chunkBytes each, at COLUMN_ALIGN aligned offsets
+//
+// Only trivially copyable components can be written, anything that owns
+// memory elsewhere would be left pointing at garbage.
+
+#include "Entity_Engine.h"
+#include "Root/Utility/MappedFile/MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+namespace
+{
+    const char SNAPSHOT_MAGIC[8] = {'S', 'N', 'T', 'W', 'O', 'R', 'L', 'D'};
+    const std::uint32_t SNAPSHOT_VERSION = 4;
+    const std::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+    struct SnapshotHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint32_t handleSize;
+        std::uint32_t typeCount;
+        std::uint64_t slotCount;
+        std::uint64_t archetypeCount;
+        std::uint64_t nameCount;
+        std::uint32_t tagTypeCount;
+        std::uint32_t reserved;
+        std::uint64_t tagCount;
+        std::uint64_t fileSize;
+    };
+
+    // types are found by id, the name is only there for messages
+    struct SnapshotType
+    {
+        std::uint64_t typeID;
+        std::uint64_t size;
+        std::uint64_t align;
+        std::uint32_t nameLength;
+        std::uint32_t reserved;
+    };
+
+    struct SnapshotArchetype
+    {
+        std::uint32_t typeCount;
+        std::uint32_t chunkCount;
+        std::uint64_t capacity;
+        std::uint64_t chunkBytes;
+    };
+
+    // one component column, types are in the column order of the archetype
+    struct SnapshotColumn
+    {
+        std::uint64_t type;
+        std::uint64_t offset;
+    };
+
+    struct SnapshotChunk
+    {
+        std::uint64_t fileOffset;
+        std::uint64_t count;
+    };
+
+    struct SnapshotName
+    {
+        std::uint64_t entity;
+        std::uint64_t length;
+    };
+
+    // found by id like the component types
+    struct SnapshotTagType
+    {
+        std::uint64_t typeID;
+        std::uint32_t nameLength;
+        std::uint32_t reserved;
+    };
+
+    // chunk of an archetype in the archetype table, and tag in the tag type
+    // table
+    struct SnapshotTag
+    {
+        std::uint32_t archetype;
+        std::uint32_t chunk;
+        std::uint32_t tag;
+        std::uint32_t wordCount;
+    };
+
+    class Writer
+    {
+    public:
+        Writer(const std::string& fileName) :
+            m_File(fileName.c_str(), std::ios::binary | std::ios::trunc),
+            m_Offset(0)
+        {
+            if(!m_File)
+                throw std::runtime_error("Could not open '" + fileName + "'");
+        }
+
+        template<class T>
+        void Write(const T& value) {Write(&value, sizeof(T));}
+
+        void Write(const void* data, std::size_t size)
+        {
+            m_File.write(static_cast<const char*>(data), size);
+            m_Offset += size;
+        }
+
+        void Pad(std::size_t align)
+        {
+            static const char zeros[Archetype::COLUMN_ALIGN] = {};
+
+            while(m_Offset % align != 0)
+                Write(zeros, std::min<std::size_t>(align - m_Offset % align, sizeof(zeros)));
+        }
+
+        std::uint64_t Offset() const {return m_Offset;}
+
+        void Rewind()
+        {
+            m_File.seekp(0);
+        }
+
+        void Close(const std::string& fileName)
+        {
+            m_File.close();
+
+            if(!m_File)
+                throw std::runtime_error("Could not write '" + fileName + "'");
+        }
+
+    private:
+        std::ofstream m_File;
+        std::uint64_t m_Offset;
+    };
+
+    // bounds checked cursor over the mapped file
+    class Reader
+    {
+    public:
+        Reader(const unsigned char* data, std::size_t size) :
+            m_Data(data),
+            m_Size(size),
+            m_Offset(0)
+            {}
+
+        template<class T>
+        T Read()
+        {
+            T value;
+            std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+
+            return value;
+        }
+
+        const unsigned char* Take(std::uint64_t size)
+        {
+            if(size > m_Size - m_Offset)
+                throw std::runtime_error("Snapshot is truncated");
+
+            const unsigned char* data = m_Data + m_Offset;
+            m_Offset += std::size_t(size);
+
+            return data;
+        }
+
+    private:
+        const unsigned char* m_Data;
+        std::size_t m_Size;
+        std::size_t m_Offset;
+    };
+
+    // an archetype as read from the file, checked but not applied yet
+    struct LoadedArchetype
+    {
+        std::vector<const ComponentInfo*> types;
+        std::vector<std::uint64_t> offsets;
+        SnapshotArchetype info;
+
+        // SnapshotChunk entries, not necessarily aligned
+        const unsigned char* chunks;
+
+        SnapshotChunk Chunk(std::uint32_t index) const
+        {
+            SnapshotChunk chunk;
+            std::memcpy(&chunk, chunks + index * sizeof(SnapshotChunk), sizeof(chunk));
+
+            return chunk;
+        }
+    };
+
+    // tag bits of one saved chunk, the words are not necessarily aligned
+    struct LoadedTag
+    {
+        SnapshotTag info;
+        const TagInfo* type;
+        const unsigned char* words;
+    };
+
+    bool CompareTypes(const ComponentInfo* lhs, const ComponentInfo* rhs)
+    {
+        return lhs->typeID < rhs->typeID;
+    }
+
+    bool AnyBits(const std::uint64_t* bits, long count)
+    {
+        for(long word = 0; word * 64 < count; ++word)
+            if(bits[word] != 0)
+                return true;
+
+        return false;
+    }
+}
+
+void World::SaveSnapshot(const std::string& fileName) const
+{
+    // type table, by index into it
+    std::vector<const ComponentInfo*> types;
+    std::map<TypeHash, std::uint64_t> typeIndex;
+    std::vector<const Archetype*> archetypes;
+
+    for(unsigned int i = 0; i < m_Archetypes.size(); ++i)
+    {
+        const Archetype * archetype = m_Archetypes[i].get();
+
+        if(archetype->Size() == 0)
+            continue;
+
+        for(unsigned int t = 0; t < archetype->Types().size(); ++t)
+        {
+            const ComponentInfo* info = archetype->Types()[t];
+
+            if(!info->trivial)
+                throw std::runtime_error(std::string("Component is not trivially copyable: ") + info->name);
+
+            if(typeIndex.insert(std::make_pair(info->typeID, std::uint64_t(types.size()))).second)
+                types.push_back(info);
+        }
+
+        archetypes.push_back(archetype);
+    }
+
+    // the tags any saved row has, by TagInfo::index and by file index
+    std::vector<const TagInfo*> tagTypes;
+    std::vector<std::uint32_t> tagIndex(TagInfo::MAX_TAGS, 0);
+    std::vector<SnapshotTag> tags;
+
+    for(unsigned int a = 0; a < archetypes.size(); ++a)
+    {
+        for(long c = 0; c < archetypes[a]->ChunkCount(); ++c)
+        {
+            const Chunk * chunk = archetypes[a]->GetChunk(c);
+
+            for(unsigned int t = 0; t < TagInfo::MAX_TAGS; ++t)
+            {
+                const std::uint64_t* bits = archetypes[a]->TagBits(chunk, t);
+
+                if(bits == nullptr || !AnyBits(bits, chunk->count))
+                    continue;
+
+                if(tagIndex[t] == 0)
+                {
+                    tagTypes.push_back(TagInfo::Find(t));
+                    tagIndex[t] = std::uint32_t(tagTypes.size());
+                }
+
+                SnapshotTag tag = {a, std::uint32_t(c), tagIndex[t] - 1, std::uint32_t((chunk->count + 63) / 64)};
+                tags.push_back(tag);
+            }
+        }
+    }
+
+    Writer writer(fileName);
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.handleSize = sizeof(EntityHandle);
+    header.typeCount = std::uint32_t(types.size());
+    header.slotCount = std::uint64_t(m_Entities.SlotCount());
+    header.archetypeCount = archetypes.size();
+    header.nameCount = m_Names.size();
+    header.tagTypeCount = std::uint32_t(tagTypes.size());
+    header.reserved = 0;
+    header.tagCount = tags.size();
+    header.fileSize = 0;
+    writer.Write(header);
+
+    for(unsigned int i = 0; i < types.size(); ++i)
+    {
+        SnapshotType type = {types[i]->typeID, types[i]->size, types[i]->align, std::uint32_t(std::strlen(types[i]->name)), 0};
+        writer.Write(type);
+        writer.Write(types[i]->name, type.nameLength);
+    }
+
+    for(long i = 0; i < m_Entities.SlotCount(); ++i)
+        writer.Write(m_Entities.SlotGeneration(i));
+
+    // the chunks follow the tables, so their offsets can be worked out up
+    // front by sizing the tables first
+    std::uint64_t tableBytes = 0;
+
+    for(unsigned int a = 0; a < archetypes.size(); ++a)
+        tableBytes += sizeof(SnapshotArchetype) +
+                      archetypes[a]->Types().size() * sizeof(SnapshotColumn) +
+                      archetypes[a]->ChunkCount() * sizeof(SnapshotChunk);
+
+    for(std::map<EntityHandle, std::string>::const_iterator it = m_Names.begin(); it != m_Names.end(); ++it)
+        tableBytes += sizeof(SnapshotName) + it->second.size();
+
+    for(unsigned int i = 0; i < tagTypes.size(); ++i)
+        tableBytes += sizeof(SnapshotTagType) + std::strlen(tagTypes[i]->name);
+
+    for(unsigned int i = 0; i < tags.size(); ++i)
+        tableBytes += sizeof(SnapshotTag) + tags[i].wordCount * sizeof(std::uint64_t);
+
+    std::uint64_t chunkOffset = writer.Offset() + tableBytes;
+    chunkOffset = (chunkOffset + Archetype::COLUMN_ALIGN - 1) / Archetype::COLUMN_ALIGN * Archetype::COLUMN_ALIGN;
+
+    for(unsigned int a = 0; a < archetypes.size(); ++a)
+    {
+        const Archetype& archetype = *archetypes[a];
+
+        SnapshotArchetype info = {std::uint32_t(archetype.Types().size()), std::uint32_t(archetype.ChunkCount()),
+                                  std::uint64_t(archetype.Capacity()), archetype.ChunkBytes()};
+        writer.Write(info);
+
+        for(unsigned int t = 0; t < archetype.Types().size(); ++t)
+        {
+            SnapshotColumn column = {typeIndex[archetype.Types()[t]->typeID], archetype.ColumnOffset(t)};
+            writer.Write(column);
+        }
+
+        for(long c = 0; c < archetype.ChunkCount(); ++c)
+        {
+            SnapshotChunk chunk = {chunkOffset, std::uint64_t(archetype.GetChunk(c)->count)};
+            writer.Write(chunk);
+
+            chunkOffset += archetype.ChunkBytes();
+        }
+    }
+
+    for(std::map<EntityHandle, std::string>::const_iterator it = m_Names.begin(); it != m_Names.end(); ++it)
+    {
+        SnapshotName name = {it->first.Value(), it->second.size()};
+        writer.Write(name);
+        writer.Write(it->second.data(), it->second.size());
+    }
+
+    for(unsigned int i = 0; i < tagTypes.size(); ++i)
+    {
+        SnapshotTagType type = {tagTypes[i]->typeID, std::uint32_t(std::strlen(tagTypes[i]->name)), 0};
+        writer.Write(type);
+        writer.Write(tagTypes[i]->name, type.nameLength);
+    }
+
+    for(unsigned int i = 0; i < tags.size(); ++i)
+    {
+        const Archetype& archetype = *archetypes[tags[i].archetype];
+        const Chunk * chunk = archetype.GetChunk(tags[i].chunk);
+
+        writer.Write(tags[i]);
+        writer.Write(archetype.TagBits(chunk, tagTypes[tags[i].tag]->index), tags[i].wordCount * sizeof(std::uint64_t));
+    }
+
+    writer.Pad(Archetype::COLUMN_ALIGN);
+
+    for(unsigned int a = 0; a < archetypes.size(); ++a)
+        for(long c = 0; c < archetypes[a]->ChunkCount(); ++c)
+            writer.Write(archetypes[a]->GetChunk(c)->data, archetypes[a]->ChunkBytes());
+
+    // written last, a file cut short by a crash fails the size check on load
+    header.fileSize = writer.Offset();
+    writer.Rewind();
+    writer.Write(header);
+    writer.Close(fileName);
+}
+
+void World::LoadSnapshot(const std::string& fileName)
+{
+    if(m_Entities.Size() != 0)
+        throw std::logic_error("Snapshots can only be loaded into an empty World");
+
+    std::unique_ptr<MappedFile> file(new MappedFile(fileName));
+    Reader reader(file->Data(), file->Size());
+
+    // everything is checked before the World is touched, so a bad file
+    // leaves it empty
+    SnapshotHeader header = reader.Read<SnapshotHeader>();
+
+    if(std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != SNAPSHOT_VERSION ||
+       header.byteOrder != SNAPSHOT_BYTE_ORDER ||
+       header.handleSize != sizeof(EntityHandle))
+        throw std::runtime_error("'" + fileName + "' is not a compatible snapshot");
+
+    if(header.fileSize != file->Size())
+        throw std::runtime_error("Snapshot is truncated");
+
+    if(header.slotCount > std::uint64_t(m_Entities.Capacity()))
+        throw std::runtime_error("Snapshot has more entities than fit into a World");
+
+    std::vector<const ComponentInfo*> types;
+
+    for(std::uint32_t i = 0; i < header.typeCount; ++i)
+    {
+        SnapshotType type = reader.Read<SnapshotType>();
+        std::string name(reinterpret_cast<const char*>(reader.Take(type.nameLength)), type.nameLength);
+
+        // every type the program uses is registered before main(), so one
+        // that is not cannot be in use anywhere in it
+        const ComponentInfo* info = ComponentInfo::Find(TypeHash(type.typeID));
+
+        if(info == nullptr)
+            throw std::runtime_error("Snapshot component type is unknown: " + name);
+
+        if(info->size != type.size || info->align != type.align || !info->trivial)
+            throw std::runtime_error("Snapshot component type has changed: " + name);
+
+        types.push_back(info);
+    }
+
+    std::vector<EntityHandle::value_type> generations(std::size_t(header.slotCount));
+
+    for(std::uint64_t i = 0; i < header.slotCount; ++i)
+        generations[std::size_t(i)] = reader.Read<EntityHandle::value_type>();
+
+    std::vector<LoadedArchetype> archetypes(std::size_t(header.archetypeCount));
+    std::set<std::vector<const ComponentInfo*> > signatures;
+    std::vector<bool> seen(std::size_t(header.slotCount), false);
+
+    for(std::uint64_t a = 0; a < header.archetypeCount; ++a)
+    {
+        LoadedArchetype& loaded = archetypes[std::size_t(a)];
+        loaded.info = reader.Read<SnapshotArchetype>();
+
+        for(std::uint32_t t = 0; t < loaded.info.typeCount; ++t)
+        {
+            SnapshotColumn column = reader.Read<SnapshotColumn>();
+
+            if(column.type >= types.size() || column.offset > loaded.info.chunkBytes)
+                throw std::runtime_error("Snapshot archetype table is corrupt");
+
+            loaded.types.push_back(types[std::size_t(column.type)]);
+            loaded.offsets.push_back(column.offset);
+        }
+
+        loaded.chunks = reader.Take(std::uint64_t(loaded.info.chunkCount) * sizeof(SnapshotChunk));
+
+        std::vector<const ComponentInfo*> sorted = loaded.types;
+        std::sort(sorted.begin(), sorted.end(), CompareTypes);
+
+        if(loaded.info.capacity == 0 || std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end() ||
+           !signatures.insert(sorted).second)
+            throw std::runtime_error("Snapshot archetype table is corrupt");
+
+        for(std::uint32_t c = 0; c < loaded.info.chunkCount; ++c)
+        {
+            SnapshotChunk chunk = loaded.Chunk(c);
+
+            // every chunk but the last is full, and all of them are in the file
+            bool last = (c + 1 == loaded.info.chunkCount);
+
+            if(chunk.count == 0 || chunk.count > loaded.info.capacity || (!last && chunk.count != loaded.info.capacity) ||
+               chunk.fileOffset % Archetype::COLUMN_ALIGN != 0 ||
+               chunk.fileOffset > file->Size() || loaded.info.chunkBytes > file->Size() - chunk.fileOffset)
+                throw std::runtime_error("Snapshot chunk table is corrupt");
+
+            for(std::uint32_t t = 0; t < loaded.info.typeCount; ++t)
+                if(loaded.offsets[t] + loaded.types[t]->size * chunk.count > loaded.info.chunkBytes)
+                    throw std::runtime_error("Snapshot chunk table is corrupt");
+
+            if(sizeof(EntityHandle) * chunk.count > loaded.info.chunkBytes)
+                throw std::runtime_error("Snapshot chunk table is corrupt");
+
+            const EntityHandle * entities = reinterpret_cast<const EntityHandle*>(file->Data() + chunk.fileOffset);
+
+            for(std::uint64_t row = 0; row < chunk.count; ++row)
+            {
+                EntityHandle entity = entities[row];
+
+                if(entity.Index() >= header.slotCount || entity.Generation() != generations[std::size_t(entity.Index())] ||
+                   seen[std::size_t(entity.Index())])
+                    throw std::runtime_error("Snapshot entity handles are corrupt");
+
+                seen[std::size_t(entity.Index())] = true;
+            }
+        }
+    }
+
+    std::vector<std::pair<EntityHandle, std::string> > names;
+
+    for(std::uint64_t i = 0; i < header.nameCount; ++i)
+    {
+        SnapshotName name = reader.Read<SnapshotName>();
+        const char * text = reinterpret_cast<const char*>(reader.Take(name.length));
+
+        names.push_back(std::make_pair(EntityHandle::FromValue(name.entity), std::string(text, std::size_t(name.length))));
+    }
+
+    std::vector<const TagInfo*> tagTypes;
+
+    for(std::uint32_t i = 0; i < header.tagTypeCount; ++i)
+    {
+        SnapshotTagType type = reader.Read<SnapshotTagType>();
+        std::string name(reinterpret_cast<const char*>(reader.Take(type.nameLength)), type.nameLength);
+
+        const TagInfo* info = TagInfo::Find(TypeHash(type.typeID));
+
+        if(info == nullptr)
+            throw std::runtime_error("Snapshot tag type is unknown: " + name);
+
+        tagTypes.push_back(info);
+    }
+
+    std::vector<LoadedTag> tags;
+
+    for(std::uint64_t i = 0; i < header.tagCount; ++i)
+    {
+        LoadedTag tag;
+        tag.info = reader.Read<SnapshotTag>();
+
+        if(tag.info.archetype >= archetypes.size() || tag.info.tag >= tagTypes.size() ||
+           tag.info.chunk >= archetypes[tag.info.archetype].info.chunkCount ||
+           tag.info.wordCount != (archetypes[tag.info.archetype].Chunk(tag.info.chunk).count + 63) / 64)
+            throw std::runtime_error("Snapshot tag table is corrupt");
+
+        tag.type = tagTypes[tag.info.tag];
+        tag.words = reader.Take(std::uint64_t(tag.info.wordCount) * sizeof(std::uint64_t));
+
+        // rows past the end of the chunk must be clear
+        std::uint64_t rows = archetypes[tag.info.archetype].Chunk(tag.info.chunk).count % 64;
+        std::uint64_t last;
+        std::memcpy(&last, tag.words + (tag.info.wordCount - 1) * sizeof(last), sizeof(last));
+
+        if(rows != 0 && (last >> rows) != 0)
+            throw std::runtime_error("Snapshot tag table is corrupt");
+
+        tags.push_back(tag);
+    }
+
+    std::vector<EntityHandle> live;
+    std::vector<EntityRecord> records;
+    std::uint32_t version = Version();
+    bool borrowed = false;
+
+    for(unsigned int a = 0; a < archetypes.size(); ++a)
+    {
+        LoadedArchetype& loaded = archetypes[a];
+
+        std::vector<const ComponentInfo*> sorted = loaded.types;
+        std::sort(sorted.begin(), sorted.end(), CompareTypes);
+
+        Archetype * archetype = GetArchetype(sorted);
+
+        // the chunks can be used in place if this build lays them out the
+        // same way, which it does unless the type ids came out in a
+        // different order or the chunk size changed
+        bool inPlace = archetype->Capacity() == long(loaded.info.capacity) &&
+                       archetype->ChunkBytes() == loaded.info.chunkBytes &&
+                       archetype->Size() % archetype->Capacity() == 0;
+
+        std::vector<int> columns;
+
+        for(unsigned int t = 0; t < loaded.types.size(); ++t)
+        {
+            columns.push_back(archetype->ColumnIndex(loaded.types[t]->typeID));
+            inPlace = inPlace && archetype->ColumnOffset(columns.back()) == loaded.offsets[t];
+        }
+
+        for(std::uint32_t c = 0; c < loaded.info.chunkCount; ++c)
+        {
+            SnapshotChunk chunk = loaded.Chunk(c);
+
+            unsigned char * data = file->Data() + chunk.fileOffset;
+            const EntityHandle * entities = reinterpret_cast<const EntityHandle*>(data);
+            long count = long(chunk.count);
+
+            if(inPlace)
+            {
+                Chunk * adopted = archetype->AdoptChunk(data, count);
+                archetype->MarkChanged(adopted, version);
+
+                for(long row = 0; row < count; ++row)
+                {
+                    EntityRecord record = {archetype, adopted, row};
+                    live.push_back(entities[row]);
+                    records.push_back(record);
+                }
+
+                borrowed = true;
+                continue;
+            }
+
+            // layouts differ, copy column by column into fresh chunks
+            for(long done = 0; done < count; )
+            {
+                Chunk * dest;
+                long first;
+                long added = archetype->AllocateRange(count - done, dest, first);
+
+                std::memcpy(archetype->Entities(dest) + first, entities + done, added * sizeof(EntityHandle));
+
+                for(unsigned int t = 0; t < loaded.types.size(); ++t)
+                {
+                    std::size_t size = loaded.types[t]->size;
+                    std::memcpy(archetype->Get(dest, columns[t], first), data + loaded.offsets[t] + size * done, size * added);
+                }
+
+                for(long row = 0; row < added; ++row)
+                {
+                    EntityRecord record = {archetype, dest, first + row};
+                    live.push_back(entities[done + row]);
+                    records.push_back(record);
+                }
+
+                archetype->MarkChanged(dest, version);
+                done += added;
+            }
+        }
+    }
+
+    m_Entities.Restore(generations.data(), long(generations.size()), live.data(), records.data(), long(live.size()));
+
+    for(unsigned int i = 0; i < names.size(); ++i)
+        if(m_Entities.IsAlive(names[i].first))
+            SetName(names[i].first, names[i].second);
+
+    // rows may have landed elsewhere if the chunks were copied, so tags are
+    // set through the saved entity handles
+    for(unsigned int i = 0; i < tags.size(); ++i)
+    {
+        SnapshotChunk chunk = archetypes[tags[i].info.archetype].Chunk(tags[i].info.chunk);
+        const EntityHandle * entities = reinterpret_cast<const EntityHandle*>(file->Data() + chunk.fileOffset);
+
+        for(std::uint32_t word = 0; word < tags[i].info.wordCount; ++word)
+        {
+            std::uint64_t bits;
+            std::memcpy(&bits, tags[i].words + word * sizeof(bits), sizeof(bits));
+
+            for( ; bits != 0; bits &= bits - 1)
+            {
+                std::uint64_t row = word * 64 + LowestBit(bits);
+                EntityRecord& record = m_Entities[entities[row]];
+                record.archetype->SetTag(record.chunk, tags[i].type->index, record.row, true);
+            }
+        }
+    }
+
+    // observers see every loaded entity as added
+    for(unsigned int i = 0; i < m_Archetypes.size(); ++i)
+    {
+        const Archetype * archetype = m_Archetypes[i].get();
+
+        for(long c = 0; c < archetype->ChunkCount(); ++c)
+            QueueAdded(archetype, archetype->Entities(archetype->GetChunk(c)), archetype->GetChunk(c)->count);
+    }
+
+    // adopted chunks point into the mapping, it lives as long as the World
+    if(borrowed)
+        m_Snapshots.push_back(std::move(file));
+}
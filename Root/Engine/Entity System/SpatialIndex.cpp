@@ -0,0 +1,1001 @@
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SENTIMENT_SSE
+#include <emmintrin.h>
+#endif
+
+const int SpatialIndex::Tree::NONE;
+
+namespace
+{
+    AABB Union(const AABB& a, const AABB& b)
+    {
+        AABB result;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            result.min[i] = std::min(a.min[i], b.min[i]);
+            result.max[i] = std::max(a.max[i], b.max[i]);
+        }
+
+        return result;
+    }
+
+    float Area(const AABB& box)
+    {
+        float x = box.max[0] - box.min[0];
+        float y = box.max[1] - box.min[1];
+        float z = box.max[2] - box.min[2];
+
+        return 2.0f * (x * y + y * z + z * x);
+    }
+
+    AABB Fatten(const AABB& box, float margin)
+    {
+        AABB result = box;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            result.min[i] -= margin;
+            result.max[i] += margin;
+        }
+
+        return result;
+    }
+
+    Plane Normalized(float a, float b, float c, float d)
+    {
+        float length = std::sqrt(a * a + b * b + c * c);
+        float scale = (length > 0.0f) ? 1.0f / length : 0.0f;
+
+        Plane plane = {{a * scale, b * scale, c * scale}, d * scale};
+
+        return plane;
+    }
+
+    // the ray with its direction inverted once up front for the slab tests
+    struct Ray
+    {
+        float origin[3];
+        float inverse[3];
+        float length;
+    };
+
+    Ray MakeRay(const float origin[3], const float direction[3], float maxDistance)
+    {
+        Ray ray;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            ray.origin[i] = origin[i];
+
+            // keeps 0 * inf out of the slab test for axis parallel rays
+            float d = (std::fabs(direction[i]) > 1e-30f) ? direction[i] : 1e-30f;
+            ray.inverse[i] = 1.0f / d;
+        }
+
+        ray.length = maxDistance;
+
+        return ray;
+    }
+
+    //--------------------------------------------------------------------------------------
+    // single box tests, for tree nodes and the scalar fallback
+    //--------------------------------------------------------------------------------------
+    bool InFrustum(const AABB& box, const Frustum& frustum)
+    {
+        for(int p = 0; p < 6; ++p)
+        {
+            const Plane& plane = frustum.planes[p];
+
+            // the corner furthest along the normal
+            float x = (plane.normal[0] >= 0.0f) ? box.max[0] : box.min[0];
+            float y = (plane.normal[1] >= 0.0f) ? box.max[1] : box.min[1];
+            float z = (plane.normal[2] >= 0.0f) ? box.max[2] : box.min[2];
+
+            if(plane.normal[0] * x + plane.normal[1] * y + plane.normal[2] * z + plane.distance < 0.0f)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool InSphere(const AABB& box, const float center[3], float radius)
+    {
+        float distance = 0.0f;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            float d = std::max(std::max(box.min[i] - center[i], center[i] - box.max[i]), 0.0f);
+            distance += d * d;
+        }
+
+        return distance <= radius * radius;
+    }
+
+    bool HitByRay(const AABB& box, const Ray& ray, float& distance)
+    {
+        float tmin = 0.0f;
+        float tmax = ray.length;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            float t1 = (box.min[i] - ray.origin[i]) * ray.inverse[i];
+            float t2 = (box.max[i] - ray.origin[i]) * ray.inverse[i];
+
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+
+        distance = tmin;
+
+        return tmin <= tmax;
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// four box tests, each returns a mask with bit i set if box i passes
+//------------------------------------------------------------------------------------------
+namespace
+{
+    template<class TBlock>
+    AABB Lane(const TBlock& block, int lane)
+    {
+        AABB box = {{block.minX[lane], block.minY[lane], block.minZ[lane]},
+                    {block.maxX[lane], block.maxY[lane], block.maxZ[lane]}};
+
+        return box;
+    }
+
+#ifdef SENTIMENT_SSE
+
+    template<class TBlock>
+    int Overlap4(const TBlock& block, const AABB& box)
+    {
+        __m128 inside = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(block.minX), _mm_set1_ps(box.max[0])),
+                                   _mm_cmpge_ps(_mm_load_ps(block.maxX), _mm_set1_ps(box.min[0])));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_load_ps(block.minY), _mm_set1_ps(box.max[1])));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_load_ps(block.maxY), _mm_set1_ps(box.min[1])));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_load_ps(block.minZ), _mm_set1_ps(box.max[2])));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_load_ps(block.maxZ), _mm_set1_ps(box.min[2])));
+
+        return _mm_movemask_ps(inside);
+    }
+
+    template<class TBlock>
+    int Frustum4(const TBlock& block, const Frustum& frustum)
+    {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for(int p = 0; p < 6; ++p)
+        {
+            const Plane& plane = frustum.planes[p];
+
+            __m128 x = _mm_load_ps((plane.normal[0] >= 0.0f) ? block.maxX : block.minX);
+            __m128 y = _mm_load_ps((plane.normal[1] >= 0.0f) ? block.maxY : block.minY);
+            __m128 z = _mm_load_ps((plane.normal[2] >= 0.0f) ? block.maxZ : block.minZ);
+
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.normal[0])),
+                                                    _mm_mul_ps(y, _mm_set1_ps(plane.normal[1]))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.normal[2])),
+                                                    _mm_set1_ps(plane.distance)));
+
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+
+        return _mm_movemask_ps(inside);
+    }
+
+    inline __m128 AxisDistance(const float* min, const float* max, float center)
+    {
+        __m128 c = _mm_set1_ps(center);
+        __m128 d = _mm_max_ps(_mm_sub_ps(_mm_load_ps(min), c), _mm_sub_ps(c, _mm_load_ps(max)));
+
+        return _mm_max_ps(d, _mm_setzero_ps());
+    }
+
+    template<class TBlock>
+    int Sphere4(const TBlock& block, const float center[3], float radius)
+    {
+        __m128 x = AxisDistance(block.minX, block.maxX, center[0]);
+        __m128 y = AxisDistance(block.minY, block.maxY, center[1]);
+        __m128 z = AxisDistance(block.minZ, block.maxZ, center[2]);
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+        return _mm_movemask_ps(_mm_cmple_ps(distance, _mm_set1_ps(radius * radius)));
+    }
+
+    template<class TBlock>
+    int Ray4(const TBlock& block, const Ray& ray, float distances[4])
+    {
+        __m128 tmin = _mm_setzero_ps();
+        __m128 tmax = _mm_set1_ps(ray.length);
+
+        const float* mins[3] = {block.minX, block.minY, block.minZ};
+        const float* maxs[3] = {block.maxX, block.maxY, block.maxZ};
+
+        for(int i = 0; i < 3; ++i)
+        {
+            __m128 origin = _mm_set1_ps(ray.origin[i]);
+            __m128 inverse = _mm_set1_ps(ray.inverse[i]);
+
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(mins[i]), origin), inverse);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(maxs[i]), origin), inverse);
+
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+        }
+
+        _mm_storeu_ps(distances, tmin);
+
+        return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+    }
+
+#else
+
+    template<class TBlock>
+    int Overlap4(const TBlock& block, const AABB& box)
+    {
+        int mask = 0;
+
+        for(int lane = 0; lane < 4; ++lane)
+            if(Lane(block, lane).Overlaps(box))
+                mask |= 1 << lane;
+
+        return mask;
+    }
+
+    template<class TBlock>
+    int Frustum4(const TBlock& block, const Frustum& frustum)
+    {
+        int mask = 0;
+
+        for(int lane = 0; lane < 4; ++lane)
+            if(InFrustum(Lane(block, lane), frustum))
+                mask |= 1 << lane;
+
+        return mask;
+    }
+
+    template<class TBlock>
+    int Sphere4(const TBlock& block, const float center[3], float radius)
+    {
+        int mask = 0;
+
+        for(int lane = 0; lane < 4; ++lane)
+            if(InSphere(Lane(block, lane), center, radius))
+                mask |= 1 << lane;
+
+        return mask;
+    }
+
+    template<class TBlock>
+    int Ray4(const TBlock& block, const Ray& ray, float distances[4])
+    {
+        int mask = 0;
+
+        for(int lane = 0; lane < 4; ++lane)
+            if(HitByRay(Lane(block, lane), ray, distances[lane]))
+                mask |= 1 << lane;
+
+        return mask;
+    }
+
+#endif
+}
+
+//------------------------------------------------------------------------------------------
+// Frustum
+//------------------------------------------------------------------------------------------
+Frustum Frustum::FromViewProjection(const float m[16])
+{
+    // Gribb and Hartmann, every plane is the last row plus or minus another
+    Frustum frustum;
+
+    frustum.planes[0] = Normalized(m[12] + m[0], m[13] + m[1], m[14] + m[2], m[15] + m[3]);
+    frustum.planes[1] = Normalized(m[12] - m[0], m[13] - m[1], m[14] - m[2], m[15] - m[3]);
+    frustum.planes[2] = Normalized(m[12] + m[4], m[13] + m[5], m[14] + m[6], m[15] + m[7]);
+    frustum.planes[3] = Normalized(m[12] - m[4], m[13] - m[5], m[14] - m[6], m[15] - m[7]);
+    frustum.planes[4] = Normalized(m[8], m[9], m[10], m[11]);
+    frustum.planes[5] = Normalized(m[12] - m[8], m[13] - m[9], m[14] - m[10], m[15] - m[11]);
+
+    return frustum;
+}
+
+//------------------------------------------------------------------------------------------
+// SpatialIndex::Tree
+//------------------------------------------------------------------------------------------
+SpatialIndex::Tree::Tree() :
+    m_Root(NONE),
+    m_FreeList(NONE)
+{
+}
+
+int SpatialIndex::Tree::Insert(EntityHandle entity, const AABB& box)
+{
+    int leaf = AllocateNode();
+
+    m_Nodes[leaf].box = box;
+    m_Nodes[leaf].entity = entity;
+
+    InsertLeaf(leaf);
+
+    return leaf;
+}
+
+void SpatialIndex::Tree::Remove(int leaf)
+{
+    RemoveLeaf(leaf);
+    FreeNode(leaf);
+}
+
+void SpatialIndex::Tree::Clear()
+{
+    m_Nodes.clear();
+    m_Root = NONE;
+    m_FreeList = NONE;
+}
+
+int SpatialIndex::Tree::AllocateNode()
+{
+    int index;
+
+    if(m_FreeList != NONE)
+    {
+        index = m_FreeList;
+        m_FreeList = m_Nodes[index].parent;
+    }
+    else
+    {
+        index = int(m_Nodes.size());
+        m_Nodes.push_back(Node());
+    }
+
+    Node& node = m_Nodes[index];
+    node.parent = NONE;
+    node.child[0] = NONE;
+    node.child[1] = NONE;
+    node.height = 0;
+    node.entity = EntityHandle();
+
+    return index;
+}
+
+void SpatialIndex::Tree::FreeNode(int index)
+{
+    m_Nodes[index].parent = m_FreeList;
+    m_Nodes[index].height = -1;
+    m_FreeList = index;
+}
+
+void SpatialIndex::Tree::InsertLeaf(int leaf)
+{
+    if(m_Root == NONE)
+    {
+        m_Root = leaf;
+        m_Nodes[leaf].parent = NONE;
+        return;
+    }
+
+    // walk down to the sibling that makes the tree grow the least, by surface
+    // area of every box that would have to be enlarged on the way
+    AABB box = m_Nodes[leaf].box;
+    int index = m_Root;
+
+    while(!m_Nodes[index].IsLeaf())
+    {
+        const Node& node = m_Nodes[index];
+
+        float area = Area(node.box);
+        float combined = Area(Union(node.box, box));
+
+        // cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combined;
+
+        // cost every node further down inherits for enlarging this one
+        float inherited = 2.0f * (combined - area);
+
+        float childCost[2];
+
+        for(int i = 0; i < 2; ++i)
+        {
+            const Node& child = m_Nodes[node.child[i]];
+            float enlarged = Area(Union(box, child.box));
+
+            childCost[i] = (child.IsLeaf() ? enlarged : enlarged - Area(child.box)) + inherited;
+        }
+
+        if(cost < childCost[0] && cost < childCost[1])
+            break;
+
+        index = (childCost[0] < childCost[1]) ? node.child[0] : node.child[1];
+    }
+
+    int sibling = index;
+    int oldParent = m_Nodes[sibling].parent;
+    int newParent = AllocateNode();
+
+    Node& parent = m_Nodes[newParent];
+    parent.parent = oldParent;
+    parent.box = Union(box, m_Nodes[sibling].box);
+    parent.height = m_Nodes[sibling].height + 1;
+    parent.child[0] = sibling;
+    parent.child[1] = leaf;
+
+    if(oldParent != NONE)
+    {
+        Node& old = m_Nodes[oldParent];
+        old.child[(old.child[0] == sibling) ? 0 : 1] = newParent;
+    }
+    else
+        m_Root = newParent;
+
+    m_Nodes[sibling].parent = newParent;
+    m_Nodes[leaf].parent = newParent;
+
+    Refit(newParent);
+}
+
+void SpatialIndex::Tree::RemoveLeaf(int leaf)
+{
+    if(leaf == m_Root)
+    {
+        m_Root = NONE;
+        return;
+    }
+
+    int parent = m_Nodes[leaf].parent;
+    int grandParent = m_Nodes[parent].parent;
+    int sibling = (m_Nodes[parent].child[0] == leaf) ? m_Nodes[parent].child[1] : m_Nodes[parent].child[0];
+
+    // the sibling takes the place of the parent
+    if(grandParent != NONE)
+    {
+        Node& grand = m_Nodes[grandParent];
+        grand.child[(grand.child[0] == parent) ? 0 : 1] = sibling;
+        m_Nodes[sibling].parent = grandParent;
+
+        FreeNode(parent);
+        Refit(grandParent);
+    }
+    else
+    {
+        m_Root = sibling;
+        m_Nodes[sibling].parent = NONE;
+
+        FreeNode(parent);
+    }
+}
+
+void SpatialIndex::Tree::Refit(int index)
+{
+    while(index != NONE)
+    {
+        index = Balance(index);
+
+        Node& node = m_Nodes[index];
+        const Node& first = m_Nodes[node.child[0]];
+        const Node& second = m_Nodes[node.child[1]];
+
+        node.height = 1 + std::max(first.height, second.height);
+        node.box = Union(first.box, second.box);
+
+        index = node.parent;
+    }
+}
+
+int SpatialIndex::Tree::Balance(int a)
+{
+    Node& A = m_Nodes[a];
+
+    if(A.IsLeaf() || A.height < 2)
+        return a;
+
+    int b = A.child[0];
+    int c = A.child[1];
+    Node& B = m_Nodes[b];
+    Node& C = m_Nodes[c];
+
+    int balance = C.height - B.height;
+
+    if(balance > 1)
+    {
+        // C is too deep, it takes A's place and A takes one of C's children
+        int f = C.child[0];
+        int g = C.child[1];
+        Node& F = m_Nodes[f];
+        Node& G = m_Nodes[g];
+
+        C.child[0] = a;
+        C.parent = A.parent;
+        A.parent = c;
+
+        if(C.parent != NONE)
+        {
+            Node& parent = m_Nodes[C.parent];
+            parent.child[(parent.child[0] == a) ? 0 : 1] = c;
+        }
+        else
+            m_Root = c;
+
+        // the deeper grandchild stays with C
+        if(F.height > G.height)
+        {
+            C.child[1] = f;
+            A.child[1] = g;
+            G.parent = a;
+            A.box = Union(B.box, G.box);
+            C.box = Union(A.box, F.box);
+            A.height = 1 + std::max(B.height, G.height);
+            C.height = 1 + std::max(A.height, F.height);
+        }
+        else
+        {
+            C.child[1] = g;
+            A.child[1] = f;
+            F.parent = a;
+            A.box = Union(B.box, F.box);
+            C.box = Union(A.box, G.box);
+            A.height = 1 + std::max(B.height, F.height);
+            C.height = 1 + std::max(A.height, G.height);
+        }
+
+        return c;
+    }
+
+    if(balance < -1)
+    {
+        // mirror image, B is too deep
+        int d = B.child[0];
+        int e = B.child[1];
+        Node& D = m_Nodes[d];
+        Node& E = m_Nodes[e];
+
+        B.child[0] = a;
+        B.parent = A.parent;
+        A.parent = b;
+
+        if(B.parent != NONE)
+        {
+            Node& parent = m_Nodes[B.parent];
+            parent.child[(parent.child[0] == a) ? 0 : 1] = b;
+        }
+        else
+            m_Root = b;
+
+        if(D.height > E.height)
+        {
+            B.child[1] = d;
+            A.child[0] = e;
+            E.parent = a;
+            A.box = Union(C.box, E.box);
+            B.box = Union(A.box, D.box);
+            A.height = 1 + std::max(C.height, E.height);
+            B.height = 1 + std::max(A.height, D.height);
+        }
+        else
+        {
+            B.child[1] = e;
+            A.child[0] = d;
+            D.parent = a;
+            A.box = Union(C.box, D.box);
+            B.box = Union(A.box, E.box);
+            A.height = 1 + std::max(C.height, D.height);
+            B.height = 1 + std::max(A.height, E.height);
+        }
+
+        return b;
+    }
+
+    return a;
+}
+
+template<class TTest, class TVisit>
+void SpatialIndex::Tree::Query(const TTest& test, const TVisit& visit) const
+{
+    if(m_Root == NONE)
+        return;
+
+    int stack[128];
+    std::vector<int> overflow;
+    int size = 0;
+
+    stack[size++] = m_Root;
+
+    while(size > 0 || !overflow.empty())
+    {
+        int index;
+
+        if(!overflow.empty())
+        {
+            index = overflow.back();
+            overflow.pop_back();
+        }
+        else
+            index = stack[--size];
+
+        const Node& node = m_Nodes[index];
+
+        if(!test(node.box))
+            continue;
+
+        if(node.IsLeaf())
+        {
+            visit(node.entity);
+            continue;
+        }
+
+        // the tree is balanced, so this only spills over for absurd sizes
+        for(int i = 0; i < 2; ++i)
+        {
+            if(size < 128)
+                stack[size++] = node.child[i];
+            else
+                overflow.push_back(node.child[i]);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// SpatialIndex
+//------------------------------------------------------------------------------------------
+SpatialIndex::SpatialIndex(float cellSize, float margin) :
+    m_CellSize(cellSize),
+    m_Margin(margin),
+    m_Count(0)
+{
+}
+
+SpatialIndex::Proxy* SpatialIndex::Find(EntityHandle entity)
+{
+    std::size_t index = std::size_t(entity.Index());
+
+    if(index >= m_Proxies.size() || m_Proxies[index].entity != entity || entity.IsNull())
+        return nullptr;
+
+    return &m_Proxies[index];
+}
+
+const SpatialIndex::Proxy* SpatialIndex::Find(EntityHandle entity) const
+{
+    std::size_t index = std::size_t(entity.Index());
+
+    if(index >= m_Proxies.size() || m_Proxies[index].entity != entity || entity.IsNull())
+        return nullptr;
+
+    return &m_Proxies[index];
+}
+
+bool SpatialIndex::Contains(EntityHandle entity) const
+{
+    return Find(entity) != nullptr;
+}
+
+void SpatialIndex::Set(EntityHandle entity, const AABB& box, bool isStatic)
+{
+    Proxy* proxy = Find(entity);
+
+    if(proxy == nullptr)
+    {
+        std::size_t index = std::size_t(entity.Index());
+
+        if(index >= m_Proxies.size())
+        {
+            Proxy empty = {EntityHandle(), Tree::NONE, -1, -1, box};
+            m_Proxies.resize(index + 1, empty);
+        }
+
+        proxy = &m_Proxies[index];
+
+        // a stale handle still sitting in the slot is replaced
+        if(!proxy->entity.IsNull())
+            Detach(*proxy);
+        else
+            m_Count++;
+
+        proxy->entity = entity;
+        proxy->leaf = Tree::NONE;
+        proxy->cell = -1;
+    }
+
+    float extent = std::max(std::max(box.max[0] - box.min[0], box.max[1] - box.min[1]), box.max[2] - box.min[2]);
+
+    if(isStatic && extent <= m_CellSize)
+    {
+        if(proxy->cell >= 0 && m_Cells[proxy->cell].key == CellKey(box))
+        {
+            // same cell, update the lane in place
+            Cell& cell = m_Cells[proxy->cell];
+            Block& block = cell.blocks[proxy->slot / 4];
+            int lane = proxy->slot % 4;
+
+            block.minX[lane] = box.min[0];
+            block.minY[lane] = box.min[1];
+            block.minZ[lane] = box.min[2];
+            block.maxX[lane] = box.max[0];
+            block.maxY[lane] = box.max[1];
+            block.maxZ[lane] = box.max[2];
+
+            cell.bounds = Union(cell.bounds, box);
+            proxy->box = box;
+            return;
+        }
+
+        Detach(*proxy);
+        proxy->box = box;
+        AddToGrid(*proxy);
+        return;
+    }
+
+    if(proxy->leaf != Tree::NONE)
+    {
+        // small moves stay inside the fattened leaf and cost nothing
+        if(m_Tree.GetNode(proxy->leaf).box.Contains(box))
+        {
+            proxy->box = box;
+            return;
+        }
+
+        m_Tree.Remove(proxy->leaf);
+        proxy->leaf = Tree::NONE;
+    }
+    else
+        Detach(*proxy);
+
+    proxy->box = box;
+    proxy->leaf = m_Tree.Insert(entity, Fatten(box, m_Margin));
+}
+
+void SpatialIndex::Remove(EntityHandle entity)
+{
+    Proxy* proxy = Find(entity);
+
+    if(proxy == nullptr)
+        return;
+
+    Detach(*proxy);
+    proxy->entity = EntityHandle();
+    m_Count--;
+}
+
+void SpatialIndex::Clear()
+{
+    m_Tree.Clear();
+    m_Cells.clear();
+    m_CellByKey.clear();
+    m_Proxies.clear();
+    m_Count = 0;
+}
+
+int SpatialIndex::TreeHeight() const
+{
+    return m_Tree.Height();
+}
+
+void SpatialIndex::Detach(Proxy& proxy)
+{
+    if(proxy.leaf != Tree::NONE)
+    {
+        m_Tree.Remove(proxy.leaf);
+        proxy.leaf = Tree::NONE;
+    }
+
+    if(proxy.cell >= 0)
+        RemoveFromGrid(proxy);
+}
+
+std::int64_t SpatialIndex::CellKey(const AABB& box) const
+{
+    std::int64_t key = 0;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        float center = (box.min[i] + box.max[i]) * 0.5f;
+        std::int64_t cell = std::int64_t(std::floor(center / m_CellSize));
+
+        // 21 bits per axis, a million cells in every direction
+        key = (key << 21) | (cell & 0x1FFFFF);
+    }
+
+    return key;
+}
+
+void SpatialIndex::AddToGrid(Proxy& proxy)
+{
+    std::int64_t key = CellKey(proxy.box);
+    std::map<std::int64_t, int>::iterator it = m_CellByKey.find(key);
+
+    if(it == m_CellByKey.end())
+    {
+        it = m_CellByKey.insert(std::make_pair(key, int(m_Cells.size()))).first;
+
+        m_Cells.push_back(Cell());
+        m_Cells.back().key = key;
+        m_Cells.back().bounds = proxy.box;
+    }
+
+    Cell& cell = m_Cells[it->second];
+    int slot = int(cell.entities.size());
+
+    if(slot % 4 == 0)
+    {
+        Block empty;
+        std::memset(&empty, 0, sizeof(empty));
+        cell.blocks.push_back(empty);
+    }
+
+    Block& block = cell.blocks[slot / 4];
+    int lane = slot % 4;
+
+    block.minX[lane] = proxy.box.min[0];
+    block.minY[lane] = proxy.box.min[1];
+    block.minZ[lane] = proxy.box.min[2];
+    block.maxX[lane] = proxy.box.max[0];
+    block.maxY[lane] = proxy.box.max[1];
+    block.maxZ[lane] = proxy.box.max[2];
+
+    cell.entities.push_back(proxy.entity);
+    cell.bounds = Union(cell.bounds, proxy.box);
+
+    proxy.cell = it->second;
+    proxy.slot = slot;
+}
+
+void SpatialIndex::RemoveFromGrid(Proxy& proxy)
+{
+    Cell& cell = m_Cells[proxy.cell];
+    int last = int(cell.entities.size()) - 1;
+
+    // keep the cell packed by moving its last box into the hole
+    if(proxy.slot != last)
+    {
+        const Block& from = cell.blocks[last / 4];
+        Block& to = cell.blocks[proxy.slot / 4];
+        int src = last % 4;
+        int dst = proxy.slot % 4;
+
+        to.minX[dst] = from.minX[src];
+        to.minY[dst] = from.minY[src];
+        to.minZ[dst] = from.minZ[src];
+        to.maxX[dst] = from.maxX[src];
+        to.maxY[dst] = from.maxY[src];
+        to.maxZ[dst] = from.maxZ[src];
+
+        EntityHandle moved = cell.entities[last];
+        cell.entities[proxy.slot] = moved;
+        m_Proxies[std::size_t(moved.Index())].slot = proxy.slot;
+    }
+
+    cell.entities.pop_back();
+
+    if(last % 4 == 0)
+        cell.blocks.pop_back();
+
+    if(cell.entities.empty())
+    {
+        // the last cell takes the place of the empty one
+        int index = proxy.cell;
+        int back = int(m_Cells.size()) - 1;
+
+        m_CellByKey.erase(cell.key);
+
+        if(index != back)
+        {
+            std::swap(m_Cells[index], m_Cells[back]);
+            m_CellByKey[m_Cells[index].key] = index;
+
+            const std::vector<EntityHandle>& entities = m_Cells[index].entities;
+            for(unsigned int i = 0; i < entities.size(); ++i)
+                m_Proxies[std::size_t(entities[i].Index())].cell = index;
+        }
+
+        m_Cells.pop_back();
+    }
+
+    proxy.cell = -1;
+    proxy.slot = -1;
+}
+
+template<class TTest, class TTest4, class TVisit>
+void SpatialIndex::QueryGrid(const TTest& test, const TTest4& test4, const TVisit& visit) const
+{
+    for(unsigned int c = 0; c < m_Cells.size(); ++c)
+    {
+        const Cell& cell = m_Cells[c];
+
+        if(!test(cell.bounds))
+            continue;
+
+        int count = int(cell.entities.size());
+
+        for(unsigned int b = 0; b < cell.blocks.size(); ++b)
+        {
+            int lanes = std::min(4, count - int(b) * 4);
+            int mask = test4(cell.blocks[b]) & ((1 << lanes) - 1);
+
+            for(int lane = 0; mask != 0; ++lane, mask >>= 1)
+                if(mask & 1)
+                    visit(cell.entities[b * 4 + lane], cell.blocks[b], lane);
+        }
+    }
+}
+
+void SpatialIndex::QueryBox(const AABB& box, std::vector<EntityHandle>& results) const
+{
+    m_Tree.Query([&](const AABB& node) {return node.Overlaps(box);},
+                 [&](EntityHandle entity)
+                 {
+                     if(Find(entity)->box.Overlaps(box))
+                         results.push_back(entity);
+                 });
+
+    QueryGrid([&](const AABB& bounds) {return bounds.Overlaps(box);},
+              [&](const Block& block) {return Overlap4(block, box);},
+              [&](EntityHandle entity, const Block&, int) {results.push_back(entity);});
+}
+
+void SpatialIndex::QuerySphere(const float center[3], float radius, std::vector<EntityHandle>& results) const
+{
+    m_Tree.Query([&](const AABB& node) {return InSphere(node, center, radius);},
+                 [&](EntityHandle entity)
+                 {
+                     if(InSphere(Find(entity)->box, center, radius))
+                         results.push_back(entity);
+                 });
+
+    QueryGrid([&](const AABB& bounds) {return InSphere(bounds, center, radius);},
+              [&](const Block& block) {return Sphere4(block, center, radius);},
+              [&](EntityHandle entity, const Block&, int) {results.push_back(entity);});
+}
+
+void SpatialIndex::QueryFrustum(const Frustum& frustum, std::vector<EntityHandle>& results) const
+{
+    m_Tree.Query([&](const AABB& node) {return InFrustum(node, frustum);},
+                 [&](EntityHandle entity)
+                 {
+                     if(InFrustum(Find(entity)->box, frustum))
+                         results.push_back(entity);
+                 });
+
+    QueryGrid([&](const AABB& bounds) {return InFrustum(bounds, frustum);},
+              [&](const Block& block) {return Frustum4(block, frustum);},
+              [&](EntityHandle entity, const Block&, int) {results.push_back(entity);});
+}
+
+void SpatialIndex::Raycast(const float origin[3], const float direction[3], float maxDistance, std::vector<RayHit>& results) const
+{
+    std::size_t first = results.size();
+    Ray ray = MakeRay(origin, direction, maxDistance);
+    float distance;
+
+    m_Tree.Query([&](const AABB& node) {return HitByRay(node, ray, distance);},
+                 [&](EntityHandle entity)
+                 {
+                     if(HitByRay(Find(entity)->box, ray, distance))
+                     {
+                         RayHit hit = {entity, distance};
+                         results.push_back(hit);
+                     }
+                 });
+
+    // Ray4 fills in every lane, the visit picks the ones that hit
+    float distances[4];
+
+    QueryGrid([&](const AABB& bounds) {return HitByRay(bounds, ray, distance);},
+              [&](const Block& block) {return Ray4(block, ray, distances);},
+              [&](EntityHandle entity, const Block&, int lane)
+              {
+                  RayHit hit = {entity, distances[lane]};
+                  results.push_back(hit);
+              });
+
+    // the tree and the grid each hand hits out in their own order
+    std::sort(results.begin() + first, results.end(),
+              [](const RayHit& lhs, const RayHit& rhs) {return lhs.distance < rhs.distance;});
+}
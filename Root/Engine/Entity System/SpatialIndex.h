@@ -0,0 +1,235 @@
+// File: SpatialIndex.h
+// Bounding volume index over the entities of a World, used for culling and
+// picking instead of walking every entity. Moving objects live in a dynamic
+// AABB tree whose leaves are slightly fattened, so small moves do not touch
+// the tree at all. Static objects live in a hashed grid of loose cells: an
+// object belongs to the cell holding its centre and the cell bounds grow to
+// fit it, and the boxes of a cell are stored four to a block so they are
+// tested four at a time with SSE.
+
+#ifndef SENTIMENT_SPATIALINDEX_H
+#define SENTIMENT_SPATIALINDEX_H
+
+#include "Handle.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// axis aligned box, kept as plain floats so components holding it stay
+// trivially copyable
+struct AABB
+{
+    float min[3];
+    float max[3];
+
+    bool Contains(const AABB& other) const
+    {
+        return min[0] <= other.min[0] && min[1] <= other.min[1] && min[2] <= other.min[2] &&
+               max[0] >= other.max[0] && max[1] >= other.max[1] && max[2] >= other.max[2];
+    }
+
+    bool Overlaps(const AABB& other) const
+    {
+        return min[0] <= other.max[0] && min[1] <= other.max[1] && min[2] <= other.max[2] &&
+               max[0] >= other.min[0] && max[1] >= other.min[1] && max[2] >= other.min[2];
+    }
+};
+
+// points with dot(normal, p) + distance >= 0 are inside
+struct Plane
+{
+    float normal[3];
+    float distance;
+};
+
+struct Frustum
+{
+    // left, right, bottom, top, near, far
+    Plane planes[6];
+
+    // extracts the planes of a row major view projection matrix that maps
+    // column vectors to clip space with a 0 to w depth range
+    static Frustum FromViewProjection(const float matrix[16]);
+};
+
+struct RayHit
+{
+    EntityHandle entity;
+
+    // distance along the ray to where it enters the box, 0 if it starts inside
+    float distance;
+};
+
+class SpatialIndex
+{
+public:
+    // cellSize is the edge of a grid cell, static objects wider than a cell
+    // go into the tree instead. margin is how far tree leaves are fattened on
+    // every side
+    SpatialIndex(float cellSize = 32.0f, float margin = 0.1f);
+
+    // inserts the entity or moves it to its new bounds
+    void Set(EntityHandle entity, const AABB& box, bool isStatic);
+
+    void Remove(EntityHandle entity);
+
+    bool Contains(EntityHandle entity) const;
+
+    long Size() const {return m_Count;}
+
+    void Clear();
+
+    // the queries append every entity whose box passes the test to results.
+    // they may be run from several threads at once as long as nothing is
+    // changed
+    void QueryBox(const AABB& box, std::vector<EntityHandle>& results) const;
+
+    void QuerySphere(const float center[3], float radius, std::vector<EntityHandle>& results) const;
+
+    void QueryFrustum(const Frustum& frustum, std::vector<EntityHandle>& results) const;
+
+    // every box the ray enters within maxDistance, appended nearest first
+    void Raycast(const float origin[3], const float direction[3], float maxDistance, std::vector<RayHit>& results) const;
+
+    // height of the tree, for diagnostics
+    int TreeHeight() const;
+
+private:
+    //------------------------------------------------------------------------------------------
+    // SpatialIndex::Tree
+    //     dynamic AABB tree, balanced with rotations on the way back up from
+    //     every insert and removal. Nodes live in one array and are linked by
+    //     index, freed nodes are threaded into a free list through parent.
+    //------------------------------------------------------------------------------------------
+    class Tree
+    {
+    public:
+        static const int NONE = -1;
+
+        struct Node
+        {
+            AABB box;
+            int parent;
+            int child[2];
+            // 0 for leaves
+            int height;
+            EntityHandle entity;
+
+            bool IsLeaf() const {return child[0] == NONE;}
+        };
+
+        Tree();
+
+        int Insert(EntityHandle entity, const AABB& box);
+
+        void Remove(int leaf);
+
+        const Node& GetNode(int index) const {return m_Nodes[index];}
+
+        int Root() const {return m_Root;}
+
+        int Height() const {return (m_Root == NONE) ? 0 : m_Nodes[m_Root].height;}
+
+        void Clear();
+
+        // calls visit(entity) for every leaf whose box passes test(box),
+        // descending only into nodes that pass it as well
+        template<class TTest, class TVisit>
+        void Query(const TTest& test, const TVisit& visit) const;
+
+    private:
+        int AllocateNode();
+
+        void FreeNode(int index);
+
+        void InsertLeaf(int leaf);
+
+        void RemoveLeaf(int leaf);
+
+        // rotates the subtree at index if it is out of balance, returns the
+        // new root of the subtree
+        int Balance(int index);
+
+        // recomputes height and box from the children, up to the root
+        void Refit(int index);
+
+    private:
+        std::vector<Node> m_Nodes;
+        int m_Root;
+        int m_FreeList;
+    };
+
+    //------------------------------------------------------------------------------------------
+    // SpatialIndex::Block
+    //     four boxes in structure of arrays form, the unit of the SSE tests
+    //------------------------------------------------------------------------------------------
+    struct Block
+    {
+        alignas(16) float minX[4];
+        alignas(16) float minY[4];
+        alignas(16) float minZ[4];
+        alignas(16) float maxX[4];
+        alignas(16) float maxY[4];
+        alignas(16) float maxZ[4];
+    };
+
+    struct Cell
+    {
+        std::int64_t key;
+
+        // grows to fit every box added, shrinks only when the cell empties
+        AABB bounds;
+
+        std::vector<Block> blocks;
+        std::vector<EntityHandle> entities;
+    };
+
+    // where an entity lives, indexed by handle index
+    struct Proxy
+    {
+        EntityHandle entity;
+
+        // tree leaf, or NONE if the entity is in the grid
+        int leaf;
+
+        // cell and slot inside it while in the grid
+        int cell;
+        int slot;
+
+        AABB box;
+    };
+
+    Proxy* Find(EntityHandle entity);
+
+    const Proxy* Find(EntityHandle entity) const;
+
+    void Detach(Proxy& proxy);
+
+    void AddToGrid(Proxy& proxy);
+
+    void RemoveFromGrid(Proxy& proxy);
+
+    std::int64_t CellKey(const AABB& box) const;
+
+    // runs test4(block) on every block of every cell whose bounds pass
+    // test(bounds), and visit(entity, block, lane) for the lanes set in the
+    // mask it returns
+    template<class TTest, class TTest4, class TVisit>
+    void QueryGrid(const TTest& test, const TTest4& test4, const TVisit& visit) const;
+
+private:
+    float m_CellSize;
+    float m_Margin;
+
+    Tree m_Tree;
+
+    // cells in use, packed
+    std::vector<Cell> m_Cells;
+    std::map<std::int64_t, int> m_CellByKey;
+
+    std::vector<Proxy> m_Proxies;
+    long m_Count;
+};
+
+#endif
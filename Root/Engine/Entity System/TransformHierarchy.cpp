@@ -0,0 +1,537 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SENTIMENT_SSE
+#include <emmintrin.h>
+#endif
+
+const int TransformHierarchy::NONE;
+const int TransformHierarchy::SPLIT_SIZE;
+
+namespace
+{
+#ifdef SENTIMENT_SSE
+    // world = parent * local, one row of the result at a time as a sum of
+    // the local rows weighted by the parent row. parent is null for roots
+    void Combine(const float* parent, __m128 l0, __m128 l1, __m128 l2, float* world)
+    {
+        __m128 l3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+        if(parent == nullptr)
+        {
+            _mm_storeu_ps(world, l0);
+            _mm_storeu_ps(world + 4, l1);
+            _mm_storeu_ps(world + 8, l2);
+            _mm_storeu_ps(world + 12, l3);
+            return;
+        }
+
+        for(int i = 0; i < 16; i += 4)
+        {
+            __m128 row = _mm_mul_ps(_mm_set1_ps(parent[i]), l0);
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(parent[i + 1]), l1));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(parent[i + 2]), l2));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(parent[i + 3]), l3));
+            _mm_storeu_ps(world + i, row);
+        }
+    }
+#else
+    void Combine(const float* parent, const float rows[12], float* world)
+    {
+        static const float last[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+        if(parent == nullptr)
+        {
+            std::copy(rows, rows + 12, world);
+            std::copy(last, last + 4, world + 12);
+            return;
+        }
+
+        for(int i = 0; i < 16; i += 4)
+            for(int j = 0; j < 4; ++j)
+                world[i + j] = parent[i] * rows[j] + parent[i + 1] * rows[4 + j] + parent[i + 2] * rows[8 + j] + parent[i + 3] * last[j];
+    }
+#endif
+}
+
+TransformHierarchy::TransformHierarchy() :
+    m_Unordered(false),
+    m_Count(0)
+{
+}
+
+int TransformHierarchy::Find(EntityHandle entity) const
+{
+    std::size_t index = std::size_t(entity.Index());
+
+    if(entity.IsNull() || index >= m_SlotByIndex.size())
+        return NONE;
+
+    int slot = m_SlotByIndex[index];
+
+    return (slot != NONE && m_Entities[slot] == entity) ? slot : NONE;
+}
+
+int TransformHierarchy::Get(EntityHandle entity) const
+{
+    int slot = Find(entity);
+
+    if(slot == NONE)
+        throw std::out_of_range("Entity is not in the transform hierarchy");
+
+    return slot;
+}
+
+void TransformHierarchy::Add(EntityHandle entity, EntityHandle parent)
+{
+    if(Find(entity) != NONE)
+        throw std::runtime_error("Entity is already in the transform hierarchy");
+
+    int parentSlot = parent.IsNull() ? NONE : Get(parent);
+    int slot = int(m_Entities.size());
+
+    static const float identity[LOCAL_COUNT] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+    Affine world = {{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}};
+
+    std::size_t index = std::size_t(entity.Index());
+
+    if(index >= m_SlotByIndex.size())
+        m_SlotByIndex.resize(index + 1, NONE);
+
+    for(int i = 0; i < LOCAL_COUNT; ++i)
+        m_Local[i].push_back(identity[i]);
+
+    m_World.push_back(world);
+    m_Entities.push_back(entity);
+    m_Parent.push_back(parentSlot);
+    m_Subtree.push_back(1);
+    m_Dirty.push_back(0);
+    m_SlotByIndex[index] = slot;
+    m_Count++;
+
+    MarkDirty(slot);
+
+    // a new root at the end is still in depth first order
+    if(parentSlot != NONE)
+        m_Unordered = true;
+}
+
+void TransformHierarchy::Remove(EntityHandle entity)
+{
+    int slot = Find(entity);
+
+    if(slot == NONE)
+        return;
+
+    // the slot stays behind as a hole until the next rebuild, which also
+    // turns its children into roots
+    m_SlotByIndex[std::size_t(entity.Index())] = NONE;
+    m_Entities[slot] = EntityHandle();
+    m_Parent[slot] = NONE;
+    m_Count--;
+    m_Unordered = true;
+}
+
+void TransformHierarchy::Clear()
+{
+    for(int i = 0; i < LOCAL_COUNT; ++i)
+        m_Local[i].clear();
+
+    m_World.clear();
+    m_Entities.clear();
+    m_Parent.clear();
+    m_Subtree.clear();
+    m_Dirty.clear();
+    m_DirtySlots.clear();
+    m_SlotByIndex.clear();
+    m_Ranges.clear();
+    m_Unordered = false;
+    m_Count = 0;
+}
+
+void TransformHierarchy::SetParent(EntityHandle entity, EntityHandle parent)
+{
+    int slot = Get(entity);
+    int parentSlot = parent.IsNull() ? NONE : Get(parent);
+
+    for(int ancestor = parentSlot; ancestor != NONE; ancestor = m_Parent[ancestor])
+        if(ancestor == slot)
+            throw std::runtime_error("Entity cannot be parented to itself or its descendants");
+
+    if(m_Parent[slot] == parentSlot)
+        return;
+
+    m_Parent[slot] = parentSlot;
+    m_Unordered = true;
+
+    MarkDirty(slot);
+}
+
+EntityHandle TransformHierarchy::GetParent(EntityHandle entity) const
+{
+    int parent = m_Parent[Get(entity)];
+
+    // holes left by removals hold a null handle
+    return (parent == NONE) ? EntityHandle() : m_Entities[parent];
+}
+
+void TransformHierarchy::SetPosition(EntityHandle entity, float x, float y, float z)
+{
+    int slot = Get(entity);
+
+    m_Local[POSITION_X][slot] = x;
+    m_Local[POSITION_Y][slot] = y;
+    m_Local[POSITION_Z][slot] = z;
+
+    MarkDirty(slot);
+}
+
+void TransformHierarchy::SetRotation(EntityHandle entity, float x, float y, float z, float w)
+{
+    int slot = Get(entity);
+
+    m_Local[ROTATION_X][slot] = x;
+    m_Local[ROTATION_Y][slot] = y;
+    m_Local[ROTATION_Z][slot] = z;
+    m_Local[ROTATION_W][slot] = w;
+
+    MarkDirty(slot);
+}
+
+void TransformHierarchy::SetScale(EntityHandle entity, float x, float y, float z)
+{
+    int slot = Get(entity);
+
+    m_Local[SCALE_X][slot] = x;
+    m_Local[SCALE_Y][slot] = y;
+    m_Local[SCALE_Z][slot] = z;
+
+    MarkDirty(slot);
+}
+
+const float* TransformHierarchy::WorldMatrix(EntityHandle entity) const
+{
+    int slot = Find(entity);
+
+    return (slot == NONE) ? nullptr : m_World[slot].m;
+}
+
+Matrix<4,4> TransformHierarchy::GetWorldMatrix(EntityHandle entity) const
+{
+    const float* world = m_World[Get(entity)].m;
+
+    std::array<float, 16> values;
+    std::copy(world, world + 16, values.begin());
+
+    return Matrix<4,4>(values);
+}
+
+void TransformHierarchy::MarkDirty(int slot)
+{
+    if(m_Dirty[slot] == 0)
+    {
+        m_Dirty[slot] = 1;
+        m_DirtySlots.push_back(slot);
+    }
+}
+
+void TransformHierarchy::Rebuild()
+{
+    int size = int(m_Entities.size());
+
+    // children of removed slots become roots, and move
+    for(int slot = 0; slot < size; ++slot)
+        if(m_Parent[slot] != NONE && m_Entities[m_Parent[slot]].IsNull())
+        {
+            m_Parent[slot] = NONE;
+            m_Dirty[slot] = 1;
+        }
+
+    // children of every slot, in slot order so siblings keep their order
+    std::vector<int> first(size + 1, 0);
+    std::vector<int> children(size);
+
+    for(int slot = 0; slot < size; ++slot)
+        if(m_Parent[slot] != NONE)
+            first[m_Parent[slot] + 1]++;
+
+    for(int slot = 0; slot < size; ++slot)
+        first[slot + 1] += first[slot];
+
+    std::vector<int> next(first.begin(), first.end() - 1);
+
+    for(int slot = 0; slot < size; ++slot)
+        if(m_Parent[slot] != NONE)
+            children[next[m_Parent[slot]]++] = slot;
+
+    // depth first walk from every root, the new order of the old slots
+    std::vector<int> order;
+    std::vector<int> stack;
+    order.reserve(std::size_t(m_Count));
+
+    for(int root = 0; root < size; ++root)
+    {
+        if(m_Parent[root] != NONE || m_Entities[root].IsNull())
+            continue;
+
+        stack.push_back(root);
+
+        while(!stack.empty())
+        {
+            int slot = stack.back();
+            stack.pop_back();
+            order.push_back(slot);
+
+            for(int i = first[slot + 1] - 1; i >= first[slot]; --i)
+                stack.push_back(children[i]);
+        }
+    }
+
+    int count = int(order.size());
+    std::vector<int> moved(size, NONE);
+
+    for(int i = 0; i < count; ++i)
+        moved[order[i]] = i;
+
+    std::vector<float> local(count);
+
+    for(int c = 0; c < LOCAL_COUNT; ++c)
+    {
+        for(int i = 0; i < count; ++i)
+            local[i] = m_Local[c][order[i]];
+
+        m_Local[c].swap(local);
+        local.resize(count);
+    }
+
+    std::vector<Affine> world(count);
+    std::vector<EntityHandle> entities(count);
+    std::vector<int> parents(count);
+    std::vector<std::uint8_t> dirty(count);
+
+    m_DirtySlots.clear();
+
+    for(int i = 0; i < count; ++i)
+    {
+        int slot = order[i];
+
+        world[i] = m_World[slot];
+        entities[i] = m_Entities[slot];
+        parents[i] = (m_Parent[slot] == NONE) ? NONE : moved[m_Parent[slot]];
+        dirty[i] = m_Dirty[slot];
+
+        m_SlotByIndex[std::size_t(entities[i].Index())] = i;
+
+        if(dirty[i] != 0)
+            m_DirtySlots.push_back(i);
+    }
+
+    m_World.swap(world);
+    m_Entities.swap(entities);
+    m_Parent.swap(parents);
+    m_Dirty.swap(dirty);
+
+    // children come after their parents, so walking backwards finishes
+    // every subtree before it is added to its parent
+    m_Subtree.assign(count, 1);
+
+    for(int i = count - 1; i >= 0; --i)
+        if(m_Parent[i] != NONE)
+            m_Subtree[m_Parent[i]] += m_Subtree[i];
+
+    m_Unordered = false;
+}
+
+void TransformHierarchy::CollectRanges(bool split)
+{
+    std::sort(m_DirtySlots.begin(), m_DirtySlots.end());
+
+    m_Ranges.clear();
+    int covered = 0;
+
+    // a dirty slot inside a subtree that is already collected is redone
+    // along with it
+    for(unsigned int i = 0; i < m_DirtySlots.size(); ++i)
+    {
+        int slot = m_DirtySlots[i];
+        m_Dirty[slot] = 0;
+
+        if(slot < covered)
+            continue;
+
+        covered = slot + m_Subtree[slot];
+
+        Range range = {slot, covered};
+        m_Ranges.push_back(range);
+    }
+
+    m_DirtySlots.clear();
+
+    if(!split)
+        return;
+
+    // large subtrees are replaced by the subtrees of their children, which
+    // only depend on the root, so the root is computed right away
+    for(unsigned int i = 0; i < m_Ranges.size(); ++i)
+    {
+        Range range = m_Ranges[i];
+
+        if(range.last - range.first <= SPLIT_SIZE)
+            continue;
+
+        Propagate(range.first, range.first + 1);
+
+        int child = range.first + 1;
+        m_Ranges[i].first = m_Ranges[i].last = child;
+
+        while(child < range.last)
+        {
+            Range sub = {child, child + m_Subtree[child]};
+            m_Ranges.push_back(sub);
+            child = sub.last;
+        }
+    }
+}
+
+void TransformHierarchy::LocalRows(int slot, float rows[12]) const
+{
+    float x = m_Local[ROTATION_X][slot], y = m_Local[ROTATION_Y][slot], z = m_Local[ROTATION_Z][slot], w = m_Local[ROTATION_W][slot];
+    float sx = m_Local[SCALE_X][slot], sy = m_Local[SCALE_Y][slot], sz = m_Local[SCALE_Z][slot];
+
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z;
+    float wx = w * x, wy = w * y, wz = w * z;
+
+    rows[0] = (1.0f - 2.0f * (yy + zz)) * sx;
+    rows[1] = 2.0f * (xy - wz) * sy;
+    rows[2] = 2.0f * (xz + wy) * sz;
+    rows[3] = m_Local[POSITION_X][slot];
+
+    rows[4] = 2.0f * (xy + wz) * sx;
+    rows[5] = (1.0f - 2.0f * (xx + zz)) * sy;
+    rows[6] = 2.0f * (yz - wx) * sz;
+    rows[7] = m_Local[POSITION_Y][slot];
+
+    rows[8] = 2.0f * (xz - wy) * sx;
+    rows[9] = 2.0f * (yz + wx) * sy;
+    rows[10] = (1.0f - 2.0f * (xx + yy)) * sz;
+    rows[11] = m_Local[POSITION_Z][slot];
+}
+
+void TransformHierarchy::Propagate(int first, int last)
+{
+    int slot = first;
+
+#ifdef SENTIMENT_SSE
+    // four local matrices at a time, one lane per transform, transposed
+    // back into rows. the four are combined in order, so a child may sit
+    // in the same group as its parent
+    for(; slot + 4 <= last; slot += 4)
+    {
+        __m128 x = _mm_loadu_ps(&m_Local[ROTATION_X][slot]);
+        __m128 y = _mm_loadu_ps(&m_Local[ROTATION_Y][slot]);
+        __m128 z = _mm_loadu_ps(&m_Local[ROTATION_Z][slot]);
+        __m128 w = _mm_loadu_ps(&m_Local[ROTATION_W][slot]);
+        __m128 sx = _mm_loadu_ps(&m_Local[SCALE_X][slot]);
+        __m128 sy = _mm_loadu_ps(&m_Local[SCALE_Y][slot]);
+        __m128 sz = _mm_loadu_ps(&m_Local[SCALE_Z][slot]);
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 two = _mm_set1_ps(2.0f);
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        __m128 r0 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        __m128 r1 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        __m128 r2 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        __m128 r3 = _mm_loadu_ps(&m_Local[POSITION_X][slot]);
+
+        __m128 r4 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        __m128 r5 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        __m128 r6 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        __m128 r7 = _mm_loadu_ps(&m_Local[POSITION_Y][slot]);
+
+        __m128 r8 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        __m128 r9 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        __m128 r10 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        __m128 r11 = _mm_loadu_ps(&m_Local[POSITION_Z][slot]);
+
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _MM_TRANSPOSE4_PS(r4, r5, r6, r7);
+        _MM_TRANSPOSE4_PS(r8, r9, r10, r11);
+
+        __m128 rows[4][3] = {{r0, r4, r8}, {r1, r5, r9}, {r2, r6, r10}, {r3, r7, r11}};
+
+        for(int i = 0; i < 4; ++i)
+        {
+            int parent = m_Parent[slot + i];
+            Combine((parent == NONE) ? nullptr : m_World[parent].m, rows[i][0], rows[i][1], rows[i][2], m_World[slot + i].m);
+        }
+    }
+#endif
+
+    for(; slot < last; ++slot)
+    {
+        float rows[12];
+        LocalRows(slot, rows);
+
+        int parent = m_Parent[slot];
+        const float* parentWorld = (parent == NONE) ? nullptr : m_World[parent].m;
+
+#ifdef SENTIMENT_SSE
+        Combine(parentWorld, _mm_loadu_ps(rows), _mm_loadu_ps(rows + 4), _mm_loadu_ps(rows + 8), m_World[slot].m);
+#else
+        Combine(parentWorld, rows, m_World[slot].m);
+#endif
+    }
+}
+
+void TransformHierarchy::Update(IJobSystem * jobs)
+{
+    if(m_Unordered)
+        Rebuild();
+
+    if(m_DirtySlots.empty())
+        return;
+
+    bool parallel = jobs != nullptr && jobs->WorkerCount() > 0;
+    CollectRanges(parallel);
+
+    if(!parallel)
+    {
+        for(unsigned int i = 0; i < m_Ranges.size(); ++i)
+            Propagate(m_Ranges[i].first, m_Ranges[i].last);
+
+        return;
+    }
+
+    // neighbouring ranges are batched until a batch is worth a job
+    std::vector<unsigned int> batches(1, 0);
+    int size = 0;
+
+    for(unsigned int i = 0; i < m_Ranges.size(); ++i)
+    {
+        size += m_Ranges[i].last - m_Ranges[i].first;
+
+        if(size >= SPLIT_SIZE)
+        {
+            batches.push_back(i + 1);
+            size = 0;
+        }
+    }
+
+    if(batches.back() != m_Ranges.size())
+        batches.push_back((unsigned int)m_Ranges.size());
+
+    jobs->parallel_for(0, long(batches.size()) - 1, 1, [&](long batch)
+    {
+        for(unsigned int i = batches[batch]; i < batches[batch + 1]; ++i)
+            Propagate(m_Ranges[i].first, m_Ranges[i].last);
+    });
+}
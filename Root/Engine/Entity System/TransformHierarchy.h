@@ -0,0 +1,151 @@
+// File: TransformHierarchy.h
+// Parent/child transforms of the entities of a World. Local position,
+// rotation and scale are kept one float per column, and the columns are
+// sorted depth first so every parent comes before its children and every
+// subtree is one contiguous run. Update() then only has to walk the subtrees
+// that were touched, front to back, building four local matrices at a time
+// with SSE and multiplying each into the world matrix of its parent, which
+// is already done by the time the child is reached.
+
+#ifndef SENTIMENT_TRANSFORMHIERARCHY_H
+#define SENTIMENT_TRANSFORMHIERARCHY_H
+
+#include "Handle.h"
+#include "Root/Engine/Jobs/IJobSystem.h"
+#include "Root/Utility/Math/SENTIMENT_Math.h"
+
+#include <cstdint>
+#include <vector>
+
+class TransformHierarchy
+{
+public:
+    TransformHierarchy();
+
+    // adds the entity with an identity local transform, as a root or as the
+    // last child of parent. throws std::runtime_error if it is already in
+    // the hierarchy and std::out_of_range if parent is not null and not in it
+    void Add(EntityHandle entity, EntityHandle parent = EntityHandle());
+
+    // children of a removed entity become roots and keep their local
+    // transform. does nothing if the entity is not in the hierarchy
+    void Remove(EntityHandle entity);
+
+    bool Contains(EntityHandle entity) const {return Find(entity) >= 0;}
+
+    long Size() const {return m_Count;}
+
+    void Clear();
+
+    // a null parent makes the entity a root. throws std::out_of_range for
+    // entities that are not in the hierarchy and std::runtime_error if
+    // parent is the entity or one of its descendants
+    void SetParent(EntityHandle entity, EntityHandle parent);
+
+    // null for roots. throws std::out_of_range
+    EntityHandle GetParent(EntityHandle entity) const;
+
+    // the setters throw std::out_of_range for entities that are not in the
+    // hierarchy. rotations are expected to be normalized
+    void SetPosition(EntityHandle entity, float x, float y, float z);
+
+    void SetPosition(EntityHandle entity, const Vector3& position) {SetPosition(entity, position.x, position.y, position.z);}
+
+    void SetRotation(EntityHandle entity, float x, float y, float z, float w);
+
+    void SetRotation(EntityHandle entity, const Quaternion& rotation) {SetRotation(entity, rotation.v.x, rotation.v.y, rotation.v.z, rotation.w);}
+
+    void SetScale(EntityHandle entity, float x, float y, float z);
+
+    void SetScale(EntityHandle entity, const Vector3& scale) {SetScale(entity, scale.x, scale.y, scale.z);}
+
+    // world matrix as of the last Update(), 16 floats in the row major
+    // layout of Matrix<4,4>, for column vectors. nullptr for entities that
+    // are not in the hierarchy
+    const float* WorldMatrix(EntityHandle entity) const;
+
+    // throws std::out_of_range
+    Matrix<4,4> GetWorldMatrix(EntityHandle entity) const;
+
+    // restores the depth first order if entities were added, removed or
+    // reparented, then recomputes the world matrices of every subtree that
+    // was changed since the last call. with a job system independent
+    // subtrees are spread over the workers
+    void Update(IJobSystem * jobs = nullptr);
+
+private:
+    // local transform columns
+    enum LOCAL
+    {
+        POSITION_X, POSITION_Y, POSITION_Z,
+        ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+        SCALE_X, SCALE_Y, SCALE_Z,
+        LOCAL_COUNT
+    };
+
+    struct Affine
+    {
+        float m[16];
+    };
+
+    // [first, last) of the slots, a whole subtree
+    struct Range
+    {
+        int first;
+        int last;
+    };
+
+    static const int NONE = -1;
+
+    // subtrees smaller than this are not split further across workers
+    static const int SPLIT_SIZE = 1024;
+
+    // slot of the entity, or NONE
+    int Find(EntityHandle entity) const;
+
+    // throws std::out_of_range
+    int Get(EntityHandle entity) const;
+
+    void MarkDirty(int slot);
+
+    // puts the slots back in depth first order, dropping removed ones
+    void Rebuild();
+
+    // the subtrees to recompute, split at the top where they are large and
+    // there are workers to share them
+    void CollectRanges(bool split);
+
+    // the first three rows of the local matrix of a slot, the last row is
+    // always 0 0 0 1
+    void LocalRows(int slot, float rows[12]) const;
+
+    // recomputes the world matrices of [first, last). parents outside the
+    // range must be up to date
+    void Propagate(int first, int last);
+
+private:
+    std::vector<float> m_Local[LOCAL_COUNT];
+    std::vector<Affine> m_World;
+
+    std::vector<EntityHandle> m_Entities;
+    std::vector<int> m_Parent;
+
+    // number of slots in the subtree starting at each slot, itself included.
+    // only valid while the order is
+    std::vector<int> m_Subtree;
+
+    std::vector<std::uint8_t> m_Dirty;
+    std::vector<int> m_DirtySlots;
+
+    // slot of every entity, indexed by handle index
+    std::vector<int> m_SlotByIndex;
+
+    // the slots are out of order after adds, removals and reparenting
+    bool m_Unordered;
+
+    long m_Count;
+
+    std::vector<Range> m_Ranges;
+};
+
+#endif
@@ -0,0 +1,54 @@
+// File: TypeID.h
+// Stable type ids. The id of a type is the 64 bit FNV-1a hash of the name the
+// compiler gives it, worked out at compile time. Every module built by the
+// same compiler agrees on it whatever order things are initialized in, and it
+// can be used as a template argument or in a constant table. The World only
+// sorts and compares ids. Code that wants small dense numbers instead uses
+// ComponentInfo::index, which is handed out at runtime.
+
+#ifndef SENTIMENT_TYPEID_H
+#define SENTIMENT_TYPEID_H
+
+#include <cstdint>
+
+typedef std::uint64_t TypeHash;
+
+namespace typeid_detail
+{
+    const TypeHash FNV_OFFSET = 14695981039346656037ull;
+    const TypeHash FNV_PRIME = 1099511628211ull;
+
+    constexpr TypeHash Mix(TypeHash hash, char c)
+    {
+        return (hash ^ TypeHash(static_cast<unsigned char>(c))) * FNV_PRIME;
+    }
+
+    // four characters per call keeps the recursion well inside the
+    // constexpr depth limit for long template names
+    constexpr TypeHash Hash(const char* name, TypeHash hash)
+    {
+        return (name[0] == 0) ? hash :
+               (name[1] == 0) ? Mix(hash, name[0]) :
+               (name[2] == 0) ? Mix(Mix(hash, name[0]), name[1]) :
+               (name[3] == 0) ? Mix(Mix(Mix(hash, name[0]), name[1]), name[2]) :
+               Hash(name + 4, Mix(Mix(Mix(Mix(hash, name[0]), name[1]), name[2]), name[3]));
+    }
+}
+
+constexpr TypeHash HashName(const char* name)
+{
+    return typeid_detail::Hash(name, typeid_detail::FNV_OFFSET);
+}
+
+// the signature of this function names T, which is all the hash needs
+template<class T>
+constexpr TypeHash TypeHashOf()
+{
+#if defined(_MSC_VER)
+    return HashName(__FUNCSIG__);
+#else
+    return HashName(__PRETTY_FUNCTION__);
+#endif
+}
+
+#endif
@@ -0,0 +1,150 @@
+// File: IJobSystem.h
+// Abstract interface to the engine task scheduler. The engine owns the only
+// instance and hands it to game modules through Engine::Jobs(), the same way
+// the renderer is handed out, so everything that crosses the dll boundary is
+// either a virtual call or inline code in this header.
+
+#ifndef SENTIMENT_IJOBSYSTEM_H
+#define SENTIMENT_IJOBSYSTEM_H
+
+#include <atomic>
+#include <vector>
+
+class JobCounter;
+
+// signature of a job entry point. begin and end describe the slice of work
+// the job was handed, and are free for any use by single jobs
+typedef void (*JOB_ENTRY)(void* data, long begin, long end);
+
+struct Job
+{
+    JOB_ENTRY function;
+    void* data;
+    long begin;
+    long end;
+
+    // filled in by IJobSystem::Submit, decremented once the job has run
+    JobCounter* counter;
+};
+
+//------------------------------------------------------------------------------------------
+// JobCounter
+//     counts the outstanding jobs of a submission. A counter is both what
+//     you wait on and what later jobs can depend on. It must outlive every
+//     job submitted against it.
+//------------------------------------------------------------------------------------------
+class JobCounter
+{
+public:
+    JobCounter() :
+        m_Value(0),
+        m_Locked(false)
+        {}
+
+    // number of jobs submitted against this counter that have not finished
+    long Value() const {return m_Value.load(std::memory_order_acquire);}
+
+    // the lock is checked as well so a waiter cannot destroy the counter
+    // while the last job is still releasing its continuations
+    bool IsDone() const {return Value() == 0 && !m_Locked.load(std::memory_order_acquire);}
+
+private:
+    friend class JobSystem;
+
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+
+    std::atomic<long> m_Value;
+
+    // jobs waiting for this counter to reach zero before being queued,
+    // guarded by a spin lock that is only taken around the transition to zero
+    std::atomic<bool> m_Locked;
+    std::vector<Job> m_Continuations;
+};
+
+class IJobSystem
+{
+public:
+    // virtual destructor for derived classes
+    virtual ~IJobSystem() {}
+
+    // queues count jobs. counter, if given, is raised by count and lowered as
+    // each job finishes. if dependency is given the jobs are held back until
+    // its value reaches zero.
+    virtual void Submit(const Job* jobs, long count, JobCounter* counter, JobCounter* dependency = nullptr) = 0;
+
+    // blocks until counter reaches zero. the calling thread runs queued jobs
+    // while it waits instead of idling, so waiting inside a job is allowed
+    virtual void Wait(const JobCounter& counter) = 0;
+
+    // number of threads that execute jobs, not counting threads calling Wait()
+    virtual unsigned int WorkerCount() const = 0;
+
+    // index of the calling thread, 0 to WorkerCount() - 1 for the workers and
+    // WorkerCount() for any other thread. meant for per thread scratch data
+    // sized WorkerCount() + 1, which only works if a single outside thread
+    // (the main loop) drives the work
+    virtual unsigned int ThreadIndex() const = 0;
+
+    // splits [begin, end) into slices of at most grain indices, runs func(i)
+    // for every index across the workers and returns once all have finished.
+    // a grain of 0 picks one based on the number of workers.
+    template<class TFunc>
+    void parallel_for(long begin, long end, long grain, const TFunc& func);
+
+    template<class TFunc>
+    void parallel_for(long begin, long end, const TFunc& func) {parallel_for(begin, end, 0, func);}
+
+private:
+    template<class TFunc>
+    static void parallel_for_entry(void* data, long begin, long end)
+    {
+        const TFunc& func = *static_cast<const TFunc*>(data);
+
+        for(long i = begin; i < end; ++i)
+            func(i);
+    }
+};
+
+template<class TFunc>
+void IJobSystem::parallel_for(long begin, long end, long grain, const TFunc& func)
+{
+    if(end <= begin)
+        return;
+
+    long count = end - begin;
+
+    // a few slices per worker keeps everyone busy when slices are uneven
+    if(grain <= 0)
+    {
+        grain = count / (long(WorkerCount() + 1) * 4);
+        if(grain < 1)
+            grain = 1;
+    }
+
+    if(count <= grain)
+    {
+        parallel_for_entry<TFunc>(const_cast<TFunc*>(&func), begin, end);
+        return;
+    }
+
+    std::vector<Job> jobs;
+    jobs.reserve((count + grain - 1) / grain);
+
+    for(long first = begin; first < end; first += grain)
+    {
+        Job job;
+        job.function = &parallel_for_entry<TFunc>;
+        job.data = const_cast<TFunc*>(&func);
+        job.begin = first;
+        job.end = (end - first > grain) ? first + grain : end;
+        job.counter = nullptr;
+        jobs.push_back(job);
+    }
+
+    JobCounter counter;
+    Submit(jobs.data(), long(jobs.size()), &counter);
+    Wait(counter);
+}
+
+#endif
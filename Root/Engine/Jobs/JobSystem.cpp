@@ -0,0 +1,323 @@
+#include "JobSystem.h"
+
+namespace
+{
+    // which worker of which system the current thread is, if any
+    thread_local JobSystem* t_Owner = nullptr;
+    thread_local unsigned int t_Index = 0;
+    thread_local unsigned int t_Random = 0x9E3779B9u;
+
+    // rounds of unsuccessful searching before a worker goes to sleep
+    const int IDLE_SPINS = 64;
+
+    unsigned int NextRandom()
+    {
+        // xorshift, only used to spread thieves over victims
+        t_Random ^= t_Random << 13;
+        t_Random ^= t_Random >> 17;
+        t_Random ^= t_Random << 5;
+        return t_Random;
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// JobSystem::WorkQueue
+//------------------------------------------------------------------------------------------
+JobSystem::WorkQueue::WorkQueue() :
+    m_Top(0),
+    m_Bottom(0)
+{
+}
+
+bool JobSystem::WorkQueue::Push(const Job& job)
+{
+    long long bottom = m_Bottom.load(std::memory_order_relaxed);
+    long long top = m_Top.load(std::memory_order_acquire);
+
+    if(bottom - top >= CAPACITY)
+        return false;
+
+    m_Jobs[bottom & MASK] = job;
+    m_Bottom.store(bottom + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool JobSystem::WorkQueue::Pop(Job& job)
+{
+    long long bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+    m_Bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long top = m_Top.load(std::memory_order_relaxed);
+
+    if(top > bottom)
+    {
+        // empty, undo the reservation
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    job = m_Jobs[bottom & MASK];
+
+    if(top == bottom)
+    {
+        // last job, race the thieves for it
+        bool won = m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    return true;
+}
+
+bool JobSystem::WorkQueue::Steal(Job& job)
+{
+    long long top = m_Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long bottom = m_Bottom.load(std::memory_order_acquire);
+
+    if(top >= bottom)
+        return false;
+
+    // the copy can be torn if the owner wraps around onto this slot, but in
+    // that case top has moved and the exchange below rejects it
+    job = m_Jobs[top & MASK];
+
+    return m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------------------
+// JobSystem
+//------------------------------------------------------------------------------------------
+JobSystem::JobSystem(unsigned int workers) :
+    m_Pending(0),
+    m_Sleeping(0),
+    m_Quit(false)
+{
+    if(workers == 0)
+    {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        workers = (hardware > 1) ? hardware - 1 : 1;
+    }
+
+    // every queue exists before any thread starts looking for victims
+    for(unsigned int i = 0; i < workers; ++i)
+        m_Workers.push_back(std::unique_ptr<Worker>(new Worker));
+
+    for(unsigned int i = 0; i < workers; ++i)
+        m_Workers[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_SleepLock);
+        m_Quit = true;
+    }
+    m_WakeUp.notify_all();
+
+    for(unsigned int i = 0; i < m_Workers.size(); ++i)
+        m_Workers[i]->thread.join();
+}
+
+void JobSystem::Submit(const Job* jobs, long count, JobCounter* counter, JobCounter* dependency)
+{
+    if(count <= 0)
+        return;
+
+    // raise the counter before anything can run so it cannot touch zero early
+    if(counter != nullptr)
+        counter->m_Value.fetch_add(count, std::memory_order_relaxed);
+
+    if(dependency != nullptr)
+    {
+        Lock(dependency);
+
+        // Finish() drops the value to zero under the same lock, so anything
+        // appended while the value is still raised is picked up by it
+        if(dependency->m_Value.load(std::memory_order_acquire) != 0)
+        {
+            for(long i = 0; i < count; ++i)
+            {
+                dependency->m_Continuations.push_back(jobs[i]);
+                dependency->m_Continuations.back().counter = counter;
+            }
+
+            Unlock(dependency);
+            return;
+        }
+
+        Unlock(dependency);
+    }
+
+    for(long i = 0; i < count; ++i)
+    {
+        Job job = jobs[i];
+        job.counter = counter;
+        Push(job);
+    }
+}
+
+void JobSystem::Wait(const JobCounter& counter)
+{
+    int idle = 0;
+
+    while(!counter.IsDone())
+    {
+        Job job;
+
+        if(Acquire(job))
+        {
+            Execute(job);
+            idle = 0;
+        }
+        else if(++idle > IDLE_SPINS)
+            std::this_thread::yield();
+    }
+}
+
+unsigned int JobSystem::ThreadIndex() const
+{
+    return (t_Owner == this) ? t_Index : WorkerCount();
+}
+
+void JobSystem::Push(const Job& job)
+{
+    bool queued = false;
+
+    if(t_Owner == this)
+        queued = m_Workers[t_Index]->queue.Push(job);
+
+    if(!queued)
+    {
+        std::lock_guard<std::mutex> lock(m_GlobalLock);
+        m_Global.push_back(job);
+    }
+
+    m_Pending.fetch_add(1, std::memory_order_seq_cst);
+
+    if(m_Sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_SleepLock);
+        m_WakeUp.notify_one();
+    }
+}
+
+bool JobSystem::Acquire(Job& job)
+{
+    bool found = false;
+    unsigned int count = (unsigned int)m_Workers.size();
+
+    if(t_Owner == this)
+        found = m_Workers[t_Index]->queue.Pop(job);
+
+    if(!found && m_Pending.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_GlobalLock);
+
+        if(!m_Global.empty())
+        {
+            job = m_Global.front();
+            m_Global.pop_front();
+            found = true;
+        }
+    }
+
+    if(!found && count > 0)
+    {
+        unsigned int start = NextRandom() % count;
+
+        for(unsigned int i = 0; i < count && !found; ++i)
+        {
+            unsigned int victim = (start + i) % count;
+
+            if(t_Owner != this || victim != t_Index)
+                found = m_Workers[victim]->queue.Steal(job);
+        }
+    }
+
+    if(found)
+        m_Pending.fetch_sub(1, std::memory_order_relaxed);
+
+    return found;
+}
+
+void JobSystem::Execute(Job& job)
+{
+    job.function(job.data, job.begin, job.end);
+
+    if(job.counter != nullptr)
+        Finish(job.counter);
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+    // common case, not the last job so nobody can be released
+    long value = counter->m_Value.load(std::memory_order_relaxed);
+
+    while(value > 1)
+    {
+        if(counter->m_Value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+    }
+
+    std::vector<Job> continuations;
+
+    Lock(counter);
+    if(counter->m_Value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        continuations.swap(counter->m_Continuations);
+    // the counter may be destroyed by a waiter from here on
+    Unlock(counter);
+
+    // these were counted when they were submitted
+    for(unsigned int i = 0; i < continuations.size(); ++i)
+        Push(continuations[i]);
+}
+
+void JobSystem::Lock(JobCounter* counter)
+{
+    while(counter->m_Locked.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+}
+
+void JobSystem::Unlock(JobCounter* counter)
+{
+    counter->m_Locked.store(false, std::memory_order_release);
+}
+
+void JobSystem::WorkerMain(unsigned int index)
+{
+    t_Owner = this;
+    t_Index = index;
+    t_Random = 0x9E3779B9u * (index + 1);
+
+    int idle = 0;
+
+    while(!m_Quit.load(std::memory_order_relaxed))
+    {
+        Job job;
+
+        if(Acquire(job))
+        {
+            Execute(job);
+            idle = 0;
+            continue;
+        }
+
+        if(++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // nothing to do, sleep until a job is pushed instead of burning a core
+        std::unique_lock<std::mutex> lock(m_SleepLock);
+        m_Sleeping.fetch_add(1, std::memory_order_seq_cst);
+
+        while(!m_Quit && m_Pending.load(std::memory_order_seq_cst) <= 0)
+            m_WakeUp.wait(lock);
+
+        m_Sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        idle = 0;
+    }
+}
@@ -0,0 +1,107 @@
+// File: JobSystem.h
+// Work stealing implementation of IJobSystem. Every worker thread owns a
+// deque it pushes and pops at the bottom, idle workers steal from the top of
+// the others. Jobs submitted from threads that are not workers (the main
+// loop, game code) go through a shared injection queue.
+
+#ifndef SENTIMENT_JOBSYSTEM_H
+#define SENTIMENT_JOBSYSTEM_H
+
+#include "IJobSystem.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class JobSystem :
+    public IJobSystem
+{
+public:
+    //--------------------------------------------------------------------------------------
+    // JobSystem::WorkQueue
+    //     fixed capacity Chase-Lev deque. Only the owning worker may Push and
+    //     Pop, any thread may Steal.
+    //--------------------------------------------------------------------------------------
+    class WorkQueue
+    {
+    public:
+        static const long long CAPACITY = 4096;
+
+        WorkQueue();
+
+        // returns false when the queue is full
+        bool Push(const Job& job);
+
+        bool Pop(Job& job);
+
+        bool Steal(Job& job);
+
+    private:
+        static const long long MASK = CAPACITY - 1;
+
+        // kept on separate cache lines, the owner hammers bottom while the
+        // thieves hammer top. padded by hand since the workers are allocated
+        // with plain new, which does not honour extended alignment
+        std::atomic<long long> m_Top;
+        char m_TopPadding[64];
+        std::atomic<long long> m_Bottom;
+        char m_BottomPadding[64];
+        Job m_Jobs[CAPACITY];
+    };
+
+public:
+    // 0 workers picks one less than the number of hardware threads, leaving
+    // a core for the main loop
+    JobSystem(unsigned int workers = 0);
+
+    ~JobSystem();
+
+    void Submit(const Job* jobs, long count, JobCounter* counter, JobCounter* dependency = nullptr);
+
+    void Wait(const JobCounter& counter);
+
+    unsigned int WorkerCount() const {return (unsigned int)m_Workers.size();}
+
+    unsigned int ThreadIndex() const;
+
+private:
+    struct Worker
+    {
+        WorkQueue queue;
+        std::thread thread;
+    };
+
+    void WorkerMain(unsigned int index);
+
+    // queues a job that has already been counted
+    void Push(const Job& job);
+
+    // takes one job from the local queue, the injection queue or a victim
+    bool Acquire(Job& job);
+
+    void Execute(Job& job);
+
+    void Finish(JobCounter* counter);
+
+    static void Lock(JobCounter* counter);
+
+    static void Unlock(JobCounter* counter);
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+
+    std::mutex m_GlobalLock;
+    std::deque<Job> m_Global;
+
+    // number of queued jobs, used only to decide whether to sleep
+    std::atomic<long> m_Pending;
+    std::atomic<long> m_Sleeping;
+    std::mutex m_SleepLock;
+    std::condition_variable m_WakeUp;
+
+    std::atomic<bool> m_Quit;
+};
+
+#endif
@@ -1,9 +1,151 @@
 #ifndef SENTIMENT_ISYSTEM_H
 #define SENTIMENT_ISYSTEM_H
 
+#include "Root/Engine/Entity System/TypeID.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class World;
+
 class ISystem
 {
+public:
+    //------------------------------------------------------------------------------------------
+    // ISystem::Access
+    //     the component types a system touches. The World orders two systems
+    //     only if one writes what the other reads or writes, everything else
+    //     is free to run at the same time on different workers.
+    //------------------------------------------------------------------------------------------
+    class Access
+    {
+    public:
+        Access() :
+            m_Exclusive(false)
+            {}
+
+        template<class T>
+        Access& Read() {Insert(m_Reads, T::TypeID()); return *this;}
+
+        template<class T>
+        Access& Write() {Insert(m_Writes, T::TypeID()); return *this;}
+
+        // the system makes structural changes directly instead of through
+        // World::Commands(), or touches state outside the world, and runs alone
+        Access& Exclusive() {m_Exclusive = true; return *this;}
+
+        const std::vector<TypeHash>& Reads() const {return m_Reads;}
+
+        const std::vector<TypeHash>& Writes() const {return m_Writes;}
+
+        bool IsExclusive() const {return m_Exclusive;}
+
+        bool Conflicts(const Access& other) const
+        {
+            return m_Exclusive || other.m_Exclusive ||
+                   Overlaps(m_Writes, other.m_Writes) ||
+                   Overlaps(m_Writes, other.m_Reads) ||
+                   Overlaps(m_Reads, other.m_Writes);
+        }
+
+        void Clear()
+        {
+            m_Reads.clear();
+            m_Writes.clear();
+            m_Exclusive = false;
+        }
+
+    private:
+        static void Insert(std::vector<TypeHash>& set, TypeHash typeID)
+        {
+            std::vector<TypeHash>::iterator it = std::lower_bound(set.begin(), set.end(), typeID);
+
+            if(it == set.end() || *it != typeID)
+                set.insert(it, typeID);
+        }
+
+        // both sets are sorted
+        static bool Overlaps(const std::vector<TypeHash>& lhs, const std::vector<TypeHash>& rhs)
+        {
+            std::vector<TypeHash>::const_iterator l = lhs.begin();
+            std::vector<TypeHash>::const_iterator r = rhs.begin();
+
+            while(l != lhs.end() && r != rhs.end())
+            {
+                if(*l < *r)
+                    ++l;
+                else if(*r < *l)
+                    ++r;
+                else
+                    return true;
+            }
+
+            return false;
+        }
+
+    private:
+        std::vector<TypeHash> m_Reads;
+        std::vector<TypeHash> m_Writes;
+        bool m_Exclusive;
+    };
+
+public:
+    typedef std::chrono::steady_clock clock;
+
+    ISystem() :
+        m_LastRun(0),
+        m_Budget(0.0),
+        m_Cursor(0)
+        {}
+
+    // virtual destructor for derived classes
+    virtual ~ISystem() {}
+
+    // fills in the component types the system reads and writes. called every
+    // frame before the execution graph is built
+    virtual void Declare(Access& access) = 0;
+
+    // runs the system. may be called from any worker thread, and at the same
+    // time as other systems whose access does not conflict
+    virtual void Update(World& world) = 0;
+
+    // seconds a single Update() may take, 0 for no limit
+    double Budget() const {return m_Budget;}
+
+protected:
+    // World version taken as the previous run of this system finished, 0
+    // before the first run. pass it to QueryView::Changed() to only visit
+    // what others wrote since this system last looked. the writes of that
+    // run are older, so a system does not see its own changes again
+    std::uint32_t LastRunVersion() const {return m_LastRun;}
+
+    // a system with a budget does part of its work per frame. it checks
+    // OutOfBudget() as it goes, stops once it is true and keeps its place in
+    // the cursor to carry on from next frame. runs that go over are counted
+    // in World::GetSystemStats()
+    void SetBudget(double seconds) {m_Budget = seconds;}
+
+    // always false without a budget
+    bool OutOfBudget() const {return m_Budget > 0.0 && clock::now() >= m_Deadline;}
+
+    // kept between runs, 0 at first
+    long Cursor() const {return m_Cursor;}
+
+    void SetCursor(long cursor) {m_Cursor = cursor;}
+
+private:
+    friend class World;
+
+    std::uint32_t m_LastRun;
+
+    double m_Budget;
+    long m_Cursor;
 
+    // set by the World before every run with a budget
+    clock::time_point m_Deadline;
 };
 
 typedef void (*SYSTEM_CONSTRUCTOR)(std::shared_ptr<ISystem> & systemObj);
@@ -0,0 +1,206 @@
+#include "FrameScheduler.h"
+
+#include <thread>
+
+#ifdef _WIN32
+
+// CreateWaitableTimerExW needs Vista
+#if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+
+#include <windows.h>
+
+// Windows 10 1803, older sdk headers do not know it yet
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+#endif
+
+namespace
+{
+    typedef std::chrono::duration<double> seconds;
+
+    // weight of the newest sample in the moving frame time average
+    const double AVERAGE_WEIGHT = 0.1;
+
+    // bounds for the self tuning sleep slack
+    const std::chrono::microseconds MIN_SLACK(250);
+    const std::chrono::microseconds MAX_SLACK(20000);
+}
+
+FrameScheduler::FrameScheduler(const INIT_DESC& desc) :
+    m_TickLength(1.0 / desc.tickRate),
+    m_Accumulator(0.0),
+    m_MaxTicks(desc.maxTicksPerFrame > 0 ? desc.maxTicksPerFrame : 1),
+    m_FrameLength(clock::duration::zero()),
+    m_SleepSlack(std::chrono::milliseconds(2)),
+    m_FrameStart(clock::now()),
+    m_Deadline(m_FrameStart),
+    m_Timer(nullptr),
+    m_Stats()
+{
+#ifdef _WIN32
+    // the default timer runs at 15.6ms, longer than a whole frame at 120hz.
+    // older systems fail the flag and fall back to sleep_until, where the
+    // slack cap in WaitUntil keeps the yield loop in charge of the last
+    // half frame
+    m_Timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+
+    SetFrameLimit(desc.maxFrameRate);
+}
+
+FrameScheduler::~FrameScheduler()
+{
+#ifdef _WIN32
+    if(m_Timer != nullptr)
+        CloseHandle((HANDLE)m_Timer);
+#endif
+}
+
+void FrameScheduler::SetFrameLimit(double framesPerSecond)
+{
+    if(framesPerSecond > 0.0)
+        m_FrameLength = std::chrono::duration_cast<clock::duration>(seconds(1.0 / framesPerSecond));
+    else
+        m_FrameLength = clock::duration::zero();
+}
+
+void FrameScheduler::BeginFrame()
+{
+    clock::time_point now = clock::now();
+
+    // the time between construction and the first frame is loading, not
+    // simulation, and would start the loop on a full set of catch up ticks
+    if(m_Stats.frameCount == 0)
+    {
+        m_FrameStart = now;
+        m_Deadline = now;
+    }
+
+    double elapsed = std::chrono::duration_cast<seconds>(now - m_FrameStart).count();
+    m_FrameStart = now;
+
+    m_Stats.frameTime = elapsed;
+    if(m_Stats.frameCount == 0)
+        m_Stats.averageFrameTime = elapsed;
+    else
+        m_Stats.averageFrameTime += (elapsed - m_Stats.averageFrameTime) * AVERAGE_WEIGHT;
+
+    // clamp the accumulator so a long stall (debugger, loading, window drag)
+    // cannot start a spiral of ever longer catch up frames
+    m_Accumulator += elapsed;
+    double maxAccumulated = m_TickLength * m_MaxTicks;
+
+    if(m_Accumulator > maxAccumulated)
+    {
+        m_Stats.droppedTime = m_Accumulator - maxAccumulated;
+        m_Accumulator = maxAccumulated;
+    }
+    else
+        m_Stats.droppedTime = 0.0;
+
+    m_Stats.ticks = 0;
+}
+
+bool FrameScheduler::Tick()
+{
+    if(m_Accumulator >= m_TickLength)
+    {
+        m_Accumulator -= m_TickLength;
+        m_Stats.ticks++;
+        m_Stats.tickCount++;
+        return true;
+    }
+
+    m_Stats.alpha = m_Accumulator / m_TickLength;
+    return false;
+}
+
+void FrameScheduler::EndFrame()
+{
+    clock::time_point workEnd = clock::now();
+
+    m_Stats.workTime = std::chrono::duration_cast<seconds>(workEnd - m_FrameStart).count();
+    if(m_Stats.workTime > m_Stats.peakWorkTime)
+        m_Stats.peakWorkTime = m_Stats.workTime;
+
+    if(m_FrameLength != clock::duration::zero())
+    {
+        // deadlines advance by whole frames so pacing does not drift, but a
+        // frame that overran is not made up for by shortening the next ones
+        m_Deadline += m_FrameLength;
+        if(m_Deadline < workEnd)
+            m_Deadline = workEnd;
+
+        WaitUntil(m_Deadline);
+    }
+    else
+        m_Deadline = workEnd;
+
+    m_Stats.waitTime = std::chrono::duration_cast<seconds>(clock::now() - workEnd).count();
+    m_Stats.frameCount++;
+}
+
+void FrameScheduler::WaitUntil(clock::time_point deadline)
+{
+    clock::time_point now = clock::now();
+
+    if(deadline - now > m_SleepSlack)
+    {
+        clock::time_point wake = deadline - m_SleepSlack;
+        SleepUntil(wake);
+        now = clock::now();
+
+        // learn how late the os wakes us up. grow immediately so the next
+        // frame does not overshoot again, shrink slowly to stay conservative
+        clock::duration oversleep = now - wake;
+        if(oversleep > m_SleepSlack)
+            m_SleepSlack = oversleep;
+        else
+            m_SleepSlack -= (m_SleepSlack - oversleep) / 16;
+
+        // a slack past half a frame would leave most of every frame to the
+        // yield loop, so a coarse os timer is worked around by yielding
+        // rather than by sleeping less
+        clock::duration maxSlack = MAX_SLACK;
+        if(maxSlack > m_FrameLength / 2)
+            maxSlack = m_FrameLength / 2;
+
+        if(m_SleepSlack > maxSlack)
+            m_SleepSlack = maxSlack;
+        if(m_SleepSlack < MIN_SLACK)
+            m_SleepSlack = MIN_SLACK;
+    }
+
+    // the last stretch is shorter than the sleep granularity, give the core
+    // away between checks instead of burning it
+    while(clock::now() < deadline)
+        std::this_thread::yield();
+}
+
+void FrameScheduler::SleepUntil(clock::time_point wake)
+{
+#ifdef _WIN32
+    if(m_Timer != nullptr)
+    {
+        // relative due times are negative, in 100ns units
+        LARGE_INTEGER due;
+        due.QuadPart = -std::chrono::duration_cast<std::chrono::duration<LONGLONG, std::ratio<1, 10000000> > >(wake - clock::now()).count();
+
+        if(due.QuadPart >= 0)
+            return;
+
+        if(SetWaitableTimer((HANDLE)m_Timer, &due, 0, nullptr, nullptr, FALSE))
+        {
+            WaitForSingleObject((HANDLE)m_Timer, INFINITE);
+            return;
+        }
+    }
+#endif
+
+    std::this_thread::sleep_until(wake);
+}
@@ -0,0 +1,106 @@
+// File: FrameScheduler.h
+// Drives the engine main loop. Simulation runs on a fixed tick that is
+// decoupled from the render rate, the remainder of the accumulated time is
+// handed out as an interpolation alpha, and the end of every frame is paced
+// against a target frame length by sleeping rather than spinning.
+
+#ifndef SENTIMENT_FRAMESCHEDULER_H
+#define SENTIMENT_FRAMESCHEDULER_H
+
+#include <chrono>
+
+// per frame timing statistics, all times are in seconds
+struct FrameStats
+{
+    // wall time between the start of the last frame and the start of this one
+    double frameTime;
+    // time spent in simulation and drawing, excluding pacing
+    double workTime;
+    // time spent waiting on the frame limiter
+    double waitTime;
+    // exponential moving average of frameTime
+    double averageFrameTime;
+    // largest workTime seen since the stats were last reset
+    double peakWorkTime;
+    // fraction of a tick left in the accumulator, to interpolate renders with
+    double alpha;
+    // number of simulation ticks run during the last frame
+    unsigned int ticks;
+    // simulation time that was discarded because the frame ran too long
+    double droppedTime;
+    // running totals
+    unsigned long long frameCount;
+    unsigned long long tickCount;
+};
+
+class FrameScheduler
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    struct INIT_DESC
+    {
+        // simulation ticks per second
+        double tickRate;
+        // frames per second to pace to, 0 disables the limiter
+        double maxFrameRate;
+        // upper bound on catch up ticks in a single frame
+        unsigned int maxTicksPerFrame;
+    };
+
+public:
+    FrameScheduler(const INIT_DESC& desc);
+    ~FrameScheduler();
+
+    // marks the start of a frame and feeds the elapsed time into the accumulator
+    void BeginFrame();
+
+    // returns true while a fixed simulation tick should be run, consuming it
+    bool Tick();
+
+    // marks the end of the work for this frame and waits out the frame limit
+    void EndFrame();
+
+    // length of a single simulation tick in seconds
+    double TickLength() const {return m_TickLength;}
+
+    // interpolation factor between the last two simulation states [0, 1)
+    double Alpha() const {return m_Stats.alpha;}
+
+    const FrameStats& Stats() const {return m_Stats;}
+
+    void ResetPeaks() {m_Stats.peakWorkTime = 0.0;}
+
+    // 0 disables the limiter
+    void SetFrameLimit(double framesPerSecond);
+
+private:
+    FrameScheduler(const FrameScheduler&);
+    FrameScheduler& operator=(const FrameScheduler&);
+
+    // sleeps until close to the deadline then yields for the remainder
+    void WaitUntil(clock::time_point deadline);
+
+    // the os sleep, on the high resolution timer where there is one
+    void SleepUntil(clock::time_point wake);
+
+private:
+    double m_TickLength;
+    double m_Accumulator;
+    unsigned int m_MaxTicks;
+
+    clock::duration m_FrameLength;
+    // measured oversleep of the os scheduler, used to wake up early enough
+    clock::duration m_SleepSlack;
+
+    clock::time_point m_FrameStart;
+    clock::time_point m_Deadline;
+
+    // high resolution waitable timer on windows, null elsewhere or where the
+    // os does not offer one
+    void * m_Timer;
+
+    FrameStats m_Stats;
+};
+
+#endif
@@ -18,10 +18,15 @@ public:
 
     virtual void Activate() = 0;
 
+    // called once per rendered frame, before drawing. Engine::Alpha() holds
+    // how far between the last two ticks the frame should be interpolated
     virtual void PreDraw() = 0;
 
+    // called once per fixed simulation tick, zero or more times a frame.
+    // Engine::TickLength() is the step to advance the simulation by
     virtual void Frame() = 0;
 
+    // called once per rendered frame, after drawing
     virtual void PostDraw() = 0;
 
 protected:
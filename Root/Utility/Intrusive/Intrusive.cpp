@@ -7,6 +7,7 @@
  *****************************************************************************/
 
 #include "Intrusive.h"
+#include "Root/Utility/SlabAllocator/SlabAllocator.h"
 
 namespace intrusive
 {
@@ -25,21 +26,98 @@ namespace intrusive
 
     void dynamic_node::attach(base_container* listptr)
     {
-        if(m_hooks.count(listptr) == 0)
+        if(get_hook(listptr) != nullptr)
+            return;
+
+        hook_table* table = &m_hooks;
+
+        while(table->next != nullptr)
+            table = table->next;
+
+        if(table->count == hook_table::HOOKS)
         {
-            m_hooks.insert(map_type::value_type(listptr, std::shared_ptr<base_hook>(listptr->create_hook())));
+            table->next = allocate_table();
+            table = table->next;
         }
 
+        void* where = table->storage + table->used;
+        std::size_t space = hook_table::BYTES - table->used;
+        base_hook* hook = listptr->create_hook_in(where, space);
+
+        // a hook that does not fit behind the others may still fit in a
+        // table of its own
+        if(hook == nullptr && table->count > 0)
+        {
+            table->next = allocate_table();
+            table = table->next;
+
+            where = table->storage;
+            space = hook_table::BYTES;
+            hook = listptr->create_hook_in(where, space);
+        }
+
+        if(hook != nullptr)
+            table->used = hook_table::BYTES - space;
+        else
+            hook = listptr->create_hook();
+
+        table->containers[table->count] = listptr;
+        table->hooks[table->count] = hook;
+        ++table->count;
+
         return;
     }
 
     void dynamic_node::detach()
     {
-        for(auto it = m_hooks.begin(); it != m_hooks.end(); ++it)
+        for(hook_table* table = &m_hooks; table != nullptr; table = table->next)
+            for(unsigned int i = 0; i < table->count; ++i)
+                table->hooks[i]->unhook(table->containers[i]);
+
+        hook_table* table = &m_hooks;
+
+        while(table != nullptr)
         {
-            it->second->unhook(it->first);
+            for(unsigned int i = 0; i < table->count; ++i)
+            {
+                if(table->owns(table->hooks[i]))
+                    table->hooks[i]->~base_hook();
+                else
+                    delete table->hooks[i];
+            }
+
+            hook_table* next = table->next;
+
+            if(table != &m_hooks)
+                free_table(table);
+
+            table = next;
         }
 
-        m_hooks.clear();
+        m_hooks.next = nullptr;
+        m_hooks.count = 0;
+        m_hooks.used = 0;
+    }
+
+    // overflow tables of every dynamic_node. never destroyed, so nodes may
+    // outlive static destruction, and the cached calls fall back to the
+    // lock once the thread caches are gone, so nodes may be destroyed
+    // during it
+    static SlabAllocator& table_pool(std::size_t size, std::size_t align)
+    {
+        static SlabAllocator* pool = new SlabAllocator(size, align);
+
+        return *pool;
+    }
+
+    dynamic_node::hook_table* dynamic_node::allocate_table()
+    {
+        return new(table_pool(sizeof(hook_table), alignof(hook_table)).AllocateCached()) hook_table;
+    }
+
+    void dynamic_node::free_table(hook_table* table)
+    {
+        table->~hook_table();
+        table_pool(sizeof(hook_table), alignof(hook_table)).DeallocateCached(table);
     }
 }
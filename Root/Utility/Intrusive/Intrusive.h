@@ -86,10 +86,12 @@
 #ifndef INTRUSIVE_H
 #define INTRUSIVE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <stdexcept>
 #include <memory>
-#include <map>
+#include <new>
+#include <stdexcept>
 
 namespace intrusive
 {
@@ -182,8 +184,83 @@ namespace intrusive
          *       specific to the container type.
          */
         virtual base_hook* create_hook() = 0;
+
+        /**
+         * Virtual Function Declaration
+         * @name - create_hook_in(void*& where, std::size_t& space)
+         * @scope - intrusive::base_container
+         * @purpose - Constructs the hook of the container in the space given
+         *       instead of on the heap, the way std::align does: where and
+         *       space are moved past the new hook. Nodes with storage of
+         *       their own use this to avoid an allocation per container.
+         * @param where - the first free byte, advanced past the hook
+         * @param space - the bytes free from where, reduced by what was used
+         * @return - the new hook, or nullptr if it does not fit, in which case
+         *       where and space are left alone. The default never fits, so
+         *       containers that do not override this are always given a hook
+         *       from create_hook().
+         */
+        virtual base_hook* create_hook_in(void*&, std::size_t&) {return nullptr;}
     };
 
+    /**
+     * Function Declaration
+     * @name - template<class THook> emplace_hook(void*& where, std::size_t& space)
+     * @scope - intrusive
+     * @purpose - the usual body of create_hook_in() for a container whose
+     *       hook is THook.
+     * @return - the new hook, or nullptr if it does not fit
+     * -- INLINE --
+     */
+    template<class THook>
+    base_hook* emplace_hook(void*& where, std::size_t& space)
+    {
+        void* aligned = where;
+        std::size_t left = space;
+
+        if(std::align(alignof(THook), sizeof(THook), aligned, left) == nullptr)
+            return nullptr;
+
+        base_hook* created = new(aligned) THook;
+
+        where = static_cast<unsigned char*>(aligned) + sizeof(THook);
+        space = left - sizeof(THook);
+
+        return created;
+    }
+
+    /**
+     * Function Declaration
+     * @name - template<class T, class THook> member_owner(THook* hook, THook T::* member)
+     * @scope - intrusive
+     * @purpose - used by the member hook containers, which keep a hook as a
+     *       named member of the element instead of asking a node for it, to
+     *       get from the hook back to the element. With member known at
+     *       compile time this folds to subtracting a constant.
+     *
+     *       The offset is taken the way offsetof takes it, from the
+     *       address of the member in a T at a made up, suitably aligned
+     *       address, without ever looking at a T. Unlike offsetof this is
+     *       not limited to standard layout types: elements may be
+     *       polymorphic and derive from other classes, like the nodes do.
+     *       Member pointers into a virtual base do not convert to
+     *       THook T::*, so those never get here. This is how member hooks
+     *       are done in Boost.Intrusive as well, and it holds on GCC, Clang
+     *       and MSVC, where a data member pointer is a constant offset.
+     * @pre - hook must be the member of a T
+     * @return - the T whose member hook is
+     * -- INLINE --
+     */
+    template<class T, class THook>
+    T* member_owner(THook* hook, THook T::* member)
+    {
+        // offsetof is often written with a null base, which sanitizers trap
+        const std::uintptr_t base = alignof(T) < 64 ? 64 : alignof(T);
+        std::ptrdiff_t offset = std::ptrdiff_t(reinterpret_cast<std::uintptr_t>(&(reinterpret_cast<const volatile T*>(base)->*member)) - base);
+
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(hook) - offset);
+    }
+
     /**********************************************************************
      * Abstract Class Declaration
      *
@@ -557,31 +634,104 @@ namespace intrusive
      * @desc - This is, in my opinion, what makes these intrusive containers
      *       worth it. A dynamic_node lifts the restriction of a node,
      *       belonging to only one container at once. This required that the
-     *       node be able to hold more than one hook at a time, and to do that
-     *       i used the std::map to hold the hooks with indexes to the
-     *       container that they belong to. When a container needs the hook
-     *       it just calls the get_hook method like any other node, except the
-     *       container pointer passed in is utilized as an index to look up the
-     *       corresponding node. Even better, using the base_hook pointers, the
-     *       map can hold any type of hook, which, in summary, means that a
-     *       dynamic node can belong to any container of any type at any time.
+     *       node be able to hold more than one hook at a time. When a
+     *       container needs the hook it just calls the get_hook method like
+     *       any other node, except the container pointer passed in is
+     *       utilized as a key to look up the corresponding hook. Even better,
+     *       using the base_hook pointers, the node can hold any type of hook,
+     *       which, in summary, means that a dynamic node can belong to any
+     *       container of any type at any time.
+     *
+     *       The hooks used to live in a std::map of shared_ptrs, which cost
+     *       three allocations per container and a tree walk on every
+     *       get_hook(), and containers call get_hook() on every step they
+     *       take. Now the node carries a hook_table of its own: the first
+     *       few containers and their hooks sit in small arrays, and the hooks
+     *       themselves are built in place in the storage behind them through
+     *       create_hook_in(). Lookup is a scan over a handful of pointers and
+     *       the common case of one to three containers never allocates.
+     *       Containers beyond that chain further tables off the first one,
+     *       taken from a pool shared by all nodes, and a hook too large for
+     *       any table comes from create_hook() on the heap.
      *
-     *       The only real tradeoff here is that depending on the number of
-     *       containers the node belongs to, the node will grow quite large,
-     *       and the operations within the containers can become quite
-     *       quite expensive as the calls to get_hook() stack up. You can use
-     *       them in a couple containers, but things can become quite slow if
-     *       a node belongs to too many containers, so use them wisely, and
-     *       they in turn will show you their true potential. Give and take.
+     *       The tradeoff is that every node is a bit over a hundred bytes
+     *       larger, whether it joins a container or not, and a node that
+     *       belongs to many containers still pays a longer scan per
+     *       get_hook(). Use them wisely, and they in turn will show you their
+     *       true potential. Give and take.
      *
      *********************************************************************/
     class dynamic_node :
         public base_node
     {
-        // too lazy to type this type a lot
-        typedef std::map<base_container* ,std::shared_ptr<base_hook> > map_type;
+        /**
+         * Struct Declaration
+         * @name - hook_table
+         * @scope - intrusive::dynamic_node
+         * @purpose - up to HOOKS containers and their hooks, the hooks built
+         *       in storage from the front. A hook that is not inside storage
+         *       came from the heap. next links the overflow tables.
+         */
+        struct hook_table
+        {
+            static const unsigned int HOOKS = 3;
+
+            // three list hooks, or one map hook with a string key and a
+            // list hook
+            static const std::size_t BYTES = 12 * sizeof(void*);
+
+            base_container* containers[HOOKS];
+            base_hook* hooks[HOOKS];
+            hook_table* next;
+            unsigned int count;
+            std::size_t used;
+            alignas(std::max_align_t) unsigned char storage[BYTES];
+
+            hook_table() :
+                next(nullptr),
+                count(0),
+                used(0)
+                {}
+
+            bool owns(const base_hook* hook) const
+            {
+                const unsigned char* at = reinterpret_cast<const unsigned char*>(hook);
+
+                return at >= storage && at < storage + BYTES;
+            }
+        };
 
     public:
+        /**
+         * Function Declaration
+         * @name - dynamic_node()
+         * @scope - intrusive::dynamic_node
+         * @purpose - default constructor, the node starts out in no container
+         * -- INLINE --
+         */
+        dynamic_node() {}
+
+        /**
+         * Function Declaration
+         * @name - dynamic_node(const dynamic_node&)
+         * @scope - intrusive::dynamic_node
+         * @purpose - a copy is a new object, so it starts out in no container
+         *       rather than sharing the hooks of the original.
+         * -- INLINE --
+         */
+        dynamic_node(const dynamic_node&) :
+            base_node()
+            {}
+
+        /**
+         * Function Declaration
+         * @name - operator=(const dynamic_node&)
+         * @scope - intrusive::dynamic_node
+         * @purpose - assignment leaves the containers of both nodes alone
+         * -- INLINE --
+         */
+        dynamic_node& operator=(const dynamic_node&) {return *this;}
+
         /**
          * Virtual Function Declaration
          * @name - ~dynamic_node()
@@ -636,11 +786,12 @@ namespace intrusive
          * @scope - intrusive::dynamic_node
          * @purpose - This function is used to attach this node to the
          *       container and create a valid hook for it to use, adding it
-         *       in the map of hooks, to be recalled later. The pointer to the
-         *       container is used as an index to the obtain it later.
+         *       to the hook table, to be recalled later. The pointer to the
+         *       container is used as a key to obtain it later. Attaching to
+         *       a container the node already belongs to does nothing.
          * @pre - listptr CANNOT be null and must point to a valid container
-         * @post - a hook will be added to the hook map to be used by later by
-         *       the container.
+         * @post - a hook will be in the hook table to be used later by the
+         *       container.
          * @param listptr - a pointer to a valid container to obtain a hook
          *       from
          */
@@ -652,8 +803,7 @@ namespace intrusive
          * @scope - intrusive::dynamic_node
          * @purpose - used to close the gap in all the containers the node
          *       belongs to, and then destroy all the hooks currently in the
-         *       map. Becauset the hooks are managed by smart pointers, all
-         *       the hooks are destroyed automatically when the map is cleared.
+         *       table and give the overflow tables back to the pool.
          * @post - the node will be removed from all containers, and the hooks
          *       destroyed
          */
@@ -664,16 +814,41 @@ namespace intrusive
          * @name - get_hook(base_container*)
          * @scope - intrusive::dynamic_node
          * @purpose - This is used to obtain the hook corresponding to the
-         *       given container. The pointer is used to navigate the map
-         *       and locate the hook used by the container.
+         *       given container. The containers in the table are scanned
+         *       in the order the node joined them.
          * @pre - listptr CANNOT be null and must point to a valid container
-         * @return - a pointer to the hook used by the container is returned.
+         * @return - a pointer to the hook used by the container is returned,
+         *       or nullptr if the node does not belong to the container.
          * -- INLINE --
          */
-        base_hook* get_hook(base_container* listptr) { return m_hooks[listptr].get();}
+        base_hook* get_hook(base_container* listptr)
+        {
+            for(hook_table* table = &m_hooks; table != nullptr; table = table->next)
+                for(unsigned int i = 0; i < table->count; ++i)
+                    if(table->containers[i] == listptr)
+                        return table->hooks[i];
+
+            return nullptr;
+        }
 
     private:
-        map_type m_hooks;
+        /**
+         * Function Declaration
+         * @name - allocate_table()
+         * @scope - intrusive::dynamic_node
+         * @purpose - takes an empty overflow table from the shared pool
+         */
+        static hook_table* allocate_table();
+
+        /**
+         * Function Declaration
+         * @name - free_table(hook_table*)
+         * @scope - intrusive::dynamic_node
+         * @purpose - gives an overflow table back to the shared pool
+         */
+        static void free_table(hook_table* table);
+
+        hook_table m_hooks;
     };
 }
 
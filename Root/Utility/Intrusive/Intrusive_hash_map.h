@@ -0,0 +1,662 @@
+/******************************************************************************
+ * @File - Intrusive_hash_map.h
+ * @Purpose - This file contains the intrusive hash map implementation to be
+ *       used along side the nodes declared in Intrusive.h
+ *
+ * @Description - The hash map is for point lookups, where the ordered
+ *       intrusive::map pays a pointer chase per level for an order nobody
+ *       asked for. It is an open addressing table in the style of
+ *       SwissTable: every slot is just a pointer to a node, and a byte of
+ *       control per slot says whether it is empty, deleted, or full, in
+ *       which case it holds 7 bits of the hash of the key. Probing looks at
+ *       a group of 16 control bytes at once, with SSE2 where there is SSE2,
+ *       so most lookups touch one group of control bytes and the one node
+ *       that matches.
+ *
+ *       The hook holds the key, the full hash and a pointer to the slot
+ *       holding the node, so removing a node, or the node destroying
+ *       itself, is O(1) and needs no lookup.
+ *
+ *       Growing does not stall a single insert with clearing a large table
+ *       or moving every node. When the table is 3/4 used a new one is
+ *       allocated, and the inserts after that clear a few groups of it each
+ *       while they still go to the current table, which has room up to 7/8.
+ *       Once the new table is clear it takes over and the old one is kept
+ *       around; every insert after that moves a couple of groups worth of
+ *       slots over, and lookups check both tables until the old one is
+ *       empty and freed.
+ *
+ *       For an object to be used in this container, all an object needs to do
+ *       is inherit from one of the node objects declared in Intrusive.h
+ *
+ *****************************************************************************/
+#ifndef INTRUSIVE_HASH_MAP_H
+#define INTRUSIVE_HASH_MAP_H
+
+#include "Intrusive.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INTRUSIVE_SSE
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace intrusive
+{
+    /**************************************************************************
+     * Class Declaration
+     *
+     * @name - template<class TKey, class T, class THash> hash_map
+     *
+     * @scope - intrusive
+     *
+     * @inherits - intrusive::base_container            @see Intrusive.h
+     *
+     * @desc - an unordered map of unique keys to nodes. Keys are hashed with
+     *       THash and compared with operator==.
+     *
+     *************************************************************************/
+    template<class TKey, class T, class THash = std::hash<TKey> >
+    class hash_map :
+        public base_container
+    {
+        // control bytes probed at once
+        static const std::size_t GROUP = 16;
+
+        // slots moved from the old table to the new one per insert
+        static const std::size_t MIGRATE_SLOTS = 2 * GROUP;
+
+        // slots of the next table cleared per insert, enough for a table of
+        // sixteen times the size to be ready before the current one is full
+        static const std::size_t PREPARE_SLOTS = 8 * GROUP;
+
+        // full slots hold the low 7 bits of the hash, so only these are
+        // negative
+        static const signed char EMPTY = -128;
+        static const signed char DELETED = -2;
+
+        struct table
+        {
+            std::unique_ptr<signed char[]> ctrl;
+            // null in every slot that is not full
+            std::unique_ptr<base_node*[]> slots;
+            std::size_t capacity;
+            // slots that are full or deleted, since both lengthen probes
+            std::size_t used;
+
+            table() :
+                capacity(0),
+                used(0)
+                {}
+
+            bool owns(base_node** slot) const
+            {
+                return slot >= slots.get() && slot < slots.get() + capacity;
+            }
+        };
+
+    public:
+        class hook :
+            public base_hook
+        {
+        public:
+            hook() :
+                m_hash(0),
+                m_slot(nullptr)
+                {}
+
+            /**
+             * Function Declaration
+             * @name - unhook(base_container* mapptr)
+             * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>::hook
+             * @purpose - frees the slot holding the element. Does nothing
+             *       if the element was already removed, so the map may be
+             *       gone by then.
+             */
+            void unhook(base_container* mapptr)
+            {
+                if(m_slot != nullptr)
+                    static_cast<hash_map*>(mapptr)->unlink(this);
+            }
+
+            TKey m_key;
+            std::size_t m_hash;
+            base_node ** m_slot;
+        };
+
+        /**********************************************************************
+         * Class Declaration
+         *
+         * @name - iterator
+         *
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         *
+         * @desc - walks the elements in no particular order. Inserting may
+         *       move elements between tables, which invalidates iterators.
+         *       Removing does not.
+         *********************************************************************/
+        class iterator
+        {
+        public:
+            iterator(hash_map * mapptr = 0, base_node ** slot = 0) :
+                m_mapptr(mapptr),
+                m_slot(slot)
+                {}
+
+            T& operator*() const
+            {
+                if(m_slot == nullptr)
+                    throw std::out_of_range("Iterator out of range.");
+
+                return *static_cast<T*>(*m_slot);
+            }
+
+            const TKey& key() const
+            {
+                if(m_slot == nullptr)
+                    throw std::out_of_range("Iterator out of range.");
+
+                return GET_HOOK((*m_slot), m_mapptr)->m_key;
+            }
+
+            iterator& operator++()
+            {
+                if(m_slot != nullptr)
+                    m_slot = m_mapptr->next_full(m_slot + 1);
+
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator temp(*this);
+                ++*this;
+                return temp;
+            }
+
+            bool operator==(const iterator& x) const {return m_slot == x.m_slot;}
+            bool operator!=(const iterator& x) const {return m_slot != x.m_slot;}
+
+        private:
+            friend class hash_map;
+
+            hash_map * m_mapptr;
+            base_node ** m_slot;
+        };
+
+    public:
+        hash_map() :
+            m_Cursor(0),
+            m_Ready(0),
+            m_Size(0)
+            {}
+
+        /**
+         * Function Declaration
+         * @name - ~hash_map()
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @purpose - unlinks every element, so elements outliving the map
+         *       do not reach back into it when they are destroyed
+         */
+        ~hash_map()
+        {
+            clear();
+        }
+
+        base_hook * create_hook()
+        {
+            return new hook;
+        }
+
+        base_hook * create_hook_in(void*& where, std::size_t& space)
+        {
+            return emplace_hook<hook>(where, space);
+        }
+
+        bool is_empty() const
+        {
+            return m_Size == 0;
+        }
+
+        long size() const
+        {
+            return long(m_Size);
+        }
+
+        /**
+         * Function Declaration
+         * @name - insert(const TKey& key, base_node& val)
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @purpose - attaches val to this map under key. Makes a new
+         *       table when this one is 3/4 used and clears part of it per
+         *       insert, then moves part of the old table over per insert
+         *       once the new one has taken over.
+         * @pre - val must not be in this map already
+         * @return - an iterator to val and true, or if key is taken, an
+         *       iterator to the element holding it and false. val is left
+         *       alone in that case.
+         */
+        std::pair<iterator, bool> insert(const TKey& key, base_node & val)
+        {
+            std::size_t hash = hash_of(key);
+            base_node ** found = find_slot(key, hash);
+
+            if(found != nullptr)
+                return std::make_pair(iterator(this, found), false);
+
+            migrate(MIGRATE_SLOTS);
+            prepare(PREPARE_SLOTS);
+
+            if(m_Next.capacity == 0 && (m_Table.used + 1) * 4 > m_Table.capacity * 3)
+            {
+                migrate(m_Old.capacity);
+                grow(m_Size + 1);
+                prepare(PREPARE_SLOTS);
+            }
+
+            // the next table was not ready in time, it is finished here
+            if((m_Table.used + 1) * 8 > m_Table.capacity * 7)
+            {
+                migrate(m_Old.capacity);
+                prepare(m_Next.capacity);
+                migrate(MIGRATE_SLOTS);
+            }
+
+            val.attach(this);
+
+            hook * valHook = GET_HOOK((&val), this);
+
+            valHook->m_key = key;
+            valHook->m_hash = hash;
+            valHook->m_slot = place(m_Table, hash, &val);
+            ++m_Size;
+
+            return std::make_pair(iterator(this, valHook->m_slot), true);
+        }
+
+        /**
+         * Function Declaration
+         * @name - remove(const TKey& key)
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @purpose - removes the element under key from this map only. It
+         *       stays in any other container it belongs to.
+         * @return - true if there was an element under key
+         */
+        bool remove(const TKey& key)
+        {
+            base_node ** found = find_slot(key, hash_of(key));
+
+            if(found == nullptr)
+                return false;
+
+            unlink(GET_HOOK((*found), this));
+            return true;
+        }
+
+        /**
+         * Function Declaration
+         * @name - erase(iterator position)
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @purpose - removes the element at position from this map only
+         * @return - an iterator to the element after it
+         */
+        iterator erase(iterator position)
+        {
+            if(position.m_slot == nullptr)
+                throw std::out_of_range("Iterator out of range.");
+
+            iterator next = position;
+            ++next;
+
+            unlink(GET_HOOK((*position.m_slot), this));
+
+            return next;
+        }
+
+        /**
+         * Function Declaration
+         * @name - clear()
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @purpose - unlinks every element and frees the tables
+         */
+        void clear()
+        {
+            for(base_node ** slot = next_full(first_slot()); slot != nullptr; slot = next_full(slot + 1))
+                GET_HOOK((*slot), this)->m_slot = nullptr;
+
+            m_Table = table();
+            m_Old = table();
+            m_Next = table();
+            m_Cursor = 0;
+            m_Ready = 0;
+            m_Size = 0;
+        }
+
+        /**
+         * Function Declaration
+         * @name - reserve(long count)
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @purpose - makes room for count elements up front, moving every
+         *       element at once if the table has to grow. Inserting up to
+         *       count elements after that never grows the table.
+         */
+        void reserve(long count)
+        {
+            if(std::size_t(count) * 8 <= m_Table.capacity * 7)
+                return;
+
+            migrate(m_Old.capacity);
+            grow(std::size_t(count) * 2);
+            prepare(m_Next.capacity);
+            migrate(m_Old.capacity);
+        }
+
+        iterator begin()
+        {
+            return iterator(this, next_full(first_slot()));
+        }
+
+        iterator end()
+        {
+            return iterator(this, nullptr);
+        }
+
+        /**
+         * Function Declaration
+         * @name - find(const TKey& key)
+         * @scope - template<class TKey, class T, class THash> intrusive::hash_map<TKey, T, THash>
+         * @return - an iterator to the element under key, or end()
+         */
+        iterator find(const TKey& key)
+        {
+            return iterator(this, find_slot(key, hash_of(key)));
+        }
+
+        long count(const TKey& key)
+        {
+            return find_slot(key, hash_of(key)) != nullptr ? 1 : 0;
+        }
+
+    private:
+        // std::hash is the identity for integers and pointers in some
+        // standard libraries, so the bits are mixed before they are split
+        // into the group index and the control byte
+        static std::size_t hash_of(const TKey& key)
+        {
+            std::uint64_t bits = std::uint64_t(THash()(key));
+
+            bits ^= bits >> 33;
+            bits *= 0xff51afd7ed558ccdULL;
+            bits ^= bits >> 33;
+
+            return std::size_t(bits);
+        }
+
+        static signed char control_of(std::size_t hash)
+        {
+            return static_cast<signed char>(hash & 0x7F);
+        }
+
+        static unsigned int lowest_bit(unsigned int bits)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, bits);
+
+            return (unsigned int)index;
+#elif defined(__GNUC__)
+            return (unsigned int)__builtin_ctz(bits);
+#else
+            unsigned int index = 0;
+
+            while((bits & 1) == 0)
+            {
+                bits >>= 1;
+                ++index;
+            }
+
+            return index;
+#endif
+        }
+
+        // a bit per control byte of the group equal to control
+        static unsigned int match(const signed char * group, signed char control)
+        {
+#ifdef INTRUSIVE_SSE
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+
+            return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(control)));
+#else
+            unsigned int bits = 0;
+
+            for(std::size_t i = 0; i < GROUP; ++i)
+                if(group[i] == control)
+                    bits |= 1u << i;
+
+            return bits;
+#endif
+        }
+
+        // a bit per control byte of the group that is empty or deleted
+        static unsigned int match_free(const signed char * group)
+        {
+#ifdef INTRUSIVE_SSE
+            return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group)));
+#else
+            unsigned int bits = 0;
+
+            for(std::size_t i = 0; i < GROUP; ++i)
+                if(group[i] < 0)
+                    bits |= 1u << i;
+
+            return bits;
+#endif
+        }
+
+        // groups are visited in triangular steps, which reaches every group
+        // of a power of two count before coming back around
+        base_node ** probe(table & where, const TKey& key, std::size_t hash)
+        {
+            if(where.capacity == 0)
+                return nullptr;
+
+            std::size_t mask = where.capacity / GROUP - 1;
+            std::size_t group = (hash >> 7) & mask;
+            signed char control = control_of(hash);
+
+            for(std::size_t step = 1; step <= mask + 1; ++step)
+            {
+                const signed char * controls = where.ctrl.get() + group * GROUP;
+
+                for(unsigned int bits = match(controls, control); bits != 0; bits &= bits - 1)
+                {
+                    base_node ** slot = where.slots.get() + group * GROUP + lowest_bit(bits);
+                    hook * slotHook = GET_HOOK((*slot), this);
+
+                    if(slotHook->m_hash == hash && slotHook->m_key == key)
+                        return slot;
+                }
+
+                // the key would have gone in the first empty slot on its way
+                if(match(controls, EMPTY) != 0)
+                    return nullptr;
+
+                group = (group + step) & mask;
+            }
+
+            return nullptr;
+        }
+
+        base_node ** find_slot(const TKey& key, std::size_t hash)
+        {
+            base_node ** found = probe(m_Table, key, hash);
+
+            if(found == nullptr && m_Old.capacity != 0)
+                found = probe(m_Old, key, hash);
+
+            return found;
+        }
+
+        // the first free slot on the way of hash. the table must have one
+        base_node ** place(table & where, std::size_t hash, base_node * val)
+        {
+            std::size_t mask = where.capacity / GROUP - 1;
+            std::size_t group = (hash >> 7) & mask;
+
+            for(std::size_t step = 1; ; ++step)
+            {
+                unsigned int bits = match_free(where.ctrl.get() + group * GROUP);
+
+                if(bits != 0)
+                {
+                    std::size_t index = group * GROUP + lowest_bit(bits);
+
+                    if(where.ctrl[index] == EMPTY)
+                        ++where.used;
+
+                    where.ctrl[index] = control_of(hash);
+                    where.slots[index] = val;
+
+                    return where.slots.get() + index;
+                }
+
+                group = (group + step) & mask;
+            }
+        }
+
+        void unlink(hook * valHook)
+        {
+            base_node ** slot = valHook->m_slot;
+            table & where = m_Old.owns(slot) ? m_Old : m_Table;
+
+            where.ctrl[slot - where.slots.get()] = DELETED;
+            *slot = nullptr;
+
+            valHook->m_slot = nullptr;
+            --m_Size;
+        }
+
+        // allocates the next table, to hold count elements at less than
+        // half its load limit so it cannot fill up before the old table is
+        // moved over. never less than half the old size for the same
+        // reason. it is left uncleared, see prepare()
+        void grow(std::size_t count)
+        {
+            std::size_t capacity = GROUP;
+
+            while(capacity * 7 < count * 16 || capacity * 2 < m_Table.capacity)
+                capacity *= 2;
+
+            m_Next = table();
+            m_Next.capacity = capacity;
+            m_Next.ctrl.reset(new signed char[capacity]);
+            m_Next.slots.reset(new base_node*[capacity]);
+            m_Ready = 0;
+        }
+
+        // clears the next count slots of the next table. once it is all
+        // clear it takes over, and the current table becomes the old one
+        void prepare(std::size_t count)
+        {
+            if(m_Next.capacity == 0)
+                return;
+
+            for(; count > 0 && m_Ready < m_Next.capacity; --count, ++m_Ready)
+            {
+                m_Next.ctrl[m_Ready] = EMPTY;
+                m_Next.slots[m_Ready] = nullptr;
+            }
+
+            if(m_Ready < m_Next.capacity)
+                return;
+
+            if(m_Size > 0)
+                m_Old = std::move(m_Table);
+
+            m_Table = std::move(m_Next);
+            m_Next = table();
+            m_Cursor = 0;
+            m_Ready = 0;
+        }
+
+        // moves the next count slots of the old table to the new one, and
+        // frees the old table once it is done
+        void migrate(std::size_t count)
+        {
+            if(m_Old.capacity == 0)
+                return;
+
+            for(; count > 0 && m_Cursor < m_Old.capacity; --count, ++m_Cursor)
+            {
+                base_node * val = m_Old.slots[m_Cursor];
+
+                if(val == nullptr)
+                    continue;
+
+                hook * valHook = GET_HOOK(val, this);
+
+                m_Old.ctrl[m_Cursor] = DELETED;
+                m_Old.slots[m_Cursor] = nullptr;
+                valHook->m_slot = place(m_Table, valHook->m_hash, val);
+            }
+
+            if(m_Cursor == m_Old.capacity)
+            {
+                m_Old = table();
+                m_Cursor = 0;
+            }
+        }
+
+        // the old table comes first in iteration, then the new one
+        base_node ** first_slot()
+        {
+            return m_Old.capacity != 0 ? m_Old.slots.get() : m_Table.slots.get();
+        }
+
+        // the first full slot at or after slot, or null past the last one
+        base_node ** next_full(base_node ** slot)
+        {
+            if(slot == nullptr)
+                return nullptr;
+
+            if(m_Old.capacity != 0 && slot >= m_Old.slots.get() && slot <= m_Old.slots.get() + m_Old.capacity)
+            {
+                for(base_node ** last = m_Old.slots.get() + m_Old.capacity; slot != last; ++slot)
+                    if(*slot != nullptr)
+                        return slot;
+
+                slot = m_Table.slots.get();
+            }
+
+            if(slot == nullptr)
+                return nullptr;
+
+            for(base_node ** last = m_Table.slots.get() + m_Table.capacity; slot != last; ++slot)
+                if(*slot != nullptr)
+                    return slot;
+
+            return nullptr;
+        }
+
+    private:
+        table m_Table;
+        // the table being moved out of while growing, empty otherwise
+        table m_Old;
+        // the table being cleared to take over from m_Table, empty
+        // otherwise. it holds no elements until it does
+        table m_Next;
+        // next slot of the old table to move
+        std::size_t m_Cursor;
+        // slots of the next table cleared so far
+        std::size_t m_Ready;
+        std::size_t m_Size;
+    };
+}
+#endif
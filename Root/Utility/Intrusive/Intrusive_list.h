@@ -462,6 +462,19 @@ namespace intrusive
             return new hook;
         }
 
+        /**
+         * Function Declaration
+         * @name - create_hook_in(void*& where, std::size_t& space)
+         * @scope - template<class T> intrusive::list<T>
+         * @purpose - builds the hook object defined in this container in the
+         *       space given by the node, @see base_container
+         * @return - the new hook, or nullptr if it does not fit
+         */
+        base_hook* create_hook_in(void*& where, std::size_t& space)
+        {
+            return emplace_hook<hook>(where, space);
+        }
+
         /**
          * Function Declaration
          * @name - is_empty() const
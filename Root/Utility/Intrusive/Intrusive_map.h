@@ -2,7 +2,7 @@
  * @Programmer - Rook
  * @File - Intrusive_map.h
  * @Date - 8/22/2013
- * @Purpose - This file container the intrusive binary search tree map
+ * @Purpose - This file container the intrusive red-black tree map
  *       implementation to be used along side the nodes declared in
  *       Intrusive.h
  *
@@ -12,15 +12,18 @@
  *
  *       The hook is implemented to utilize three pointers, one that points
  *       to the left subtree, the right subtree, and the parent of this
- *       element. The terminators are setup so that the begin_terminator is
- *       located at the far left leaf of the tree, and the far right. There
- *       is also a root terminator that is used to access the top of the tree.
- *       the parent pointer of the root node points to the first element in the
- *       tree, the begin_terminator's parent pointer points to the first node
- *       in in-order traversal, and the end_terminator's parent pointer points
- *       to the last element in in-order traversal. Using these terminators,
- *       you can create iterators, and traverse the whole map, and you can use
- *       the root terminator for insertion, deletion, finding, etc.
+ *       element, plus the key and the color of the element. Empty subtrees
+ *       are null. The tree is kept red-black, so it is never more than twice
+ *       as deep as it would be perfectly balanced, and insert, remove and
+ *       find stay O(log n) no matter the order the keys come in.
+ *
+ *       There are three terminators. The root terminator is the parent of
+ *       the top element, its parent pointer points to the top element, and
+ *       its left and right pointers point to the begin and end terminators.
+ *       The begin_terminator's right pointer points to the first element in
+ *       in-order traversal and the end_terminator's left pointer points to
+ *       the last, so iterators can walk off either end onto a terminator and
+ *       back, and begin() and rbegin() are O(1).
  *
  *       For an object to be used in this container, all an object needs to do
  *       is inherit from one of the node objects declared in Intrusive.h
@@ -32,13 +35,23 @@
 #define INTRUSIVE_MAP_H
 
 #include "Intrusive.h"
-#include <iostream>
+#include <utility>
 
 namespace intrusive
 {
     /**************************************************************************
+     * Class Declaration
+     *
+     * @name - template<class TKey, class T> map
+     *
+     * @scope - intrusive
+     *
+     * @inherits - intrusive::base_container            @see Intrusive.h
+     *
+     * @desc - an ordered map of unique keys to nodes, kept as a red-black
+     *       tree. Keys are compared with operator< only.
      *
-     */
+     *************************************************************************/
     template<class TKey, class T>
     class map :
         public base_container
@@ -48,140 +61,32 @@ namespace intrusive
             public base_hook
         {
         public:
+            hook() :
+                m_parent(nullptr),
+                m_left(nullptr),
+                m_right(nullptr),
+                m_red(false)
+                {}
+
+            /**
+             * Function Declaration
+             * @name - unhook(base_container* mapptr)
+             * @scope - template<class TKey, class T> intrusive::map<TKey, T>::hook
+             * @purpose - removes the element owning this hook from the map and
+             *       rebalances the tree. Does nothing if the element was
+             *       already removed, so the map may be gone by then.
+             */
             void unhook(base_container* mapptr)
             {
-                base_node * swap = nullptr;
-                hook * swapHook = nullptr;
-                hook * parentHook = nullptr;
-                hook * leftHook = nullptr;
-                hook * rightHook = nullptr;
-
-                if(m_left != nullptr && m_right != nullptr)
-                {
-                    if(!m_left->is_terminal_begin())
-                    {
-
-                        swap = m_left;
-                        swapHook = GET_HOOK(swap, mapptr);
-
-                        while(swapHook->m_right != nullptr)
-                        {
-                            swap = swapHook->m_right;
-                            swapHook = GET_HOOK(swap, mapptr);
-                        }
-
-                        if(swap != m_left)
-                        {
-                            parentHook = GET_HOOK(swapHook->m_parent, mapptr);
-                            parentHook->m_right = swapHook->m_left;
-                        }
-                    }
-                    else if(!m_right->is_terminal_end())
-                    {
-
-                        swap = m_right;
-                        swapHook = GET_HOOK(swap, mapptr);
-
-                        while(swapHook->m_left != nullptr)
-                        {
-                            swap = swapHook->m_left;
-                            swapHook = GET_HOOK(swap, mapptr);
-                        }
-
-                        if(swap != m_right)
-                        {
-                            parentHook = GET_HOOK(swapHook->m_parent, mapptr);
-                            parentHook->m_left = swapHook->m_right;
-                        }
-                    }
-
-                    if(swap != nullptr)
-                    {
-                        swapHook->m_parent = m_parent;
-
-                        if(swap != m_left)
-                            swapHook->m_left = m_left;
-
-                        if(swap != m_right)
-                            swapHook->m_right = m_right;
-
-                        parentHook = GET_HOOK(m_parent, mapptr);
-
-                        if(m_parent->is_terminal())
-                            parentHook->m_parent = swap;
-                        else
-                        {
-                            if(parentHook->m_left != nullptr && GET_HOOK(parentHook->m_left, mapptr) == this)
-                                parentHook->m_left = swap;
-                            else
-                                parentHook->m_right = swap;
-                        }
-
-                        if(m_left != nullptr && m_left != swap)
-                        {
-                            leftHook = GET_HOOK(m_left, mapptr);
-                            leftHook->m_parent = swap;
-                        }
-
-                        if(m_right != nullptr && m_right != swap)
-                        {
-                            rightHook = GET_HOOK(m_right, mapptr);
-                            rightHook->m_parent = swap;
-                        }
-                    }
-                    else
-                    {
-                           parentHook = GET_HOOK(m_parent, mapptr);
-                           leftHook = GET_HOOK(m_left, mapptr);
-                           rightHook = GET_HOOK(m_right, mapptr);
-
-                           parentHook->m_parent = m_right;
-                           rightHook->m_parent = m_parent;
-                           rightHook->m_left = m_left;
-                           leftHook->m_parent = m_right;
-                    }
-                }
-                else if(m_left != nullptr)
-                {
-                    parentHook = GET_HOOK(m_parent, mapptr);
-                    leftHook = GET_HOOK(m_left, mapptr);
-
-
-                    if(parentHook->m_left != nullptr && GET_HOOK(parentHook->m_left, mapptr) == this)
-                        parentHook->m_left = m_left;
-                    else
-                        parentHook->m_right = m_left;
-
-                    leftHook->m_parent = m_parent;
-                }
-                else if(m_right != nullptr)
-                {
-                    parentHook = GET_HOOK(m_parent, mapptr);
-                    rightHook = GET_HOOK(m_right, mapptr);
-
-                    if(parentHook->m_left != nullptr && GET_HOOK(parentHook->m_left, mapptr) == this)
-                        parentHook->m_left = m_right;
-                    else
-                        parentHook->m_right = m_right;
-
-                    rightHook->m_parent = m_parent;
-                }
-                else
-                {
-                    parentHook = GET_HOOK(m_parent, mapptr);
-
-                    if(GET_HOOK(parentHook->m_left, mapptr) == this)
-                        parentHook->m_left = nullptr;
-                    else
-                        parentHook->m_right = nullptr;
-                }
-
+                if(m_parent != nullptr)
+                    static_cast<map*>(mapptr)->unlink(static_cast<map*>(mapptr)->node_of(this));
             }
 
             TKey m_key;
             base_node * m_parent;
             base_node * m_left;
             base_node * m_right;
+            bool m_red;
         };
 
         class iterator
@@ -208,37 +113,46 @@ namespace intrusive
                 return *static_cast<T*>(m_current);
             }
 
+            const TKey& key() const
+            {
+                if(m_current->is_terminal())
+                    throw std::out_of_range("Iterator out of range.");
+
+                return GET_HOOK(m_current, m_mapptr)->m_key;
+            }
+
             iterator& operator++()
             {
-                if(!m_current->is_terminal_end())
+                if(m_current->is_terminal_end())
+                    return *this;
+
+                hook * current_hook = GET_HOOK(m_current, m_mapptr);
+
+                if(m_current->is_terminal_begin())
+                    m_current = current_hook->m_right;
+                else if(current_hook->m_right != nullptr)
                 {
-                    hook * current_hook = GET_HOOK(m_current, m_mapptr);
+                    m_current = current_hook->m_right;
+                    current_hook = GET_HOOK(m_current, m_mapptr);
 
-                    if(current_hook->m_right != nullptr)
+                    while(current_hook->m_left != nullptr)
                     {
-
-                        m_current = current_hook->m_right;
+                        m_current = current_hook->m_left;
                         current_hook = GET_HOOK(m_current, m_mapptr);
-
-                        while(current_hook->m_left != nullptr)
-                        {
-                            m_current = current_hook->m_left;
-                            current_hook = GET_HOOK(m_current, m_mapptr);
-                        }
                     }
-                    else
-                    {
-                        hook * parent_hook = GET_HOOK(current_hook->m_parent, m_mapptr);
-
-                        while(m_current != parent_hook->m_left)
-                        {
-                            m_current = current_hook->m_parent;
-                            current_hook = GET_HOOK(m_current, m_mapptr);
-                            parent_hook = GET_HOOK(current_hook->m_parent, m_mapptr);
-                        }
+                }
+                else
+                {
+                    base_node * parent = current_hook->m_parent;
 
-                        m_current = current_hook->m_parent;
+                    while(!parent->is_terminal() && GET_HOOK(parent, m_mapptr)->m_right == m_current)
+                    {
+                        m_current = parent;
+                        parent = GET_HOOK(parent, m_mapptr)->m_parent;
                     }
+
+                    // climbing out of the top lands on the end terminator
+                    m_current = parent->is_terminal() ? GET_HOOK(parent, m_mapptr)->m_right : parent;
                 }
 
                 return *this;
@@ -253,40 +167,42 @@ namespace intrusive
 
             iterator& operator--()
             {
-                if(!m_current->is_terminal_begin())
+                if(m_current->is_terminal_begin())
+                    return *this;
+
+                hook * current_hook = GET_HOOK(m_current, m_mapptr);
+
+                if(m_current->is_terminal_end())
+                    m_current = current_hook->m_left;
+                else if(current_hook->m_left != nullptr)
                 {
-                    hook * current_hook = GET_HOOK(m_current, m_mapptr);
+                    m_current = current_hook->m_left;
+                    current_hook = GET_HOOK(m_current, m_mapptr);
 
-                    if(current_hook->m_left != nullptr)
+                    while(current_hook->m_right != nullptr)
                     {
-                        m_current = current_hook->m_left;
+                        m_current = current_hook->m_right;
                         current_hook = GET_HOOK(m_current, m_mapptr);
-
-                        while(current_hook->m_right != nullptr)
-                        {
-                            m_current = current_hook->m_right;
-                            current_hook = GET_HOOK(m_current, m_mapptr);
-                        }
                     }
-                    else
-                    {
-                        hook * parent_hook = GET_HOOK(current_hook->m_parent, m_mapptr);
-
-                        while(m_current != parent_hook->m_right)
-                        {
-                            m_current = current_hook->m_parent;
-                            current_hook = GET_HOOK(m_current, m_mapptr);
-                            parent_hook = GET_HOOK(current_hook->m_parent, m_mapptr);
-                        }
+                }
+                else
+                {
+                    base_node * parent = current_hook->m_parent;
 
-                        m_current = current_hook->m_parent;
+                    while(!parent->is_terminal() && GET_HOOK(parent, m_mapptr)->m_left == m_current)
+                    {
+                        m_current = parent;
+                        parent = GET_HOOK(parent, m_mapptr)->m_parent;
                     }
+
+                    // climbing out of the top lands on the begin terminator
+                    m_current = parent->is_terminal() ? GET_HOOK(parent, m_mapptr)->m_left : parent;
                 }
 
                 return *this;
             }
 
-            iterator& operator--(int)
+            iterator operator--(int)
             {
                 iterator temp(*this);
                 --*this;
@@ -297,6 +213,8 @@ namespace intrusive
             bool operator!=(const iterator& x) const {return m_current != x.m_current;}
 
         private:
+            friend class map;
+
             base_container * m_mapptr;
             base_node * m_current;
         };
@@ -338,6 +256,9 @@ namespace intrusive
             bool is_terminal_end() const {return true;}
         };
 
+        // the parent of the top element. the begin and end terminators
+        // never have children, so it is the only terminator an iterator
+        // can climb onto
         class root_terminator final :
             public terminator
         {
@@ -348,27 +269,27 @@ namespace intrusive
         };
 
     public:
-        map()
+        map() :
+            m_Size(0)
         {
-            m_Root.attach(this);
-            m_Begin.attach(this);
-            m_End.attach(this);
-
             hook * rootHook = GET_HOOK((&m_Root), this);
-            hook * beginHook = GET_HOOK((&m_Begin), this);
-            hook * endHook = GET_HOOK((&m_End), this);
 
-            rootHook->m_parent = &m_End;
-            rootHook->m_left = nullptr;
-            rootHook->m_right = nullptr;
+            rootHook->m_left = &m_Begin;
+            rootHook->m_right = &m_End;
 
-            endHook->m_parent = &m_Root;
-            endHook->m_left = &m_Begin;
-            endHook->m_right = nullptr;
+            reset_ends();
+        }
 
-            beginHook->m_parent = &m_End;
-            beginHook->m_left = nullptr;
-            beginHook->m_right = nullptr;
+        /**
+         * Function Declaration
+         * @name - ~map()
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @purpose - unlinks every element, so elements outliving the map
+         *       do not reach back into it when they are destroyed
+         */
+        ~map()
+        {
+            clear();
         }
 
         base_hook * create_hook()
@@ -376,59 +297,183 @@ namespace intrusive
             return new hook;
         }
 
-        bool is_empty()
+        base_hook * create_hook_in(void*& where, std::size_t& space)
         {
-            hook * rootHook = GET_HOOK( (&m_Root), this);
+            return emplace_hook<hook>(where, space);
+        }
 
-            return (rootHook->m_parent == &m_End)?true:false;
+        bool is_empty() const
+        {
+            return m_Size == 0;
         }
 
-        void insert(TKey key, base_node & val)
+        long size() const
         {
-            hook * rootHook = GET_HOOK((&m_Root), this);
+            return m_Size;
+        }
 
-            base_node * topNode = rootHook->m_parent;
+        /**
+         * Function Declaration
+         * @name - insert(const TKey& key, base_node& val)
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @purpose - attaches val to this map under key
+         * @pre - val must not be in this map already
+         * @return - an iterator to val and true, or if key is taken, an
+         *       iterator to the element holding it and false. val is left
+         *       alone in that case.
+         */
+        std::pair<iterator, bool> insert(const TKey& key, base_node & val)
+        {
+            base_node * parent = nullptr;
+            base_node * current = root();
+            bool left = true;
 
-            val.attach(this);
+            while(current != nullptr)
+            {
+                hook * currentHook = GET_HOOK(current, this);
+
+                parent = current;
+
+                if(key < currentHook->m_key)
+                {
+                    current = currentHook->m_left;
+                    left = true;
+                }
+                else if(currentHook->m_key < key)
+                {
+                    current = currentHook->m_right;
+                    left = false;
+                }
+                else
+                    return std::make_pair(iterator(this, current), false);
+            }
 
-            if(topNode == &m_End)
+            link(key, val, parent, left);
+
+            return std::make_pair(iterator(this, &val), true);
+        }
+
+        /**
+         * Function Declaration
+         * @name - template<class TIterator> insert_sorted(TIterator first, TIterator last)
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @purpose - inserts a run of elements, given as pairs of a key and a
+         *       pointer to the node, like std::pair<TKey, T*>. Elements with
+         *       a key past the last in the map are linked straight onto the
+         *       end without searching the tree, so loading a sorted run costs
+         *       amortized O(1) per element. Anything else goes through
+         *       insert(), so unsorted runs and taken keys are still handled.
+         * @return - the number of elements inserted
+         */
+        template<class TIterator>
+        long insert_sorted(TIterator first, TIterator last)
+        {
+            long inserted = 0;
+
+            for(; first != last; ++first)
             {
-                hook * valHook = GET_HOOK((&val), this);
-                valHook->m_parent = &m_Root;
-                valHook->m_left = &m_Begin;
-                valHook->m_right = &m_End;
-                valHook->m_key = key;
-
-                rootHook->m_parent = &val;
-                GET_HOOK((&m_Begin), this)->m_parent = &val;
-                GET_HOOK((&m_End), this)->m_parent = &val;
-                GET_HOOK((&m_End), this)->m_left = nullptr;
+                base_node * back = GET_HOOK((&m_End), this)->m_left;
+
+                if(m_Size > 0 && GET_HOOK(back, this)->m_key < first->first)
+                {
+                    link(first->first, *first->second, back, false);
+                    ++inserted;
+                }
+                else if(insert(first->first, *first->second).second)
+                    ++inserted;
             }
-            else
-                insert(key, &val, topNode);
+
+            return inserted;
         }
 
-        void remove(TKey key)
+        /**
+         * Function Declaration
+         * @name - remove(const TKey& key)
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @purpose - removes the element under key from this map only. It
+         *       stays in any other container it belongs to.
+         * @return - true if there was an element under key
+         */
+        bool remove(const TKey& key)
         {
-            hook * rootHook = GET_HOOK( (&m_Root), this);
+            iterator it = find(key);
 
-            base_node * currentNode = rootHook->m_parent;
+            if(it == end())
+                return false;
 
-            if(currentNode != &m_End)
-                remove(key, currentNode);
+            erase(it);
+            return true;
         }
 
+        /**
+         * Function Declaration
+         * @name - erase(iterator position)
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @purpose - removes the element at position from this map only
+         * @pre - position must point to an element of this map
+         * @return - an iterator to the element after it
+         */
+        iterator erase(iterator position)
+        {
+            if(position.m_current->is_terminal())
+                throw std::out_of_range("Iterator out of range.");
+
+            iterator next = position;
+            ++next;
+
+            unlink(position.m_current);
+
+            return next;
+        }
 
-        long size()
+        /**
+         * Function Declaration
+         * @name - clear()
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @purpose - unlinks every element in O(n), leaving them in any
+         *       other containers they belong to
+         */
+        void clear()
         {
-            return 0;
+            base_node * current = root();
+
+            // post-order, so every element is unlinked after its children
+            while(current != nullptr)
+            {
+                hook * currentHook = GET_HOOK(current, this);
+
+                if(currentHook->m_left != nullptr)
+                    current = currentHook->m_left;
+                else if(currentHook->m_right != nullptr)
+                    current = currentHook->m_right;
+                else
+                {
+                    base_node * parent = currentHook->m_parent;
+
+                    currentHook->m_parent = nullptr;
+
+                    if(parent == &m_Root)
+                        break;
+
+                    hook * parentHook = GET_HOOK(parent, this);
+
+                    if(parentHook->m_left == current)
+                        parentHook->m_left = nullptr;
+                    else
+                        parentHook->m_right = nullptr;
+
+                    current = parent;
+                }
+            }
+
+            GET_HOOK((&m_Root), this)->m_parent = nullptr;
+            m_Size = 0;
+            reset_ends();
         }
 
         iterator begin()
         {
-            hook * first = GET_HOOK( (&m_Begin), this);
-
-            return iterator(this, first->m_parent);
+            return iterator(this, GET_HOOK((&m_Begin), this)->m_right);
         }
 
         iterator end()
@@ -436,136 +481,451 @@ namespace intrusive
             return iterator(this, &m_End);
         }
 
-        iterator find(TKey key)
+        // the last element. walking backwards from it with -- ends on rend()
+        iterator rbegin()
         {
+            return iterator(this, GET_HOOK((&m_End), this)->m_left);
+        }
 
+        iterator rend()
+        {
+            return iterator(this, &m_Begin);
         }
 
-        void print()
+        /**
+         * Function Declaration
+         * @name - find(const TKey& key)
+         * @scope - template<class TKey, class T> intrusive::map<TKey, T>
+         * @return - an iterator to the element under key, or end()
+         */
+        iterator find(const TKey& key)
         {
-            hook * rootHook = GET_HOOK( (&m_Root), this);
+            base_node * found = lower(key);
 
-            base_node * topNode = rootHook->m_parent;
+            if(found != &m_End && !(key < GET_HOOK(found, this)->m_key))
+                return iterator(this, found);
 
-            int level = 0;
-            print(topNode, level);
+            return end();
         }
 
-    private:
+        // the first element whose key is not less than key, or end()
+        iterator lower_bound(const TKey& key)
+        {
+            return iterator(this, lower(key));
+        }
 
-        void print(base_node * current, int & height)
+        // the first element whose key is greater than key, or end()
+        iterator upper_bound(const TKey& key)
         {
-            hook * currentHook = GET_HOOK(current, this);
+            base_node * current = root();
+            base_node * result = &m_End;
 
-            if(currentHook->m_right != nullptr)
+            while(current != nullptr)
             {
-                print(currentHook->m_right, ++height);
+                hook * currentHook = GET_HOOK(current, this);
+
+                if(key < currentHook->m_key)
+                {
+                    result = current;
+                    current = currentHook->m_left;
+                }
+                else
+                    current = currentHook->m_right;
             }
 
-            for(int i = 0; i < height; i++)
+            return iterator(this, result);
+        }
+
+        // the elements under key, which is one at most since keys are unique
+        std::pair<iterator, iterator> equal_range(const TKey& key)
+        {
+            iterator first = find(key);
+
+            if(first == end())
+                return std::make_pair(first, first);
+
+            iterator last = first;
+            ++last;
+
+            return std::make_pair(first, last);
+        }
+
+    private:
+        base_node * root()
+        {
+            return GET_HOOK((&m_Root), this)->m_parent;
+        }
+
+        bool is_red(base_node * current)
+        {
+            return current != nullptr && GET_HOOK(current, this)->m_red;
+        }
+
+        // an empty map runs straight from one terminator to the other
+        void reset_ends()
+        {
+            GET_HOOK((&m_Begin), this)->m_right = &m_End;
+            GET_HOOK((&m_End), this)->m_left = &m_Begin;
+        }
+
+        base_node * lower(const TKey& key)
+        {
+            base_node * current = root();
+            base_node * result = &m_End;
+
+            while(current != nullptr)
             {
-                std::cout << "     ";
+                hook * currentHook = GET_HOOK(current, this);
+
+                if(!(currentHook->m_key < key))
+                {
+                    result = current;
+                    current = currentHook->m_left;
+                }
+                else
+                    current = currentHook->m_right;
             }
 
-            if(current->is_terminal_begin())
-                std::cout << "B";
-            else if(current->is_terminal_end())
-                std::cout << "E";
+            return result;
+        }
+
+        // the element a linked hook belongs to, found through its parent
+        base_node * node_of(hook * elementHook)
+        {
+            if(elementHook->m_parent == &m_Root)
+                return root();
+
+            hook * parentHook = GET_HOOK(elementHook->m_parent, this);
+
+            if(parentHook->m_left != nullptr && GET_HOOK(parentHook->m_left, this) == elementHook)
+                return parentHook->m_left;
+
+            return parentHook->m_right;
+        }
+
+        // puts replacement where current hangs off parent
+        void replace_child(base_node * parent, base_node * current, base_node * replacement)
+        {
+            if(parent == &m_Root)
+                GET_HOOK((&m_Root), this)->m_parent = replacement;
+            else if(GET_HOOK(parent, this)->m_left == current)
+                GET_HOOK(parent, this)->m_left = replacement;
             else
-                std::cout << static_cast<T *>(current)->m_meh << std::endl;
+                GET_HOOK(parent, this)->m_right = replacement;
+        }
 
-            std::cout << "\n";
+        void rotate_left(base_node * current)
+        {
+            hook * currentHook = GET_HOOK(current, this);
+            base_node * pivot = currentHook->m_right;
+            hook * pivotHook = GET_HOOK(pivot, this);
 
-            if(currentHook->m_left != nullptr)
-            {
-                print(currentHook->m_left, ++height);
-            }
-            height--;
+            currentHook->m_right = pivotHook->m_left;
+
+            if(pivotHook->m_left != nullptr)
+                GET_HOOK(pivotHook->m_left, this)->m_parent = current;
+
+            pivotHook->m_parent = currentHook->m_parent;
+            replace_child(currentHook->m_parent, current, pivot);
+
+            pivotHook->m_left = current;
+            currentHook->m_parent = pivot;
         }
 
-        void insert(TKey &key, base_node * insertNode, base_node * current)
+        void rotate_right(base_node * current)
         {
-            hook* currentHook = GET_HOOK(current, this);
+            hook * currentHook = GET_HOOK(current, this);
+            base_node * pivot = currentHook->m_left;
+            hook * pivotHook = GET_HOOK(pivot, this);
 
-            if(key < currentHook->m_key)
+            currentHook->m_left = pivotHook->m_right;
+
+            if(pivotHook->m_right != nullptr)
+                GET_HOOK(pivotHook->m_right, this)->m_parent = current;
+
+            pivotHook->m_parent = currentHook->m_parent;
+            replace_child(currentHook->m_parent, current, pivot);
+
+            pivotHook->m_right = current;
+            currentHook->m_parent = pivot;
+        }
+
+        // hangs val off parent, or makes it the top if parent is null, and
+        // rebalances
+        void link(const TKey& key, base_node & val, base_node * parent, bool left)
+        {
+            val.attach(this);
+
+            hook * valHook = GET_HOOK((&val), this);
+            hook * beginHook = GET_HOOK((&m_Begin), this);
+            hook * endHook = GET_HOOK((&m_End), this);
+
+            valHook->m_key = key;
+            valHook->m_left = nullptr;
+            valHook->m_right = nullptr;
+            valHook->m_red = true;
+
+            if(parent == nullptr)
             {
-                if(currentHook->m_left != nullptr && !currentHook->m_left->is_terminal())
-                    insert(key, insertNode, currentHook->m_left);
+                valHook->m_parent = &m_Root;
+                GET_HOOK((&m_Root), this)->m_parent = &val;
+            }
+            else
+            {
+                valHook->m_parent = parent;
+
+                if(left)
+                    GET_HOOK(parent, this)->m_left = &val;
                 else
+                    GET_HOOK(parent, this)->m_right = &val;
+            }
+
+            if(m_Size == 0)
+            {
+                beginHook->m_right = &val;
+                endHook->m_left = &val;
+            }
+            else if(left && parent == beginHook->m_right)
+                beginHook->m_right = &val;
+            else if(!left && parent == endHook->m_left)
+                endHook->m_left = &val;
+
+            ++m_Size;
+            insert_fixup(&val);
+        }
+
+        void insert_fixup(base_node * current)
+        {
+            // the top is black, so a red parent always has a parent of its own
+            while(is_red(GET_HOOK(current, this)->m_parent))
+            {
+                base_node * parent = GET_HOOK(current, this)->m_parent;
+                base_node * grandparent = GET_HOOK(parent, this)->m_parent;
+                hook * grandparentHook = GET_HOOK(grandparent, this);
+
+                if(parent == grandparentHook->m_left)
                 {
-                    hook * insertHook = GET_HOOK(insertNode, this);
-                    hook * leftHook;
+                    base_node * uncle = grandparentHook->m_right;
+
+                    if(is_red(uncle))
+                    {
+                        GET_HOOK(parent, this)->m_red = false;
+                        GET_HOOK(uncle, this)->m_red = false;
+                        grandparentHook->m_red = true;
+                        current = grandparent;
+                    }
+                    else
+                    {
+                        if(current == GET_HOOK(parent, this)->m_right)
+                        {
+                            current = parent;
+                            rotate_left(current);
+                            parent = GET_HOOK(current, this)->m_parent;
+                        }
 
-                    insertHook->m_parent = current;
-                    insertHook->m_left = currentHook->m_left;
-                    insertHook->m_right = nullptr;
-                    insertHook->m_key = key;
+                        GET_HOOK(parent, this)->m_red = false;
+                        grandparentHook->m_red = true;
+                        rotate_right(grandparent);
+                    }
+                }
+                else
+                {
+                    base_node * uncle = grandparentHook->m_left;
 
-                    if(currentHook->m_left != nullptr)
+                    if(is_red(uncle))
                     {
-                           leftHook = GET_HOOK(currentHook->m_left, this);
-                           leftHook->m_parent = insertNode;
+                        GET_HOOK(parent, this)->m_red = false;
+                        GET_HOOK(uncle, this)->m_red = false;
+                        grandparentHook->m_red = true;
+                        current = grandparent;
                     }
+                    else
+                    {
+                        if(current == GET_HOOK(parent, this)->m_left)
+                        {
+                            current = parent;
+                            rotate_right(current);
+                            parent = GET_HOOK(current, this)->m_parent;
+                        }
 
-                    currentHook->m_left = insertNode;
+                        GET_HOOK(parent, this)->m_red = false;
+                        grandparentHook->m_red = true;
+                        rotate_left(grandparent);
+                    }
                 }
             }
-            else if(key > currentHook->m_key)
+
+            GET_HOOK(root(), this)->m_red = false;
+        }
+
+        // takes current out of the tree and rebalances. its hook stays in the
+        // node with a null parent, so a later unhook does nothing and a later
+        // insert reuses it
+        void unlink(base_node * current)
+        {
+            hook * currentHook = GET_HOOK(current, this);
+            hook * beginHook = GET_HOOK((&m_Begin), this);
+            hook * endHook = GET_HOOK((&m_End), this);
+
+            if(beginHook->m_right == current)
+                beginHook->m_right = (++iterator(this, current)).m_current;
+
+            if(endHook->m_left == current)
+                endHook->m_left = (--iterator(this, current)).m_current;
+
+            // the child moving up into the removed spot, and its new parent
+            base_node * child;
+            base_node * childParent;
+            bool removedRed = currentHook->m_red;
+
+            if(currentHook->m_left == nullptr || currentHook->m_right == nullptr)
             {
+                child = currentHook->m_left != nullptr ? currentHook->m_left : currentHook->m_right;
+                childParent = currentHook->m_parent;
 
+                replace_child(currentHook->m_parent, current, child);
 
-                if(currentHook->m_right != nullptr && !currentHook->m_right->is_terminal())
-                    insert(key, insertNode, currentHook->m_right);
-                else
-                {
+                if(child != nullptr)
+                    GET_HOOK(child, this)->m_parent = currentHook->m_parent;
+            }
+            else
+            {
+                // the successor takes the place and color of current, so
+                // the spot really emptied is the one the successor left
+                base_node * successor = currentHook->m_right;
 
-                    hook * insertHook = GET_HOOK(insertNode, this);
-                    hook * rightHook;
+                while(GET_HOOK(successor, this)->m_left != nullptr)
+                    successor = GET_HOOK(successor, this)->m_left;
 
-                    insertHook->m_parent = current;
-                    insertHook->m_left = nullptr;
-                    insertHook->m_right = currentHook->m_right;
-                    insertHook->m_key = key;
+                hook * successorHook = GET_HOOK(successor, this);
 
+                removedRed = successorHook->m_red;
+                child = successorHook->m_right;
 
+                if(successorHook->m_parent == current)
+                    childParent = successor;
+                else
+                {
+                    childParent = successorHook->m_parent;
 
-                    if(currentHook->m_right != nullptr)
-                    {
-                           rightHook = GET_HOOK(currentHook->m_right, this);
-                           rightHook->m_parent = insertNode;
-                    }
+                    GET_HOOK(childParent, this)->m_left = child;
 
-                    currentHook->m_right = insertNode;
+                    if(child != nullptr)
+                        GET_HOOK(child, this)->m_parent = childParent;
+
+                    successorHook->m_right = currentHook->m_right;
+                    GET_HOOK(successorHook->m_right, this)->m_parent = successor;
                 }
+
+                replace_child(currentHook->m_parent, current, successor);
+                successorHook->m_parent = currentHook->m_parent;
+                successorHook->m_left = currentHook->m_left;
+                GET_HOOK(successorHook->m_left, this)->m_parent = successor;
+                successorHook->m_red = currentHook->m_red;
             }
+
+            currentHook->m_parent = nullptr;
+            currentHook->m_left = nullptr;
+            currentHook->m_right = nullptr;
+            --m_Size;
+
+            if(!removedRed)
+                erase_fixup(child, childParent);
         }
 
-        bool remove(TKey & key, base_node * current)
+        void erase_fixup(base_node * current, base_node * parent)
         {
-            if(current != nullptr && !current->is_terminal())
+            while(current != root() && !is_red(current))
             {
-                hook * currentHook = GET_HOOK(current, this);
+                hook * parentHook = GET_HOOK(parent, this);
 
-                if(key < currentHook->m_key)
+                if(current == parentHook->m_left)
                 {
-                    return remove(key, currentHook->m_left);
+                    base_node * sibling = parentHook->m_right;
+
+                    if(is_red(sibling))
+                    {
+                        GET_HOOK(sibling, this)->m_red = false;
+                        parentHook->m_red = true;
+                        rotate_left(parent);
+                        sibling = parentHook->m_right;
+                    }
+
+                    hook * siblingHook = GET_HOOK(sibling, this);
+
+                    if(!is_red(siblingHook->m_left) && !is_red(siblingHook->m_right))
+                    {
+                        siblingHook->m_red = true;
+                        current = parent;
+                        parent = parentHook->m_parent;
+                    }
+                    else
+                    {
+                        if(!is_red(siblingHook->m_right))
+                        {
+                            GET_HOOK(siblingHook->m_left, this)->m_red = false;
+                            siblingHook->m_red = true;
+                            rotate_right(sibling);
+                            sibling = parentHook->m_right;
+                            siblingHook = GET_HOOK(sibling, this);
+                        }
+
+                        siblingHook->m_red = parentHook->m_red;
+                        parentHook->m_red = false;
+                        GET_HOOK(siblingHook->m_right, this)->m_red = false;
+                        rotate_left(parent);
+                        current = root();
+                    }
                 }
-                else if(key > currentHook->m_key)
+                else
                 {
-                    return remove(key, currentHook->m_right);
-                }
+                    base_node * sibling = parentHook->m_left;
+
+                    if(is_red(sibling))
+                    {
+                        GET_HOOK(sibling, this)->m_red = false;
+                        parentHook->m_red = true;
+                        rotate_right(parent);
+                        sibling = parentHook->m_left;
+                    }
+
+                    hook * siblingHook = GET_HOOK(sibling, this);
 
-                current->detach();
-                return true;
+                    if(!is_red(siblingHook->m_left) && !is_red(siblingHook->m_right))
+                    {
+                        siblingHook->m_red = true;
+                        current = parent;
+                        parent = parentHook->m_parent;
+                    }
+                    else
+                    {
+                        if(!is_red(siblingHook->m_left))
+                        {
+                            GET_HOOK(siblingHook->m_right, this)->m_red = false;
+                            siblingHook->m_red = true;
+                            rotate_left(sibling);
+                            sibling = parentHook->m_left;
+                            siblingHook = GET_HOOK(sibling, this);
+                        }
+
+                        siblingHook->m_red = parentHook->m_red;
+                        parentHook->m_red = false;
+                        GET_HOOK(siblingHook->m_left, this)->m_red = false;
+                        rotate_right(parent);
+                        current = root();
+                    }
+                }
             }
 
-            return false;
+            if(current != nullptr)
+                GET_HOOK(current, this)->m_red = false;
         }
 
     private:
         root_terminator m_Root;
         begin_terminator m_Begin;
         end_terminator m_End;
+        long m_Size;
     };
 }
 #endif
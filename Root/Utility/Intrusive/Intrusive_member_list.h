@@ -0,0 +1,298 @@
+/******************************************************************************
+ * @File - Intrusive_member_list.h
+ * @Purpose - This file contains a doubly linked intrusive list whose hook is
+ *       a named member of the element, for lists walked in inner loops.
+ *
+ * @Description - The containers in Intrusive_list.h and Intrusive_map.h find
+ *       their hooks through the node: every step asks the node for the hook
+ *       of the container and whether it is a terminator, which is a virtual
+ *       call or two per element. That buys an object the freedom to join
+ *       any container at runtime, and costs a vtable walk per step.
+ *
+ *       A member_list knows its hook at compile time instead. The element
+ *       declares a list_member_hook member per list it can be in, and the
+ *       list is instantiated with a pointer to that member:
+ *
+ *           class Render :
+ *               public node<Render>
+ *           {
+ *           public:
+ *               intrusive::list_member_hook draw_hook;
+ *               intrusive::list_member_hook update_hook;
+ *           };
+ *
+ *           intrusive::member_list<Render, &Render::draw_hook> drawList;
+ *           intrusive::member_list<Render, &Render::update_hook> updateList;
+ *
+ *       The element can be anything with the hook as a data member,
+ *       polymorphic and derived classes included, see member_owner() in
+ *       Intrusive.h.
+ *
+ *       The hooks point straight at each other and the list is a ring
+ *       through a plain hook in the list object that stands in for the
+ *       terminators, so an iterator step is a single load and getting the
+ *       element back is subtracting a constant offset. Nothing is virtual.
+ *
+ *       Like the nodes, a hook unlinks itself when it is destroyed, so an
+ *       element removes itself from its lists when it goes away. Since the
+ *       hook does not know its list, the list cannot keep a count, and
+ *       size() walks the list.
+ *
+ *****************************************************************************/
+#ifndef INTRUSIVE_MEMBER_LIST_H
+#define INTRUSIVE_MEMBER_LIST_H
+
+#include "Intrusive.h"
+#include <cstddef>
+#include <iterator>
+
+namespace intrusive
+{
+    /**********************************************************************
+     * Class Declaration
+     *
+     * @name - list_member_hook
+     *
+     * @scope - intrusive
+     *
+     * @desc - the previous and next pointers of an element in one
+     *       member_list. Copying an element gives the copy unlinked hooks,
+     *       it does not join the lists of the original.
+     *********************************************************************/
+    class list_member_hook
+    {
+    public:
+        list_member_hook() :
+            m_prev(nullptr),
+            m_next(nullptr)
+            {}
+
+        list_member_hook(const list_member_hook&) :
+            m_prev(nullptr),
+            m_next(nullptr)
+            {}
+
+        list_member_hook& operator=(const list_member_hook&) {return *this;}
+
+        ~list_member_hook() {unlink();}
+
+        bool is_linked() const {return m_next != nullptr;}
+
+        /**
+         * Function Declaration
+         * @name - unlink()
+         * @scope - intrusive::list_member_hook
+         * @purpose - closes the gap in whatever list the hook is in. Does
+         *       nothing if it is in none.
+         */
+        void unlink()
+        {
+            if(m_next == nullptr)
+                return;
+
+            m_prev->m_next = m_next;
+            m_next->m_prev = m_prev;
+
+            m_prev = nullptr;
+            m_next = nullptr;
+        }
+
+    private:
+        template<class T, list_member_hook T::* Hook>
+        friend class member_list;
+
+        // links this unlinked hook in before position
+        void link_before(list_member_hook * position)
+        {
+            m_prev = position->m_prev;
+            m_next = position;
+
+            position->m_prev->m_next = this;
+            position->m_prev = this;
+        }
+
+        list_member_hook * m_prev;
+        list_member_hook * m_next;
+    };
+
+    /**************************************************************************
+     * Class Declaration
+     *
+     * @name - template<class T, list_member_hook T::* Hook> member_list
+     *
+     * @scope - intrusive
+     *
+     * @desc - a doubly linked list of T through the member Hook of T. The
+     *       list does not own its elements, and an element can be in one
+     *       member_list per list_member_hook member it has.
+     *
+     *************************************************************************/
+    template<class T, list_member_hook T::* Hook>
+    class member_list
+    {
+    public:
+        class iterator
+        {
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef T* pointer;
+            typedef T& reference;
+
+            iterator(list_member_hook * current = nullptr) :
+                m_current(current)
+                {}
+
+            T& operator*() const {return *member_list::owner(m_current);}
+
+            T* operator->() const {return member_list::owner(m_current);}
+
+            iterator& operator++() {m_current = m_current->m_next; return *this;}
+
+            iterator operator++(int)
+            {
+                iterator temp(*this);
+                m_current = m_current->m_next;
+                return temp;
+            }
+
+            iterator& operator--() {m_current = m_current->m_prev; return *this;}
+
+            iterator operator--(int)
+            {
+                iterator temp(*this);
+                m_current = m_current->m_prev;
+                return temp;
+            }
+
+            bool operator==(const iterator& x) const {return m_current == x.m_current;}
+            bool operator!=(const iterator& x) const {return m_current != x.m_current;}
+
+        private:
+            friend class member_list;
+
+            list_member_hook * m_current;
+        };
+
+        member_list()
+        {
+            m_Head.m_prev = &m_Head;
+            m_Head.m_next = &m_Head;
+        }
+
+        /**
+         * Function Declaration
+         * @name - ~member_list()
+         * @scope - template<class T, list_member_hook T::* Hook> intrusive::member_list<T, Hook>
+         * @purpose - unlinks every element, so elements outliving the list
+         *       do not reach back into it when they are destroyed
+         */
+        ~member_list()
+        {
+            clear();
+
+            m_Head.m_prev = nullptr;
+            m_Head.m_next = nullptr;
+        }
+
+        bool is_empty() const {return m_Head.m_next == &m_Head;}
+
+        // walks the list, see the top of the file
+        long size() const
+        {
+            long count = 0;
+
+            for(const list_member_hook * current = m_Head.m_next; current != &m_Head; current = current->m_next)
+                ++count;
+
+            return count;
+        }
+
+        /**
+         * Function Declaration
+         * @name - insert(iterator position, T& val)
+         * @scope - template<class T, list_member_hook T::* Hook> intrusive::member_list<T, Hook>
+         * @purpose - links val in before position
+         * @pre - the hook of val must not be in a list
+         * @return - an iterator to val
+         */
+        iterator insert(iterator position, T& val)
+        {
+            list_member_hook & hook = val.*Hook;
+
+            if(hook.is_linked())
+                throw std::logic_error("Element is already in a list.");
+
+            hook.link_before(position.m_current);
+
+            return iterator(&hook);
+        }
+
+        void push_back(T& val) {insert(end(), val);}
+
+        void push_front(T& val) {insert(begin(), val);}
+
+        // unlinks the element at position and returns the one after it
+        iterator erase(iterator position)
+        {
+            if(position.m_current == &m_Head)
+                throw std::out_of_range("Iterator out of range.");
+
+            iterator next(position.m_current->m_next);
+            position.m_current->unlink();
+
+            return next;
+        }
+
+        // unlinks val, which must be in this list
+        void remove(T& val) {(val.*Hook).unlink();}
+
+        void pop_front() {erase(begin());}
+
+        void pop_back() {erase(iterator(m_Head.m_prev));}
+
+        T& front()
+        {
+            if(is_empty())
+                throw std::out_of_range("List is empty.");
+
+            return *owner(m_Head.m_next);
+        }
+
+        T& back()
+        {
+            if(is_empty())
+                throw std::out_of_range("List is empty.");
+
+            return *owner(m_Head.m_prev);
+        }
+
+        void clear()
+        {
+            while(!is_empty())
+                m_Head.m_next->unlink();
+        }
+
+        iterator begin() {return iterator(m_Head.m_next);}
+
+        iterator end() {return iterator(&m_Head);}
+
+        // an iterator to val, which must be in this list
+        static iterator iterator_to(T& val) {return iterator(&(val.*Hook));}
+
+    private:
+        member_list(const member_list&);
+        member_list& operator=(const member_list&);
+
+        static T* owner(list_member_hook * hook)
+        {
+            return member_owner(hook, Hook);
+        }
+
+        // the ring runs through this hook in both directions, so it is both
+        // the terminator at the end and the one before the beginning
+        list_member_hook m_Head;
+    };
+}
+#endif
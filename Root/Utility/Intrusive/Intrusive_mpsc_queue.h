@@ -0,0 +1,191 @@
+/******************************************************************************
+ * @File - Intrusive_mpsc_queue.h
+ * @Purpose - This file contains a lock-free intrusive queue that any number
+ *       of threads can push to and one thread pops from.
+ *
+ * @Description - This is the queue Dmitry Vyukov described for many
+ *       producers and a single consumer. Like member_list, the hook is a
+ *       named member of the element, so pushing never allocates:
+ *
+ *           struct Event
+ *           {
+ *               intrusive::mpsc_queue_hook queue_hook;
+ *           };
+ *
+ *           intrusive::mpsc_queue<Event, &Event::queue_hook> events;
+ *
+ *       The elements form a singly linked list from the oldest to the
+ *       newest. A push swaps itself in as the newest with one atomic
+ *       exchange and then links the element before it to itself, so pushes
+ *       never retry or wait on each other. The consumer walks the list from
+ *       the oldest end, which no producer touches. An empty queue still
+ *       holds one element, a stub hook inside the queue itself, that the
+ *       consumer pushes back whenever it is about to take the last element.
+ *
+ *       The price of never blocking is that there is a moment between the
+ *       exchange and the link where a push is visible to other producers
+ *       but not yet to the consumer. A pop in that window returns null even
+ *       though the queue is not empty; the element shows up as soon as the
+ *       producer finishes its push.
+ *
+ *       Elements do not unlink themselves. One must not be destroyed, or
+ *       pushed again, before it has been popped.
+ *
+ *****************************************************************************/
+#ifndef INTRUSIVE_MPSC_QUEUE_H
+#define INTRUSIVE_MPSC_QUEUE_H
+
+#include "Intrusive.h"
+#include <atomic>
+
+namespace intrusive
+{
+    /**********************************************************************
+     * Class Declaration
+     *
+     * @name - mpsc_queue_hook
+     *
+     * @scope - intrusive
+     *
+     * @desc - the link to the next newer element of an mpsc_queue.
+     *********************************************************************/
+    class mpsc_queue_hook
+    {
+    public:
+        mpsc_queue_hook() :
+            m_next(nullptr)
+            {}
+
+        // a copy is not in the queue of the original
+        mpsc_queue_hook(const mpsc_queue_hook&) :
+            m_next(nullptr)
+            {}
+
+        mpsc_queue_hook& operator=(const mpsc_queue_hook&) {return *this;}
+
+    private:
+        template<class T, mpsc_queue_hook T::* Hook>
+        friend class mpsc_queue;
+
+        std::atomic<mpsc_queue_hook*> m_next;
+    };
+
+    /**************************************************************************
+     * Class Declaration
+     *
+     * @name - template<class T, mpsc_queue_hook T::* Hook> mpsc_queue
+     *
+     * @scope - intrusive
+     *
+     * @desc - a first in, first out queue of T through the member Hook of T.
+     *       push() is safe from any thread at any time, pop() and is_empty()
+     *       only from the one thread consuming the queue.
+     *
+     *************************************************************************/
+    template<class T, mpsc_queue_hook T::* Hook>
+    class mpsc_queue
+    {
+    public:
+        mpsc_queue() :
+            m_Head(&m_Stub),
+            m_Tail(&m_Stub)
+            {}
+
+        /**
+         * Function Declaration
+         * @name - push(T& val)
+         * @scope - template<class T, mpsc_queue_hook T::* Hook> intrusive::mpsc_queue<T, Hook>
+         * @purpose - adds val as the newest element. Wait-free, from any
+         *       thread.
+         * @pre - val must not be in the queue
+         */
+        void push(T& val)
+        {
+            link(&(val.*Hook));
+        }
+
+        /**
+         * Function Declaration
+         * @name - pop()
+         * @scope - template<class T, mpsc_queue_hook T::* Hook> intrusive::mpsc_queue<T, Hook>
+         * @purpose - takes the oldest element off the queue. Consumer thread
+         *       only.
+         * @return - the oldest element, or nullptr if the queue is empty or
+         *       the oldest element is still being pushed, see the top of the
+         *       file
+         */
+        T* pop()
+        {
+            mpsc_queue_hook * tail = m_Tail;
+            mpsc_queue_hook * next = tail->m_next.load(std::memory_order_acquire);
+
+            // the stub is never handed out, step over it
+            if(tail == &m_Stub)
+            {
+                if(next == nullptr)
+                    return nullptr;
+
+                m_Tail = next;
+                tail = next;
+                next = next->m_next.load(std::memory_order_acquire);
+            }
+
+            if(next != nullptr)
+            {
+                m_Tail = next;
+                return member_owner(tail, Hook);
+            }
+
+            // tail looks like the newest element. if it is not, a push is
+            // half done and the element after tail is not linked in yet
+            if(tail != m_Head.load(std::memory_order_acquire))
+                return nullptr;
+
+            // tail is the last element. the stub goes in behind it so the
+            // queue is never left without one
+            link(&m_Stub);
+
+            next = tail->m_next.load(std::memory_order_acquire);
+
+            if(next != nullptr)
+            {
+                m_Tail = next;
+                return member_owner(tail, Hook);
+            }
+
+            return nullptr;
+        }
+
+        /**
+         * Function Declaration
+         * @name - is_empty()
+         * @scope - template<class T, mpsc_queue_hook T::* Hook> intrusive::mpsc_queue<T, Hook>
+         * @purpose - consumer thread only. Like pop(), does not see pushes
+         *       that are still in progress.
+         */
+        bool is_empty() const
+        {
+            return m_Tail == &m_Stub && m_Stub.m_next.load(std::memory_order_acquire) == nullptr;
+        }
+
+    private:
+        mpsc_queue(const mpsc_queue&);
+        mpsc_queue& operator=(const mpsc_queue&);
+
+        void link(mpsc_queue_hook * hook)
+        {
+            hook->m_next.store(nullptr, std::memory_order_relaxed);
+
+            mpsc_queue_hook * previous = m_Head.exchange(hook, std::memory_order_acq_rel);
+
+            previous->m_next.store(hook, std::memory_order_release);
+        }
+
+        mpsc_queue_hook m_Stub;
+        // the newest element, shared by the producers
+        std::atomic<mpsc_queue_hook*> m_Head;
+        // the oldest element, the consumer's alone
+        mpsc_queue_hook * m_Tail;
+    };
+}
+#endif
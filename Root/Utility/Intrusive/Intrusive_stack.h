@@ -0,0 +1,215 @@
+/******************************************************************************
+ * @File - Intrusive_stack.h
+ * @Purpose - This file contains a lock-free intrusive stack that any number
+ *       of threads can push to and pop from at once.
+ *
+ * @Description - This is Treiber's stack. Like member_list, the hook is a
+ *       named member of the element, so pushing never allocates:
+ *
+ *           struct Garbage
+ *           {
+ *               intrusive::stack_hook free_hook;
+ *           };
+ *
+ *           intrusive::atomic_stack<Garbage, &Garbage::free_hook> graveyard;
+ *
+ *       The top of the stack is a single atomic word that every push and
+ *       pop compares and swaps. Comparing only the pointer would fall for
+ *       ABA: a pop reads the top A and the element under it B, another
+ *       thread pops A and B and pushes A back, and the first pop's swap
+ *       still sees A on top and installs B, which is gone. So the word packs
+ *       a tag next to the pointer that every successful swap bumps, and the
+ *       stale swap fails. The tag is 16 bits on 64 bit targets, where
+ *       pointers use no more than the low 48 bits, and 32 bits on 32 bit
+ *       targets, so it fits in 64 bit compare and swap everywhere.
+ *
+ *       That rests on two assumptions:
+ *
+ *       - Addresses fit in 48 bits. This holds for user space on x86-64
+ *         with 4 level paging and on ARM64 with 48 bit virtual addresses.
+ *         It does not hold with 5 level paging once the kernel hands out
+ *         addresses above 2^47, or with pointer tagging such as ARM top
+ *         byte ignore or hardware address sanitizers. push() throws
+ *         std::logic_error for a hook whose address does not fit.
+ *
+ *       - The tag does not wrap while a pop is stalled. A 16 bit tag comes
+ *         back to the same value after 65536 successful swaps, so a pop
+ *         that is preempted between reading the top and its swap, while
+ *         other threads swap exactly a multiple of 65536 times and leave
+ *         the same element on top, still falls for ABA. It is unlikely,
+ *         not impossible. On 32 bit targets the tag wraps after 2^32.
+ *
+ *       The tag protects against reuse, not against memory going away: a
+ *       pop may read the hook of an element another thread has just popped.
+ *       Elements popped concurrently must stay readable, for instance by
+ *       coming from a pool or a SlabAllocator, which never gives memory back
+ *       before it is destroyed.
+ *
+ *****************************************************************************/
+#ifndef INTRUSIVE_STACK_H
+#define INTRUSIVE_STACK_H
+
+#include "Intrusive.h"
+#include <atomic>
+#include <cstdint>
+
+namespace intrusive
+{
+    /**********************************************************************
+     * Class Declaration
+     *
+     * @name - stack_hook
+     *
+     * @scope - intrusive
+     *
+     * @desc - the link to the element below in an atomic_stack.
+     *********************************************************************/
+    class stack_hook
+    {
+    public:
+        stack_hook() :
+            m_next(nullptr)
+            {}
+
+        // a copy is not on the stack of the original
+        stack_hook(const stack_hook&) :
+            m_next(nullptr)
+            {}
+
+        stack_hook& operator=(const stack_hook&) {return *this;}
+
+    private:
+        template<class T, stack_hook T::* Hook>
+        friend class atomic_stack;
+
+        // atomic since a pop may read it while the element is popped and
+        // pushed again by another thread. that pop then fails its swap
+        std::atomic<stack_hook*> m_next;
+    };
+
+    /**************************************************************************
+     * Class Declaration
+     *
+     * @name - template<class T, stack_hook T::* Hook> atomic_stack
+     *
+     * @scope - intrusive
+     *
+     * @desc - a last in, first out stack of T through the member Hook of T.
+     *       Every method is safe from any thread at any time.
+     *
+     *************************************************************************/
+    template<class T, stack_hook T::* Hook>
+    class atomic_stack
+    {
+        static const unsigned int TAG_SHIFT = sizeof(void*) == 4 ? 32 : 48;
+        static const std::uint64_t POINTER_MASK = (std::uint64_t(1) << TAG_SHIFT) - 1;
+
+    public:
+        atomic_stack() :
+            m_Top(0)
+            {}
+
+        /**
+         * Function Declaration
+         * @name - push(T& val)
+         * @scope - template<class T, stack_hook T::* Hook> intrusive::atomic_stack<T, Hook>
+         * @purpose - puts val on top
+         * @pre - val must not be on the stack, and its address must fit in
+         *       48 bits, see the top of the file
+         */
+        void push(T& val)
+        {
+            stack_hook * hook = &(val.*Hook);
+
+            if((std::uint64_t(reinterpret_cast<std::uintptr_t>(hook)) & ~POINTER_MASK) != 0)
+                throw std::logic_error("Address does not fit next to the tag.");
+
+            std::uint64_t top = m_Top.load(std::memory_order_relaxed);
+
+            do
+                hook->m_next.store(pointer(top), std::memory_order_relaxed);
+            while(!m_Top.compare_exchange_weak(top, pack(hook, top), std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        /**
+         * Function Declaration
+         * @name - pop()
+         * @scope - template<class T, stack_hook T::* Hook> intrusive::atomic_stack<T, Hook>
+         * @purpose - takes the element on top off the stack
+         * @return - the element, or nullptr if the stack is empty
+         */
+        T* pop()
+        {
+            std::uint64_t top = m_Top.load(std::memory_order_acquire);
+
+            while(pointer(top) != nullptr)
+            {
+                stack_hook * hook = pointer(top);
+                stack_hook * next = hook->m_next.load(std::memory_order_relaxed);
+
+                if(m_Top.compare_exchange_weak(top, pack(next, top), std::memory_order_acquire, std::memory_order_acquire))
+                    return member_owner(hook, Hook);
+            }
+
+            return nullptr;
+        }
+
+        /**
+         * Function Declaration
+         * @name - template<class TFunction> drain(TFunction func)
+         * @scope - template<class T, stack_hook T::* Hook> intrusive::atomic_stack<T, Hook>
+         * @purpose - takes every element off the stack in one swap and calls
+         *       func(T&) on each, newest first. func may destroy the element,
+         *       which makes this the way to empty a deferred deletion list.
+         * @return - the number of elements taken
+         */
+        template<class TFunction>
+        long drain(TFunction func)
+        {
+            std::uint64_t top = m_Top.load(std::memory_order_acquire);
+
+            while(pointer(top) != nullptr &&
+                  !m_Top.compare_exchange_weak(top, pack(nullptr, top), std::memory_order_acquire, std::memory_order_acquire))
+                {}
+
+            long count = 0;
+
+            for(stack_hook * hook = pointer(top); hook != nullptr; ++count)
+            {
+                stack_hook * next = hook->m_next.load(std::memory_order_relaxed);
+
+                func(*member_owner(hook, Hook));
+                hook = next;
+            }
+
+            return count;
+        }
+
+        // a snapshot, other threads may change it right after
+        bool is_empty() const
+        {
+            return pointer(m_Top.load(std::memory_order_acquire)) == nullptr;
+        }
+
+    private:
+        atomic_stack(const atomic_stack&);
+        atomic_stack& operator=(const atomic_stack&);
+
+        static stack_hook * pointer(std::uint64_t top)
+        {
+            return reinterpret_cast<stack_hook*>(std::uintptr_t(top & POINTER_MASK));
+        }
+
+        // hook with the tag of previous, bumped
+        static std::uint64_t pack(stack_hook * hook, std::uint64_t previous)
+        {
+            std::uint64_t tag = (previous >> TAG_SHIFT) + 1;
+
+            return std::uint64_t(reinterpret_cast<std::uintptr_t>(hook)) | (tag << TAG_SHIFT);
+        }
+
+        // pointer in the low TAG_SHIFT bits, tag in the rest
+        std::atomic<std::uint64_t> m_Top;
+    };
+}
+#endif
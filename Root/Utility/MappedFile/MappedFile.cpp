@@ -0,0 +1,97 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+MappedFile::MappedFile(const std::string& fileName) :
+    m_Data(nullptr),
+    m_Size(0),
+    m_File(INVALID_HANDLE_VALUE),
+    m_Mapping(nullptr)
+{
+    m_File = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if(m_File == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Could not open '" + fileName + "'");
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx((HANDLE)m_File, &size) || size.QuadPart == 0)
+    {
+        CloseHandle((HANDLE)m_File);
+        throw std::runtime_error("Could not map '" + fileName + "'");
+    }
+
+    m_Size = std::size_t(size.QuadPart);
+
+    // PAGE_WRITECOPY and FILE_MAP_COPY give private copy on write pages
+    m_Mapping = CreateFileMappingA((HANDLE)m_File, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+    if(m_Mapping != nullptr)
+        m_Data = static_cast<unsigned char*>(MapViewOfFile((HANDLE)m_Mapping, FILE_MAP_COPY, 0, 0, 0));
+
+    if(m_Data == nullptr)
+    {
+        if(m_Mapping != nullptr)
+            CloseHandle((HANDLE)m_Mapping);
+
+        CloseHandle((HANDLE)m_File);
+        throw std::runtime_error("Could not map '" + fileName + "'");
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(m_Data);
+    CloseHandle((HANDLE)m_Mapping);
+    CloseHandle((HANDLE)m_File);
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& fileName) :
+    m_Data(nullptr),
+    m_Size(0),
+    m_File(nullptr),
+    m_Mapping(nullptr)
+{
+    int file = open(fileName.c_str(), O_RDONLY);
+
+    if(file < 0)
+        throw std::runtime_error("Could not open '" + fileName + "'");
+
+    struct stat info;
+    void* data = MAP_FAILED;
+
+    if(fstat(file, &info) == 0 && info.st_size > 0)
+    {
+        m_Size = std::size_t(info.st_size);
+
+        // MAP_PRIVATE gives private copy on write pages
+        data = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    }
+
+    // the mapping keeps its own reference to the file
+    close(file);
+
+    if(data == MAP_FAILED)
+        throw std::runtime_error("Could not map '" + fileName + "'");
+
+    m_Data = static_cast<unsigned char*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(m_Data, m_Size);
+}
+
+#else
+#error Memory mapped files not supported on your operating system
+#endif
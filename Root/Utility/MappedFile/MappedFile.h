@@ -0,0 +1,38 @@
+// File: MappedFile.h
+// Read only file mapping. Pages are mapped copy on write: they are shared
+// with the page cache until written to, at which point the process gets a
+// private copy and the file itself is never modified.
+
+#ifndef SENTIMENT_MAPPEDFILE_H
+#define SENTIMENT_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+    // throws std::runtime_error if the file cannot be opened or mapped
+    MappedFile(const std::string& fileName);
+
+    ~MappedFile();
+
+    // writable, the writes stay private to the process
+    unsigned char* Data() const {return m_Data;}
+
+    std::size_t Size() const {return m_Size;}
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+private:
+    unsigned char* m_Data;
+    std::size_t m_Size;
+
+    // platform handles needed to unmap
+    void* m_File;
+    void* m_Mapping;
+};
+
+#endif
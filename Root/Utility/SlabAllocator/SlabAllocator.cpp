@@ -0,0 +1,290 @@
+#include "SlabAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+
+const unsigned int SlabAllocator::CACHE_BATCH;
+
+namespace
+{
+    // free blocks are linked through their first word
+    void*& Next(void* block)
+    {
+        return *static_cast<void**>(block);
+    }
+
+    std::atomic<unsigned int> g_NextCacheIndex(0);
+}
+
+// indexed by the cache index of the allocator
+struct SlabAllocator::ThreadCaches
+{
+    struct Cache
+    {
+        SlabAllocator* allocator;
+        void* first;
+        unsigned int count;
+    };
+
+    // the caches of the calling thread, null before first use and after
+    // they are gone. both are trivially destructible, so they can still
+    // be read from destructors that run after the thread's caches, like
+    // those of statics on the main thread
+    static thread_local ThreadCaches* current;
+    static thread_local bool exited;
+
+    ~ThreadCaches()
+    {
+        current = nullptr;
+        exited = true;
+
+        for(unsigned int i = 0; i < caches.size(); ++i)
+            if(caches[i].count != 0)
+                caches[i].allocator->Give(caches[i].first, caches[i].count);
+    }
+
+    Cache& Get(SlabAllocator* allocator)
+    {
+        if(allocator->m_CacheIndex >= caches.size())
+        {
+            Cache empty = {nullptr, nullptr, 0};
+            caches.resize(allocator->m_CacheIndex + 1, empty);
+        }
+
+        Cache& cache = caches[allocator->m_CacheIndex];
+        cache.allocator = allocator;
+
+        return cache;
+    }
+
+    std::vector<Cache> caches;
+};
+
+thread_local SlabAllocator::ThreadCaches* SlabAllocator::ThreadCaches::current = nullptr;
+thread_local bool SlabAllocator::ThreadCaches::exited = false;
+
+SlabAllocator::ThreadCaches* SlabAllocator::LocalCaches()
+{
+    if(ThreadCaches::current == nullptr && !ThreadCaches::exited)
+    {
+        thread_local ThreadCaches caches;
+        ThreadCaches::current = &caches;
+    }
+
+    return ThreadCaches::current;
+}
+
+SlabAllocator::SlabAllocator(std::size_t size, std::size_t align, std::size_t blocksPerSlab) :
+    m_Stride(Stride(size, align)),
+    m_Align(align < alignof(void*) ? alignof(void*) : align),
+    m_BlocksPerSlab(blocksPerSlab),
+    m_CacheIndex(g_NextCacheIndex++),
+    m_Free(nullptr),
+    m_Next(nullptr),
+    m_End(nullptr)
+{
+    if((m_Align & (m_Align - 1)) != 0)
+        throw std::logic_error("Slab alignment must be a power of two");
+
+    if(m_BlocksPerSlab == 0)
+        m_BlocksPerSlab = (m_Stride < 4096) ? 65536 / m_Stride : 16;
+}
+
+SlabAllocator::~SlabAllocator()
+{
+}
+
+std::size_t SlabAllocator::Stride(std::size_t size, std::size_t align)
+{
+    if(align < alignof(void*))
+        align = alignof(void*);
+
+    // every block has to be able to hold the free list link
+    std::size_t bytes = (size < sizeof(void*)) ? sizeof(void*) : size;
+
+    return (bytes + align - 1) & ~(align - 1);
+}
+
+void* SlabAllocator::Allocate()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(m_Free != nullptr)
+    {
+        void* block = m_Free;
+        m_Free = Next(block);
+
+        return block;
+    }
+
+    return Carve();
+}
+
+void SlabAllocator::Deallocate(void* block)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    Next(block) = m_Free;
+    m_Free = block;
+}
+
+void* SlabAllocator::AllocateCached()
+{
+    ThreadCaches* caches = LocalCaches();
+
+    // the thread is shutting down and its caches are gone
+    if(caches == nullptr)
+        return Allocate();
+
+    ThreadCaches::Cache& cache = caches->Get(this);
+
+    if(cache.count == 0)
+    {
+        cache.first = Take(CACHE_BATCH);
+        cache.count = CACHE_BATCH;
+    }
+
+    void* block = cache.first;
+    cache.first = Next(block);
+    cache.count--;
+
+    return block;
+}
+
+void SlabAllocator::DeallocateCached(void* block)
+{
+    ThreadCaches* caches = LocalCaches();
+
+    if(caches == nullptr)
+    {
+        Deallocate(block);
+        return;
+    }
+
+    ThreadCaches::Cache& cache = caches->Get(this);
+
+    Next(block) = cache.first;
+    cache.first = block;
+    cache.count++;
+
+    // a thread that frees more than it allocates hands the surplus back,
+    // keeping a batch for itself
+    if(cache.count >= 2 * CACHE_BATCH)
+    {
+        void* last = cache.first;
+
+        for(unsigned int i = 1; i < CACHE_BATCH; ++i)
+            last = Next(last);
+
+        void* surplus = Next(last);
+        Next(last) = nullptr;
+
+        Give(surplus, cache.count - CACHE_BATCH);
+        cache.count = CACHE_BATCH;
+    }
+}
+
+long SlabAllocator::SlabCount() const
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return long(m_Slabs.size());
+}
+
+void* SlabAllocator::Take(unsigned int count)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    void* first = nullptr;
+
+    try
+    {
+        for(unsigned int i = 0; i < count; ++i)
+        {
+            void* block = m_Free;
+
+            if(block != nullptr)
+                m_Free = Next(block);
+            else
+                block = Carve();
+
+            Next(block) = first;
+            first = block;
+        }
+    }
+    catch(...)
+    {
+        // a new slab could not be had, the blocks taken so far go back
+        while(first != nullptr)
+        {
+            void* block = first;
+            first = Next(block);
+
+            Next(block) = m_Free;
+            m_Free = block;
+        }
+
+        throw;
+    }
+
+    return first;
+}
+
+void SlabAllocator::Give(void* first, unsigned int count)
+{
+    // found before locking, the list belongs to the caller until then
+    void* last = first;
+
+    for(unsigned int i = 1; i < count; ++i)
+        last = Next(last);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    Next(last) = m_Free;
+    m_Free = first;
+}
+
+void* SlabAllocator::Carve()
+{
+    if(m_Next == m_End)
+    {
+        // over allocated so the first block can be aligned beyond what new
+        // guarantees
+        std::size_t bytes = m_Stride * m_BlocksPerSlab + m_Align;
+        m_Slabs.push_back(std::unique_ptr<unsigned char[]>(new unsigned char[bytes]));
+
+        std::uintptr_t start = reinterpret_cast<std::uintptr_t>(m_Slabs.back().get());
+        start = (start + m_Align - 1) & ~std::uintptr_t(m_Align - 1);
+
+        m_Next = reinterpret_cast<unsigned char*>(start);
+        m_End = m_Next + m_Stride * m_BlocksPerSlab;
+    }
+
+    void* block = m_Next;
+    m_Next += m_Stride;
+
+    return block;
+}
+
+SlabAllocator& SlabAllocator::ForType(std::uint64_t typeID, std::size_t size, std::size_t align)
+{
+    // leaked on purpose, see the header
+    static std::mutex* lock = new std::mutex;
+    static std::map<std::uint64_t, SlabAllocator*>* allocators = new std::map<std::uint64_t, SlabAllocator*>;
+
+    std::lock_guard<std::mutex> guard(*lock);
+
+    std::map<std::uint64_t, SlabAllocator*>::iterator it = allocators->find(typeID);
+
+    if(it == allocators->end())
+        it = allocators->insert(std::make_pair(typeID, new SlabAllocator(size, align))).first;
+
+    SlabAllocator& allocator = *it->second;
+
+    if(allocator.m_Stride != Stride(size, align) || allocator.m_Align < align)
+        throw std::logic_error("Type id already has a slab of a different size");
+
+    return allocator;
+}
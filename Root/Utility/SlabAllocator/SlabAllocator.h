@@ -0,0 +1,96 @@
+// File: SlabAllocator.h
+// Fixed size block allocator. Blocks are carved out of large slabs with a
+// bump pointer and recycled through a free list threaded through the blocks
+// themselves, so an allocation is a pop or a bump and blocks never move.
+// Slabs are only released when the allocator is destroyed.
+//
+// Each thread can also keep a small cache of free blocks per allocator,
+// which only takes the lock when it runs empty or overflows.
+
+#ifndef SENTIMENT_SLABALLOCATOR_H
+#define SENTIMENT_SLABALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class SlabAllocator
+{
+public:
+    // blocks of size bytes aligned to align. blocksPerSlab of 0 picks
+    // enough blocks to fill about 64 KiB
+    SlabAllocator(std::size_t size, std::size_t align, std::size_t blocksPerSlab = 0);
+
+    // every block must have been given back by now
+    ~SlabAllocator();
+
+    void* Allocate();
+
+    // block must have come from this allocator
+    void Deallocate(void* block);
+
+    // Allocate() and Deallocate() through the cache of the calling thread.
+    // caches are flushed when their thread exits, so the allocator has to
+    // outlive every thread using them, as the ones from ForType() do. once
+    // a thread's caches are gone, during its exit or for the main thread
+    // in static destruction, these take the lock like the plain calls
+    void* AllocateCached();
+
+    void DeallocateCached(void* block);
+
+    std::size_t BlockSize() const {return m_Stride;}
+
+    // number of slabs carved so far
+    long SlabCount() const;
+
+    // allocator for the objects of one type id, created on first use and
+    // never destroyed, so the objects may outlive static destruction. throws
+    // std::logic_error if the type id was seen with a different size or
+    // alignment before
+    static SlabAllocator& ForType(std::uint64_t typeID, std::size_t size, std::size_t align);
+
+private:
+    SlabAllocator(const SlabAllocator&);
+    SlabAllocator& operator=(const SlabAllocator&);
+
+    // number of blocks a thread cache takes or gives back at once
+    static const unsigned int CACHE_BATCH = 32;
+
+    // free blocks the calling thread holds for every allocator
+    struct ThreadCaches;
+
+    // null once the caches of the calling thread were destroyed
+    static ThreadCaches* LocalCaches();
+
+    // block size for size and align, with room for the free list link
+    static std::size_t Stride(std::size_t size, std::size_t align);
+
+    // pops count blocks under a single lock, linked through their first
+    // word, and returns the first
+    void* Take(unsigned int count);
+
+    // pushes a linked list of count blocks under a single lock
+    void Give(void* first, unsigned int count);
+
+    // next block off the bump pointer, starting a new slab if needed. the
+    // lock must be held
+    void* Carve();
+
+private:
+    std::size_t m_Stride;
+    std::size_t m_Align;
+    std::size_t m_BlocksPerSlab;
+
+    // slot of this allocator in the thread caches
+    unsigned int m_CacheIndex;
+
+    mutable std::mutex m_Lock;
+    void* m_Free;
+    unsigned char* m_Next;
+    unsigned char* m_End;
+    std::vector<std::unique_ptr<unsigned char[]> > m_Slabs;
+};
+
+#endif
@@ -0,0 +1,346 @@
+// File: Benchmark.cpp
+// Throughput of the entity engine at 1k to 10M entities: creating and
+// removing entities, iterating one and two components, random access by
+// handle, structural changes, node allocation and memory per entity.
+//
+// Every run prints one CSV row to stdout, so results can be collected and
+// compared between builds:
+//
+//     benchmark,entities,seconds,ns_per_entity,bytes_per_entity
+//
+// Each benchmark is repeated and the fastest run is kept. Usage:
+//
+//     Sentiment_Benchmark [--max entities] [--repeat count] [--filter group]
+//
+// --max defaults to 1M, since 10M entities need a few hundred megabytes.
+// --filter runs a single group, as named in BENCHMARKS.
+
+#include "Root/Engine/Entity System/Entity_Engine.h"
+#include "Root/Engine/Entity System/Prefab.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Position :
+        public component<Position>
+    {
+        float x, y, z;
+    };
+
+    struct Velocity :
+        public component<Velocity>
+    {
+        float x, y, z;
+    };
+
+    struct Health :
+        public component<Health>
+    {
+        int value;
+    };
+
+    class BenchNode :
+        public node<BenchNode>
+    {
+    public:
+        BenchNode() :
+            node<BenchNode>("bench")
+            {}
+    };
+
+    typedef std::chrono::steady_clock clock;
+
+    struct Options
+    {
+        long maxEntities;
+        int repeat;
+        std::string filter;
+    };
+
+    // keeps the optimizer from dropping loops whose results are unused
+    volatile float g_Sink;
+
+    double Seconds(clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    void Report(const char* name, long entities, double seconds, double bytes)
+    {
+        std::printf("%s,%ld,%.9f,%.3f,%.1f\n", name, entities, seconds, seconds * 1e9 / double(entities), bytes);
+        std::fflush(stdout);
+    }
+
+    // a World holding count entities with a Position and a Velocity
+    void Populate(World& world, long count, std::vector<EntityHandle>* handles)
+    {
+        Prefab prefab;
+        prefab.Add<Position>();
+        prefab.Add<Velocity>();
+
+        if(handles != nullptr)
+        {
+            handles->resize(count);
+            world.Instantiate(prefab, count, handles->data());
+        }
+        else
+            world.Instantiate(prefab, count);
+    }
+
+    // setup runs outside the clock, run inside it. returns the fastest run
+    double Measure(int repeat, const std::function<void()>& setup, const std::function<void()>& run, const std::function<void()>& teardown)
+    {
+        double best = 0.0;
+
+        for(int i = 0; i < repeat; ++i)
+        {
+            setup();
+
+            clock::time_point start = clock::now();
+            run();
+            double seconds = Seconds(start);
+
+            teardown();
+
+            if(i == 0 || seconds < best)
+                best = seconds;
+        }
+
+        return best;
+    }
+
+    void Nothing() {}
+
+    void CreateEach(const Options& options, long count)
+    {
+        std::unique_ptr<World> world;
+
+        double seconds = Measure(options.repeat,
+            [&]() {world.reset(new World);},
+            [&]()
+            {
+                for(long i = 0; i < count; ++i)
+                {
+                    EntityHandle entity = world->CreateEntity();
+                    world->CreateComponent<Position>(entity);
+                    world->CreateComponent<Velocity>(entity);
+                }
+            },
+            [&]() {world.reset();});
+
+        Report("create_each", count, seconds, 0.0);
+    }
+
+    void CreateBatch(const Options& options, long count)
+    {
+        std::unique_ptr<World> world;
+
+        double seconds = Measure(options.repeat,
+            [&]() {world.reset(new World);},
+            [&]() {Populate(*world, count, nullptr);},
+            [&]() {world.reset();});
+
+        Report("create_batch", count, seconds, 0.0);
+    }
+
+    void Destroy(const Options& options, long count)
+    {
+        std::unique_ptr<World> world;
+        std::vector<EntityHandle> handles;
+
+        double seconds = Measure(options.repeat,
+            [&]()
+            {
+                world.reset(new World);
+                Populate(*world, count, &handles);
+                std::shuffle(handles.begin(), handles.end(), std::mt19937(1));
+            },
+            [&]()
+            {
+                for(long i = 0; i < count; ++i)
+                    world->RemoveEntity(handles[i]);
+            },
+            [&]() {world.reset();});
+
+        Report("destroy_random", count, seconds, 0.0);
+    }
+
+    void Iterate(const Options& options, long count)
+    {
+        World world;
+        Populate(world, count, nullptr);
+
+        double seconds = Measure(options.repeat, &Nothing, [&]()
+        {
+            float sum = 0.0f;
+            world.query<const Position>().Each([&](const Position& position) {sum += position.x;});
+            g_Sink = sum;
+        }, &Nothing);
+
+        Report("iterate_one", count, seconds, 0.0);
+
+        seconds = Measure(options.repeat, &Nothing, [&]()
+        {
+            world.query<Position, const Velocity>().Each([](Position& position, const Velocity& velocity)
+            {
+                position.x += velocity.x;
+                position.y += velocity.y;
+                position.z += velocity.z;
+            });
+        }, &Nothing);
+
+        Report("iterate_two", count, seconds, 0.0);
+    }
+
+    void RandomAccess(const Options& options, long count)
+    {
+        World world;
+        std::vector<EntityHandle> handles;
+        Populate(world, count, &handles);
+        std::shuffle(handles.begin(), handles.end(), std::mt19937(2));
+
+        double seconds = Measure(options.repeat, &Nothing, [&]()
+        {
+            float sum = 0.0f;
+
+            for(long i = 0; i < count; ++i)
+                sum += world.GetComponent<Position>(handles[i])->x;
+
+            g_Sink = sum;
+        }, &Nothing);
+
+        Report("random_access", count, seconds, 0.0);
+    }
+
+    void Structural(const Options& options, long count)
+    {
+        World world;
+        std::vector<EntityHandle> handles;
+        Populate(world, count, &handles);
+
+        // one add and one remove per entity
+        double seconds = Measure(options.repeat, &Nothing, [&]()
+        {
+            for(long i = 0; i < count; ++i)
+                world.CreateComponent<Health>(handles[i]);
+
+            for(long i = 0; i < count; ++i)
+                world.RemoveComponent<Health>(handles[i]);
+        }, &Nothing);
+
+        Report("add_remove_component", count, seconds / 2.0, 0.0);
+
+        seconds = Measure(options.repeat, &Nothing, [&]()
+        {
+            for(long i = 0; i < count; ++i)
+                world.Commands().AddComponent<Health>(handles[i]);
+
+            world.ApplyCommands();
+
+            for(long i = 0; i < count; ++i)
+                world.Commands().RemoveComponent<Health>(handles[i]);
+
+            world.ApplyCommands();
+        }, &Nothing);
+
+        Report("add_remove_deferred", count, seconds / 2.0, 0.0);
+    }
+
+    void Nodes(const Options& options, long count)
+    {
+        std::vector<BenchNode*> nodes(count);
+
+        double seconds = Measure(options.repeat, &Nothing, [&]()
+        {
+            for(long i = 0; i < count; ++i)
+                nodes[i] = new BenchNode;
+
+            for(long i = 0; i < count; ++i)
+                delete nodes[i];
+        }, &Nothing);
+
+        Report("node_new_delete", count, seconds, double(sizeof(BenchNode)));
+    }
+
+    void Memory(const Options&, long count)
+    {
+        World world;
+        Populate(world, count, nullptr);
+
+        World::MemoryStats stats = world.GetMemoryStats();
+
+        // chunk storage plus the handle pool, as allocated
+        double bytes = double(stats.chunkBytes + stats.handleBytes) / double(count);
+
+        Report("memory", count, 0.0, bytes);
+    }
+
+    struct Benchmark
+    {
+        const char* name;
+        void (*run)(const Options& options, long count);
+    };
+
+    const Benchmark BENCHMARKS[] =
+    {
+        {"create_each", &CreateEach},
+        {"create_batch", &CreateBatch},
+        {"destroy", &Destroy},
+        {"iterate", &Iterate},
+        {"random_access", &RandomAccess},
+        {"structural", &Structural},
+        {"node", &Nodes},
+        {"memory", &Memory}
+    };
+
+    bool ParseOptions(int argc, char * argv[], Options& options)
+    {
+        options.maxEntities = 1000000;
+        options.repeat = 3;
+
+        for(int i = 1; i < argc; ++i)
+        {
+            if(i + 1 < argc && std::strcmp(argv[i], "--max") == 0)
+                options.maxEntities = std::atol(argv[++i]);
+            else if(i + 1 < argc && std::strcmp(argv[i], "--repeat") == 0)
+                options.repeat = std::atoi(argv[++i]);
+            else if(i + 1 < argc && std::strcmp(argv[i], "--filter") == 0)
+                options.filter = argv[++i];
+            else
+                return false;
+        }
+
+        return options.maxEntities > 0 && options.repeat > 0;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    Options options;
+
+    if(!ParseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [--max entities] [--repeat count] [--filter group]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("benchmark,entities,seconds,ns_per_entity,bytes_per_entity\n");
+
+    for(long count = 1000; count <= options.maxEntities && count <= 10000000; count *= 10)
+        for(unsigned int i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); ++i)
+            if(options.filter.empty() || options.filter == BENCHMARKS[i].name)
+                BENCHMARKS[i].run(options, count);
+
+    return 0;
+}
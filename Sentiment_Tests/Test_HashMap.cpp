@@ -0,0 +1,211 @@
+// File: Test_HashMap.cpp
+// intrusive::hash_map against std::map, across the growth of the table:
+// lookups while the next table is cleared and while the old one is moved
+// over, nodes leaving on their own, reserve() and clear().
+
+#include "Root/Utility/Intrusive/Intrusive_hash_map.h"
+#include "Tests.h"
+
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    struct Item :
+        public intrusive::dynamic_node
+    {
+    };
+
+    typedef intrusive::hash_map<int, Item> Map;
+    typedef std::map<int, Item*> Reference;
+
+    bool SameContents(Map& map, const Reference& reference)
+    {
+        if(map.size() != long(reference.size()))
+            return false;
+
+        long visited = 0;
+
+        for(Map::iterator it = map.begin(); it != map.end(); ++it, ++visited)
+        {
+            Reference::const_iterator found = reference.find(it.key());
+
+            if(found == reference.end() || found->second != &*it)
+                return false;
+        }
+
+        if(visited != map.size())
+            return false;
+
+        for(Reference::const_iterator r = reference.begin(); r != reference.end(); ++r)
+        {
+            Map::iterator found = map.find(r->first);
+
+            if(found == map.end() || &*found != r->second)
+                return false;
+        }
+
+        return true;
+    }
+
+    void RandomChanges()
+    {
+        const int COUNT = 5000;
+
+        std::vector<Item> items(COUNT);
+        Map map;
+        Reference reference;
+        std::mt19937 random(7);
+
+        for(int round = 0; round < 100000; ++round)
+        {
+            int key = int(random() % COUNT);
+
+            switch(random() % 10)
+            {
+            case 0: case 1: case 2: case 3: case 4: case 5:
+                CHECK(map.insert(key, items[key]).second == reference.insert(std::make_pair(key, &items[key])).second);
+                break;
+
+            case 6: case 7:
+                CHECK(map.remove(key) == (reference.erase(key) == 1));
+                break;
+
+            case 8:
+                if(reference.erase(key) == 1)
+                    items[key].detach();
+                break;
+
+            default:
+                CHECK(map.count(key) == long(reference.count(key)));
+                break;
+            }
+
+            if(round % 997 == 0)
+                CHECK(SameContents(map, reference));
+        }
+
+        CHECK(SameContents(map, reference));
+    }
+
+    // every key stays findable through each insert while the table grows
+    void Growth()
+    {
+        const int COUNT = 20000;
+
+        std::vector<Item> items(COUNT);
+        intrusive::hash_map<std::string, Item> map;
+        bool found = true;
+
+        for(int key = 0; key < COUNT; ++key)
+        {
+            CHECK(map.insert(std::to_string(key), items[key]).second);
+
+            // the newest key and a spread of older ones
+            for(int older = key; older >= 0 && found; older -= 1 + older / 8)
+                found = map.find(std::to_string(older)) != map.end();
+        }
+
+        CHECK(found);
+        CHECK(map.size() == COUNT);
+
+        long visited = 0;
+
+        for(intrusive::hash_map<std::string, Item>::iterator it = map.begin(); it != map.end(); ++it)
+            ++visited;
+
+        CHECK(visited == COUNT);
+
+        // a taken key leaves the new node alone
+        Item other;
+        std::pair<intrusive::hash_map<std::string, Item>::iterator, bool> taken = map.insert("0", other);
+
+        CHECK(!taken.second && &*taken.first == &items[0]);
+    }
+
+    void ReserveAndClear()
+    {
+        const int COUNT = 1000;
+
+        std::vector<Item> items(COUNT);
+        Map map;
+        Reference reference;
+
+        for(int key = 0; key < COUNT; ++key)
+        {
+            map.insert(key, items[key]);
+            reference[key] = &items[key];
+        }
+
+        for(int key = 0; key < COUNT; key += 2)
+        {
+            map.remove(key);
+            reference.erase(key);
+        }
+
+        map.reserve(COUNT * 4);
+        CHECK(SameContents(map, reference));
+
+        // erase hands back the next element, so this empties the map
+        for(Map::iterator it = map.begin(); it != map.end(); )
+            it = map.erase(it);
+
+        CHECK(map.is_empty());
+
+        for(int key = 0; key < COUNT; ++key)
+            map.insert(key, items[key]);
+
+        map.clear();
+        CHECK(map.is_empty() && map.begin() == map.end());
+
+        // cleared nodes can join again
+        CHECK(map.insert(1, items[1]).second);
+        CHECK(map.size() == 1);
+    }
+
+    void Lifetimes()
+    {
+        Item first;
+
+        {
+            Map scoped;
+            scoped.insert(1, first);
+
+            {
+                Item second;
+                scoped.insert(2, second);
+            }
+
+            CHECK(scoped.size() == 1 && scoped.count(2) == 0);
+        }
+
+        // the map is gone, the node must not reach back into it
+        first.detach();
+
+        Map map;
+        bool threw = false;
+
+        try
+        {
+            *map.end();
+        }
+        catch(std::out_of_range&)
+        {
+            threw = true;
+        }
+
+        CHECK(threw);
+    }
+}
+
+void TestHashMap()
+{
+    RandomChanges();
+    Growth();
+    ReserveAndClear();
+    Lifetimes();
+}
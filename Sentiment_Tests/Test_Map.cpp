@@ -0,0 +1,318 @@
+// File: Test_Map.cpp
+// intrusive::map against std::map: order, bounds, insert_sorted, and nodes
+// leaving the tree on their own. The red-black rules are checked on the
+// hooks after every batch of changes. Also nodes in more maps than they
+// have inline hooks for, down to one destroyed at static destruction.
+
+#include "Root/Utility/Intrusive/Intrusive_map.h"
+#include "Tests.h"
+
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    struct Item :
+        public intrusive::dynamic_node
+    {
+    };
+
+    typedef intrusive::map<int, Item> Map;
+    typedef std::map<int, Item*> Reference;
+
+    // more maps than a node has inline hooks, so the node chains overflow
+    // tables. the maps are made first and the node is destroyed first, at
+    // static destruction, when the thread caches of the slab behind the
+    // tables are already gone
+    Map staticMaps[6];
+    Item staticItem;
+
+    Map::hook * HookOf(Map& map, intrusive::base_node * node)
+    {
+        return static_cast<Map::hook*>(node->get_hook(&map));
+    }
+
+    // the black height of the subtree under node, or -1 if a rule is broken
+    int BlackHeight(Map& map, intrusive::base_node * node, int low, int high)
+    {
+        if(node == nullptr)
+            return 1;
+
+        Map::hook * hook = HookOf(map, node);
+
+        if(hook->m_key < low || hook->m_key > high)
+            return -1;
+
+        intrusive::base_node * children[] = {hook->m_left, hook->m_right};
+
+        for(unsigned int i = 0; i < 2; ++i)
+        {
+            if(children[i] == nullptr)
+                continue;
+
+            if(HookOf(map, children[i])->m_parent != node)
+                return -1;
+
+            // a red node has black children
+            if(hook->m_red && HookOf(map, children[i])->m_red)
+                return -1;
+        }
+
+        int left = BlackHeight(map, hook->m_left, low, hook->m_key - 1);
+        int right = BlackHeight(map, hook->m_right, hook->m_key + 1, high);
+
+        if(left < 0 || left != right)
+            return -1;
+
+        return left + (hook->m_red ? 0 : 1);
+    }
+
+    bool IsRedBlack(Map& map)
+    {
+        if(map.is_empty())
+            return true;
+
+        intrusive::base_node * root = &*map.begin();
+
+        while(!HookOf(map, root)->m_parent->is_terminal())
+            root = HookOf(map, root)->m_parent;
+
+        return !HookOf(map, root)->m_red && BlackHeight(map, root, -1, 1 << 30) > 0;
+    }
+
+    bool SameContents(Map& map, const Reference& reference)
+    {
+        if(map.size() != long(reference.size()))
+            return false;
+
+        Map::iterator it = map.begin();
+
+        for(Reference::const_iterator r = reference.begin(); r != reference.end(); ++r, ++it)
+            if(it == map.end() || it.key() != r->first || &*it != r->second)
+                return false;
+
+        if(it != map.end())
+            return false;
+
+        // and backwards, from the last element to rend()
+        it = map.rbegin();
+
+        for(Reference::const_reverse_iterator r = reference.rbegin(); r != reference.rend(); ++r, --it)
+            if(it == map.rend() || it.key() != r->first)
+                return false;
+
+        return it == map.rend();
+    }
+
+    void RandomChanges()
+    {
+        const int COUNT = 2000;
+
+        std::vector<Item> items(COUNT);
+        Map map;
+        Reference reference;
+        std::mt19937 random(5);
+
+        for(int round = 0; round < 20000; ++round)
+        {
+            int key = int(random() % COUNT);
+
+            switch(random() % 3)
+            {
+            case 0:
+            case 1:
+                CHECK(map.insert(key, items[key]).second == reference.insert(std::make_pair(key, &items[key])).second);
+                break;
+
+            default:
+                CHECK(map.remove(key) == (reference.erase(key) == 1));
+                break;
+            }
+
+            if(round % 500 == 0)
+            {
+                CHECK(SameContents(map, reference));
+                CHECK(IsRedBlack(map));
+            }
+        }
+
+        CHECK(SameContents(map, reference));
+        CHECK(IsRedBlack(map));
+
+        map.clear();
+        CHECK(map.is_empty() && map.begin() == map.end());
+    }
+
+    void Bounds()
+    {
+        std::vector<Item> items(100);
+        Map map;
+        Reference reference;
+
+        // even keys only, so odd keys fall between elements
+        for(int key = 0; key < 200; key += 2)
+        {
+            map.insert(key, items[key / 2]);
+            reference[key] = &items[key / 2];
+        }
+
+        for(int key = -1; key <= 200; ++key)
+        {
+            Map::iterator lower = map.lower_bound(key);
+            Reference::iterator lowerRef = reference.lower_bound(key);
+
+            CHECK((lower == map.end()) == (lowerRef == reference.end()));
+            CHECK(lowerRef == reference.end() || lower.key() == lowerRef->first);
+
+            Map::iterator upper = map.upper_bound(key);
+            Reference::iterator upperRef = reference.upper_bound(key);
+
+            CHECK((upper == map.end()) == (upperRef == reference.end()));
+            CHECK(upperRef == reference.end() || upper.key() == upperRef->first);
+
+            std::pair<Map::iterator, Map::iterator> range = map.equal_range(key);
+            long count = 0;
+
+            for(Map::iterator it = range.first; it != range.second; ++it)
+                ++count;
+
+            CHECK(count == long(reference.count(key)));
+            CHECK((map.find(key) != map.end()) == (reference.count(key) == 1));
+        }
+    }
+
+    void InsertSorted()
+    {
+        const int COUNT = 1000;
+
+        std::vector<Item> items(COUNT);
+        std::vector<std::pair<int, Item*> > run;
+        Map map;
+        Reference reference;
+
+        for(int key = 0; key < COUNT; ++key)
+        {
+            run.push_back(std::make_pair(key, &items[key]));
+            reference[key] = &items[key];
+        }
+
+        CHECK(map.insert_sorted(run.begin(), run.end()) == COUNT);
+        CHECK(SameContents(map, reference));
+        CHECK(IsRedBlack(map));
+
+        // keys that are there already are skipped
+        CHECK(map.insert_sorted(run.begin(), run.begin() + 10) == 0);
+        CHECK(map.size() == COUNT);
+
+        // and into a map that is not empty
+        Map sparse;
+
+        for(int key = 0; key < COUNT; key += 3)
+            sparse.insert(key, items[key]);
+
+        CHECK(sparse.insert_sorted(run.begin(), run.end()) == COUNT - (COUNT + 2) / 3);
+        CHECK(SameContents(sparse, reference));
+        CHECK(IsRedBlack(sparse));
+    }
+
+    void DetachWhileInTree()
+    {
+        const int COUNT = 500;
+
+        std::vector<Item> items(COUNT);
+        Map map;
+        Reference reference;
+
+        for(int key = 0; key < COUNT; ++key)
+        {
+            map.insert(key, items[key]);
+            reference[key] = &items[key];
+        }
+
+        // nodes leaving on their own, in and out of the middle of the tree
+        for(int key = 0; key < COUNT; key += 2)
+        {
+            items[key].detach();
+            reference.erase(key);
+        }
+
+        CHECK(SameContents(map, reference));
+        CHECK(IsRedBlack(map));
+
+        for(Map::iterator it = map.begin(); it != map.end(); )
+            it = map.erase(it);
+
+        CHECK(map.is_empty());
+
+        // a node destroyed while in the map, and a map destroyed before
+        // its node
+        {
+            Item first;
+
+            {
+                Map scoped;
+                scoped.insert(1, first);
+
+                {
+                    Item second;
+                    scoped.insert(2, second);
+                }
+
+                CHECK(scoped.size() == 1 && scoped.begin().key() == 1);
+            }
+        }
+
+        bool threw = false;
+
+        try
+        {
+            *map.end();
+        }
+        catch(std::out_of_range&)
+        {
+            threw = true;
+        }
+
+        CHECK(threw);
+    }
+
+    void ManyMaps()
+    {
+        Item item;
+
+        {
+            Map maps[8];
+
+            for(int i = 0; i < 8; ++i)
+                CHECK(maps[i].insert(i, item).second);
+
+            bool found = true;
+
+            for(int i = 0; i < 8; ++i)
+                found = found && maps[i].find(i) != maps[i].end() && &*maps[i].find(i) == &item;
+
+            CHECK(found);
+
+            // leaving one in the middle leaves the others alone
+            maps[4].remove(4);
+            CHECK(maps[4].is_empty() && maps[5].size() == 1 && maps[7].size() == 1);
+        }
+
+        for(int i = 0; i < 6; ++i)
+            staticMaps[i].insert(i, staticItem);
+
+        CHECK(staticMaps[5].begin() != staticMaps[5].end() && &*staticMaps[5].begin() == &staticItem);
+    }
+}
+
+void TestMap()
+{
+    RandomChanges();
+    Bounds();
+    InsertSorted();
+    DetachWhileInTree();
+    ManyMaps();
+}
@@ -0,0 +1,174 @@
+// File: Test_MemberList.cpp
+// intrusive::member_list: one element in two lists through two hooks,
+// walking both ways, and hooks and lists unlinking when they go away. The
+// element is a node, as the render nodes these lists are for are.
+
+#include "Root/Utility/Intrusive/Intrusive_member_list.h"
+#include "Tests.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // derived from the base of every node<TDerived>, so polymorphic and
+    // not standard layout, like the Render node
+    struct Render :
+        public intrusive::dynamic_node
+    {
+        int value;
+        intrusive::list_member_hook draw_hook;
+        intrusive::list_member_hook update_hook;
+    };
+
+    typedef intrusive::member_list<Render, &Render::draw_hook> DrawList;
+    typedef intrusive::member_list<Render, &Render::update_hook> UpdateList;
+
+    // the values front to back as decimal digits, 0 for an empty list
+    template<class TList>
+    long Digits(TList& list)
+    {
+        long digits = 0;
+
+        for(typename TList::iterator it = list.begin(); it != list.end(); ++it)
+            digits = digits * 10 + it->value;
+
+        return digits;
+    }
+
+    template<class TList>
+    long DigitsBackwards(TList& list)
+    {
+        long digits = 0;
+
+        for(typename TList::iterator it = list.end(); it != list.begin(); )
+        {
+            --it;
+            digits = digits * 10 + it->value;
+        }
+
+        return digits;
+    }
+
+    void TwoLists()
+    {
+        std::vector<Render> renders(5);
+        DrawList draw;
+        UpdateList update;
+
+        for(int i = 0; i < 5; ++i)
+        {
+            renders[i].value = i + 1;
+            draw.push_back(renders[i]);
+
+            if(i % 2 == 0)
+                update.push_front(renders[i]);
+        }
+
+        CHECK(Digits(draw) == 12345);
+        CHECK(DigitsBackwards(draw) == 54321);
+        CHECK(Digits(update) == 531);
+        CHECK(draw.size() == 5 && update.size() == 3);
+        CHECK(draw.front().value == 1 && draw.back().value == 5);
+
+        // leaving one list leaves the other alone
+        draw.remove(renders[2]);
+        CHECK(Digits(draw) == 1245);
+        CHECK(Digits(update) == 531);
+
+        DrawList::iterator next = draw.erase(DrawList::iterator_to(renders[0]));
+        CHECK(next->value == 2);
+
+        draw.pop_back();
+        update.pop_front();
+        CHECK(Digits(draw) == 24);
+        CHECK(Digits(update) == 31);
+
+        draw.insert(DrawList::iterator_to(renders[3]), renders[2]);
+        CHECK(Digits(draw) == 234);
+
+        bool threw = false;
+
+        try
+        {
+            draw.push_back(renders[3]);
+        }
+        catch(std::logic_error&)
+        {
+            threw = true;
+        }
+
+        CHECK(threw);
+
+        draw.clear();
+        CHECK(draw.is_empty() && draw.size() == 0);
+        CHECK(!renders[1].draw_hook.is_linked());
+        CHECK(Digits(update) == 31);
+    }
+
+    void Copies()
+    {
+        DrawList draw;
+        Render original;
+        original.value = 1;
+        draw.push_back(original);
+
+        // a copy is not in the lists of the original
+        Render copy = original;
+        CHECK(!copy.draw_hook.is_linked());
+
+        copy = original;
+        CHECK(!copy.draw_hook.is_linked());
+        CHECK(draw.size() == 1);
+    }
+
+    void Lifetimes()
+    {
+        DrawList draw;
+
+        {
+            std::vector<Render> renders(3);
+
+            for(int i = 0; i < 3; ++i)
+            {
+                renders[i].value = i + 1;
+                draw.push_back(renders[i]);
+            }
+
+            CHECK(draw.size() == 3);
+        }
+
+        // the elements took themselves out when they were destroyed
+        CHECK(draw.is_empty());
+
+        Render render;
+
+        {
+            DrawList scoped;
+            scoped.push_back(render);
+        }
+
+        // and the list unlinked the element when it was
+        CHECK(!render.draw_hook.is_linked());
+
+        bool threw = false;
+
+        try
+        {
+            draw.front();
+        }
+        catch(std::out_of_range&)
+        {
+            threw = true;
+        }
+
+        CHECK(threw);
+    }
+}
+
+void TestMemberList()
+{
+    TwoLists();
+    Copies();
+    Lifetimes();
+}
@@ -0,0 +1,190 @@
+// File: Test_Queues.cpp
+// intrusive::mpsc_queue and intrusive::atomic_stack, alone and with
+// several threads at once: order per producer, nothing lost, nothing
+// handed out twice.
+
+#include "Root/Utility/Intrusive/Intrusive_mpsc_queue.h"
+#include "Root/Utility/Intrusive/Intrusive_stack.h"
+#include "Tests.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const int THREADS = 4;
+
+    // polymorphic and derived, like the nodes, so not standard layout
+    struct Envelope
+    {
+        virtual ~Envelope() {}
+
+        int producer;
+    };
+
+    struct Message :
+        public Envelope
+    {
+        int sequence;
+        intrusive::mpsc_queue_hook queue_hook;
+        intrusive::stack_hook stack_hook;
+    };
+
+    typedef intrusive::mpsc_queue<Message, &Message::queue_hook> Queue;
+    typedef intrusive::atomic_stack<Message, &Message::stack_hook> Stack;
+
+    void QueueAlone()
+    {
+        std::vector<Message> messages(3);
+        Queue queue;
+
+        CHECK(queue.is_empty() && queue.pop() == nullptr);
+
+        for(unsigned int i = 0; i < messages.size(); ++i)
+            queue.push(messages[i]);
+
+        CHECK(!queue.is_empty());
+        CHECK(queue.pop() == &messages[0]);
+
+        // a popped element can go back in, behind the others
+        queue.push(messages[0]);
+
+        CHECK(queue.pop() == &messages[1]);
+        CHECK(queue.pop() == &messages[2]);
+        CHECK(queue.pop() == &messages[0]);
+        CHECK(queue.pop() == nullptr && queue.is_empty());
+
+        // and the queue works again once it ran dry
+        queue.push(messages[1]);
+        CHECK(queue.pop() == &messages[1]);
+        CHECK(queue.pop() == nullptr);
+    }
+
+    void QueueProducers()
+    {
+        const int PER_THREAD = 20000;
+
+        std::vector<Message> messages(THREADS * PER_THREAD);
+        std::vector<std::thread> producers;
+        Queue queue;
+
+        for(int p = 0; p < THREADS; ++p)
+        {
+            producers.push_back(std::thread([&messages, &queue, p]()
+            {
+                for(int i = 0; i < PER_THREAD; ++i)
+                {
+                    Message& message = messages[p * PER_THREAD + i];
+                    message.producer = p;
+                    message.sequence = i;
+
+                    queue.push(message);
+                }
+            }));
+        }
+
+        // each producer's messages come out in the order it pushed them
+        std::vector<int> last(THREADS, -1);
+        bool ordered = true;
+        long received = 0;
+
+        while(received < long(messages.size()))
+        {
+            Message * message = queue.pop();
+
+            if(message == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            ordered = ordered && message->sequence == last[message->producer] + 1;
+            last[message->producer] = message->sequence;
+            ++received;
+        }
+
+        for(unsigned int i = 0; i < producers.size(); ++i)
+            producers[i].join();
+
+        CHECK(ordered);
+        CHECK(queue.pop() == nullptr && queue.is_empty());
+    }
+
+    void StackAlone()
+    {
+        std::vector<Message> messages(3);
+        Stack stack;
+
+        CHECK(stack.is_empty() && stack.pop() == nullptr);
+
+        for(unsigned int i = 0; i < messages.size(); ++i)
+            stack.push(messages[i]);
+
+        CHECK(stack.pop() == &messages[2]);
+        CHECK(stack.pop() == &messages[1]);
+
+        stack.push(messages[2]);
+
+        // newest first
+        std::vector<Message*> drained;
+        long count = stack.drain([&drained](Message& message) {drained.push_back(&message);});
+
+        CHECK(count == 2);
+        CHECK(drained.size() == 2 && drained[0] == &messages[2] && drained[1] == &messages[0]);
+        CHECK(stack.is_empty() && stack.drain([](Message&) {}) == 0);
+    }
+
+    void StackThreads()
+    {
+        const int OPERATIONS = 50000;
+
+        std::vector<Message> messages(THREADS * 1000);
+        std::vector<std::thread> threads;
+        Stack stack;
+
+        for(unsigned int i = 0; i < messages.size(); ++i)
+            stack.push(messages[i]);
+
+        // popping and pushing back at once is where ABA would strike
+        for(int t = 0; t < THREADS; ++t)
+        {
+            threads.push_back(std::thread([&stack]()
+            {
+                for(int i = 0; i < OPERATIONS; ++i)
+                {
+                    Message * message = stack.pop();
+
+                    if(message != nullptr)
+                        stack.push(*message);
+                }
+            }));
+        }
+
+        for(unsigned int i = 0; i < threads.size(); ++i)
+            threads[i].join();
+
+        // every element is still there, once
+        std::vector<char> seen(messages.size(), 0);
+        bool unique = true;
+
+        long count = stack.drain([&](Message& message)
+        {
+            char& mark = seen[&message - messages.data()];
+
+            unique = unique && mark == 0;
+            mark = 1;
+        });
+
+        CHECK(unique);
+        CHECK(count == long(messages.size()));
+        CHECK(stack.is_empty());
+    }
+}
+
+void TestQueues()
+{
+    QueueAlone();
+    QueueProducers();
+    StackAlone();
+    StackThreads();
+}
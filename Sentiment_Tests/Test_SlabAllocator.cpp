@@ -0,0 +1,124 @@
+// File: Test_SlabAllocator.cpp
+// SlabAllocator: blocks are distinct, aligned and reused, the thread caches
+// hand blocks back when their thread exits, and blocks freed after the
+// caches are gone take the locked path instead of a dead cache.
+
+#include "Root/Utility/SlabAllocator/SlabAllocator.h"
+#include "Tests.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const std::uint64_t BLOCKS_TYPE = 0xB10C5u;
+    const std::uint64_t LATE_TYPE = 0x5EA1A7E5u;
+
+    // frees a block when it is destroyed, which for a static is after the
+    // main thread's caches are gone. only a sanitizer build sees it go
+    // wrong, the run is over by then
+    struct LateFree
+    {
+        SlabAllocator* allocator;
+        void* block;
+
+        ~LateFree()
+        {
+            if(block == nullptr)
+                return;
+
+            allocator->DeallocateCached(block);
+
+            // and allocating works as well
+            allocator->DeallocateCached(allocator->AllocateCached());
+        }
+    };
+
+    LateFree lateStatic = {nullptr, nullptr};
+
+    void Blocks()
+    {
+        // the main thread's cache keeps blocks until the program ends, so
+        // cached blocks come from an allocator that is never destroyed
+        SlabAllocator& allocator = SlabAllocator::ForType(BLOCKS_TYPE, 24, 16);
+        std::vector<void*> blocks;
+
+        // more than a slab of 64 KiB, through both paths
+        for(int i = 0; i < 3000; ++i)
+            blocks.push_back(i % 2 ? allocator.Allocate() : allocator.AllocateCached());
+
+        std::vector<void*> sorted(blocks);
+        std::sort(sorted.begin(), sorted.end());
+
+        CHECK(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+        CHECK(allocator.SlabCount() > 1);
+
+        bool aligned = true;
+
+        for(unsigned int i = 0; i < blocks.size(); ++i)
+            aligned = aligned && reinterpret_cast<std::uintptr_t>(blocks[i]) % 16 == 0;
+
+        CHECK(aligned);
+
+        // the last block given back is the first one handed out
+        allocator.Deallocate(blocks[7]);
+        CHECK(allocator.Allocate() == blocks[7]);
+
+        for(unsigned int i = 0; i < blocks.size(); ++i)
+            allocator.DeallocateCached(blocks[i]);
+
+        long slabs = allocator.SlabCount();
+
+        for(unsigned int i = 0; i < blocks.size(); ++i)
+            blocks[i] = allocator.AllocateCached();
+
+        CHECK(allocator.SlabCount() == slabs);
+
+        for(unsigned int i = 0; i < blocks.size(); ++i)
+            allocator.Deallocate(blocks[i]);
+    }
+
+    void ThreadExit()
+    {
+        SlabAllocator allocator(32, 8);
+        void* late = nullptr;
+
+        std::thread worker([&allocator, &late]()
+        {
+            // made before the caches, so destroyed after them
+            thread_local LateFree lateLocal = {nullptr, nullptr};
+
+            lateLocal.allocator = &allocator;
+            lateLocal.block = allocator.AllocateCached();
+            late = lateLocal.block;
+
+            // some traffic for the cache to flush
+            std::vector<void*> blocks;
+
+            for(int i = 0; i < 100; ++i)
+                blocks.push_back(allocator.AllocateCached());
+
+            for(unsigned int i = 0; i < blocks.size(); ++i)
+                allocator.DeallocateCached(blocks[i]);
+        });
+
+        worker.join();
+
+        // the late block went straight to the free list, after the cache
+        // flush, where a dead cache would have swallowed it
+        CHECK(late != nullptr && allocator.Allocate() == late);
+    }
+}
+
+void TestSlabAllocator()
+{
+    Blocks();
+    ThreadExit();
+
+    SlabAllocator& allocator = SlabAllocator::ForType(LATE_TYPE, 40, 8);
+
+    lateStatic.allocator = &allocator;
+    lateStatic.block = allocator.AllocateCached();
+}
@@ -0,0 +1,491 @@
+// File: Test_Snapshot.cpp
+// World::SaveSnapshot and World::LoadSnapshot: a save and load gives back
+// the same entities, components, tags, names and handle generations,
+// whether the chunks are used in place or copied column by column. Damaged
+// files are turned down and leave the World empty, and adopted chunks take
+// structural changes like any other.
+
+#include "Root/Engine/Entity System/Entity_Engine.h"
+#include "Tests.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Position :
+        public component<Position>
+    {
+        float x, y, z;
+    };
+
+    struct Health :
+        public component<Health>
+    {
+        int points;
+    };
+
+    struct Hot :
+        public tag<Hot>
+    {
+    };
+
+    struct Cold :
+        public tag<Cold>
+    {
+    };
+
+    const char SAVED[] = "Test_Snapshot.snap";
+    const char RESAVED[] = "Test_Snapshot_resaved.snap";
+    const char DAMAGED[] = "Test_Snapshot_damaged.snap";
+
+    // where things are in the file as Snapshot.cpp lays it out, to damage
+    // it on purpose
+    const std::size_t HEADER_VERSION = 8;
+    const std::size_t HEADER_TYPE_COUNT = 20;
+    const std::size_t HEADER_SLOT_COUNT = 24;
+    const std::size_t HEADER_ARCHETYPE_COUNT = 32;
+    const std::size_t HEADER_FILE_SIZE = 64;
+    const std::size_t HEADER_BYTES = 72;
+    const std::size_t TYPE_NAME_LENGTH = 24;
+    const std::size_t TYPE_BYTES = 32;
+    const std::size_t ARCHETYPE_CHUNK_COUNT = 4;
+    const std::size_t ARCHETYPE_CAPACITY = 8;
+    const std::size_t ARCHETYPE_CHUNK_BYTES = 16;
+    const std::size_t ARCHETYPE_BYTES = 24;
+    const std::size_t COLUMN_BYTES = 16;
+    const std::size_t CHUNK_COUNT = 8;
+    const std::size_t CHUNK_BYTES = 16;
+
+    std::string ReadFile(const char* fileName)
+    {
+        std::ifstream file(fileName, std::ios::binary);
+
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void WriteFile(const char* fileName, const std::string& bytes)
+    {
+        std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), bytes.size());
+    }
+
+    template<class T>
+    T Get(const std::string& bytes, std::size_t offset)
+    {
+        T value;
+        std::memcpy(&value, bytes.data() + offset, sizeof(T));
+
+        return value;
+    }
+
+    template<class T>
+    void Set(std::string& bytes, std::size_t offset, T value)
+    {
+        std::memcpy(&bytes[offset], &value, sizeof(T));
+    }
+
+    // offset of every SnapshotArchetype in the archetype table
+    std::vector<std::size_t> Archetypes(const std::string& bytes)
+    {
+        std::size_t offset = HEADER_BYTES;
+
+        for(std::uint32_t i = 0; i < Get<std::uint32_t>(bytes, HEADER_TYPE_COUNT); ++i)
+            offset += TYPE_BYTES + Get<std::uint32_t>(bytes, offset + TYPE_NAME_LENGTH);
+
+        offset += Get<std::uint64_t>(bytes, HEADER_SLOT_COUNT) * sizeof(EntityHandle);
+
+        std::vector<std::size_t> archetypes;
+
+        for(std::uint64_t i = 0; i < Get<std::uint64_t>(bytes, HEADER_ARCHETYPE_COUNT); ++i)
+        {
+            archetypes.push_back(offset);
+            offset += ARCHETYPE_BYTES + Get<std::uint32_t>(bytes, offset) * COLUMN_BYTES +
+                      Get<std::uint32_t>(bytes, offset + ARCHETYPE_CHUNK_COUNT) * CHUNK_BYTES;
+        }
+
+        return archetypes;
+    }
+
+    // the first SnapshotChunk of an archetype
+    std::size_t FirstChunk(const std::string& bytes, std::size_t archetype)
+    {
+        return archetype + ARCHETYPE_BYTES + Get<std::uint32_t>(bytes, archetype) * COLUMN_BYTES;
+    }
+
+    // a few thousand entities over two archetypes, several chunks each, with
+    // dead slots and slots on their second generation
+    void Build(World& world, std::vector<EntityHandle>& handles)
+    {
+        for(int i = 0; i < 3000; ++i)
+        {
+            EntityHandle entity = world.CreateEntity();
+            handles.push_back(entity);
+
+            Position& position = world.CreateComponent<Position>(entity);
+            position.x = float(i);
+            position.y = float(i) * 0.5f;
+            position.z = -float(i);
+
+            if(i % 3 == 0)
+                world.CreateComponent<Health>(entity).points = i * 7;
+
+            if(i % 2 == 0)
+                world.AddTag<Hot>(entity);
+
+            if(i % 5 == 0)
+                world.AddTag<Cold>(entity);
+
+            if(i % 100 == 0)
+                world.SetName(entity, "entity " + std::to_string(i));
+        }
+
+        for(int i = 0; i < 3000; i += 7)
+            world.RemoveEntity(handles[i]);
+
+        for(int i = 0; i < 200; ++i)
+        {
+            EntityHandle entity = world.CreateEntity();
+            handles.push_back(entity);
+
+            world.CreateComponent<Position>(entity).x = -1.0f - float(i);
+            world.AddTag<Cold>(entity);
+        }
+    }
+
+    // a in lhs and b in rhs have the same components, tags and name
+    bool SameEntity(World& lhs, EntityHandle a, World& rhs, EntityHandle b)
+    {
+        if(lhs.IsAlive(a) != rhs.IsAlive(b))
+            return false;
+
+        if(!lhs.IsAlive(a))
+            return true;
+
+        Position * positionA = lhs.GetComponent<Position>(a);
+        Position * positionB = rhs.GetComponent<Position>(b);
+
+        if((positionA == nullptr) != (positionB == nullptr) ||
+           (positionA != nullptr && (positionA->x != positionB->x || positionA->y != positionB->y || positionA->z != positionB->z)))
+            return false;
+
+        Health * healthA = lhs.GetComponent<Health>(a);
+        Health * healthB = rhs.GetComponent<Health>(b);
+
+        if((healthA == nullptr) != (healthB == nullptr) || (healthA != nullptr && healthA->points != healthB->points))
+            return false;
+
+        return lhs.HasTag<Hot>(a) == rhs.HasTag<Hot>(b) &&
+               lhs.HasTag<Cold>(a) == rhs.HasTag<Cold>(b) &&
+               lhs.GetName(a) == rhs.GetName(b);
+    }
+
+    bool SameWorld(World& lhs, World& rhs, const std::vector<EntityHandle>& handles)
+    {
+        if(lhs.EntityCount() != rhs.EntityCount())
+            return false;
+
+        for(unsigned int i = 0; i < handles.size(); ++i)
+            if(!SameEntity(lhs, handles[i], rhs, handles[i]))
+                return false;
+
+        return true;
+    }
+
+    // the same changes to a World and to one loaded from its snapshot. the
+    // entities created get different handles in each, so they are returned
+    void Change(World& world, const std::vector<EntityHandle>& handles, std::vector<EntityHandle>& created)
+    {
+        for(unsigned int i = 0; i < handles.size(); ++i)
+        {
+            EntityHandle entity = handles[i];
+
+            if(!world.IsAlive(entity))
+                continue;
+
+            if(i % 4 == 1)
+            {
+                world.RemoveEntity(entity);
+                continue;
+            }
+
+            if(i % 3 == 1)
+                world.CreateComponent<Health>(entity).points = -int(i);
+            else if(i % 6 == 0)
+                world.RemoveComponent<Health>(entity);
+
+            if(i % 11 == 0)
+                world.AddTag<Cold>(entity);
+
+            if(i % 13 == 0)
+                world.RemoveTag<Hot>(entity);
+
+            if(i % 17 == 0)
+                world.GetComponent<Position>(entity)->y += 1.0f;
+        }
+
+        for(int i = 0; i < 50; ++i)
+        {
+            EntityHandle entity = world.CreateEntity("created " + std::to_string(i));
+            created.push_back(entity);
+
+            world.CreateComponent<Position>(entity).z = float(i);
+            world.AddTag<Hot>(entity);
+        }
+    }
+
+    // LoadSnapshot throws std::runtime_error and leaves the World empty
+    bool Rejects(const std::string& bytes)
+    {
+        WriteFile(DAMAGED, bytes);
+
+        World world;
+
+        try
+        {
+            world.LoadSnapshot(DAMAGED);
+        }
+        catch(std::runtime_error&)
+        {
+            return world.EntityCount() == 0 && world.GetMemoryStats().chunkCount == 0;
+        }
+
+        return false;
+    }
+
+    void RoundTrip()
+    {
+        World world;
+        std::vector<EntityHandle> handles;
+        Build(world, handles);
+
+        world.SaveSnapshot(SAVED);
+
+        // the chunks are used in place, nothing is owned by the World
+        World adopted;
+        adopted.LoadSnapshot(SAVED);
+
+        World::MemoryStats stats = adopted.GetMemoryStats();
+        CHECK(stats.chunkCount > 4 && stats.chunkBytes == 0);
+        CHECK(SameWorld(world, adopted, handles));
+        CHECK(adopted.FindEntity("entity 100") == handles[100]);
+        CHECK(adopted.FindEntity("entity 0").IsNull());
+
+        // handles of removed entities stay stale, also once their slots are
+        // handed out again
+        CHECK(!adopted.IsAlive(handles[7]));
+
+        std::vector<EntityHandle> fresh;
+
+        for(int i = 0; i < 500; ++i)
+            fresh.push_back(adopted.CreateEntity());
+
+        bool stale = true;
+
+        for(unsigned int i = 0; i < handles.size(); ++i)
+            stale = stale && adopted.IsAlive(handles[i]) == world.IsAlive(handles[i]);
+
+        CHECK(stale);
+        CHECK(adopted.EntityCount() == world.EntityCount() + 500);
+
+        // a chunk size this build does not use makes the load copy every
+        // chunk column by column. taking a byte off is harmless, the data
+        // ends before that
+        std::string bytes = ReadFile(SAVED);
+        std::vector<std::size_t> archetypes = Archetypes(bytes);
+
+        for(unsigned int i = 0; i < archetypes.size(); ++i)
+            Set<std::uint64_t>(bytes, archetypes[i] + ARCHETYPE_CHUNK_BYTES, Get<std::uint64_t>(bytes, archetypes[i] + ARCHETYPE_CHUNK_BYTES) - 1);
+
+        WriteFile(RESAVED, bytes);
+
+        World copied;
+        copied.LoadSnapshot(RESAVED);
+
+        stats = copied.GetMemoryStats();
+        CHECK(stats.chunkCount > 4 && stats.chunkBytes >= stats.chunkCount * Archetype::CHUNK_SIZE);
+        CHECK(SameWorld(world, copied, handles));
+        CHECK(copied.FindEntity("entity 2900") == handles[2900]);
+
+        // saving what was loaded gives the same World again
+        copied.SaveSnapshot(RESAVED);
+
+        World again;
+        again.LoadSnapshot(RESAVED);
+        CHECK(SameWorld(world, again, handles));
+
+        // only into an empty World
+        bool threw = false;
+
+        try
+        {
+            again.LoadSnapshot(SAVED);
+        }
+        catch(std::logic_error&)
+        {
+            threw = true;
+        }
+
+        CHECK(threw);
+    }
+
+    void BorrowedChanges()
+    {
+        World world;
+        std::vector<EntityHandle> handles;
+        Build(world, handles);
+
+        world.SaveSnapshot(SAVED);
+
+        World loaded;
+        loaded.LoadSnapshot(SAVED);
+
+        // removing rows moves the last row of the chunk over them, adding and
+        // removing components moves entities out of the adopted chunks and
+        // new entities fill up the last one
+        std::vector<EntityHandle> created;
+        std::vector<EntityHandle> createdLoaded;
+
+        Change(world, handles, created);
+        Change(loaded, handles, createdLoaded);
+
+        CHECK(SameWorld(world, loaded, handles));
+
+        bool same = true;
+
+        for(unsigned int i = 0; i < created.size(); ++i)
+            same = same && SameEntity(world, created[i], loaded, createdLoaded[i]);
+
+        CHECK(same);
+
+        // emptied adopted chunks are dropped, not freed
+        loaded.Compact(0);
+        CHECK(SameWorld(world, loaded, handles));
+
+        handles.insert(handles.end(), createdLoaded.begin(), createdLoaded.end());
+
+        loaded.SaveSnapshot(RESAVED);
+
+        World resaved;
+        resaved.LoadSnapshot(RESAVED);
+        CHECK(SameWorld(loaded, resaved, handles));
+
+        // the pages written to were private copies, the file is as it was
+        handles.clear();
+
+        World rebuilt;
+        Build(rebuilt, handles);
+
+        World reloaded;
+        reloaded.LoadSnapshot(SAVED);
+        CHECK(SameWorld(rebuilt, reloaded, handles));
+    }
+
+    void Damaged()
+    {
+        World world;
+        std::vector<EntityHandle> handles;
+        Build(world, handles);
+
+        world.SaveSnapshot(SAVED);
+
+        const std::string saved = ReadFile(SAVED);
+        const std::size_t archetype = Archetypes(saved)[0];
+        const std::size_t chunk = FirstChunk(saved, archetype);
+        const std::size_t entities = std::size_t(Get<std::uint64_t>(saved, chunk));
+        const EntityHandle first = Get<EntityHandle>(saved, entities);
+
+        // cut short, by the size in the header and with the header fixed up
+        CHECK(Rejects(saved.substr(0, saved.size() / 2)));
+        CHECK(Rejects(saved.substr(0, HEADER_BYTES - 1)));
+
+        std::string bytes = saved.substr(0, entities + 64);
+        Set<std::uint64_t>(bytes, HEADER_FILE_SIZE, bytes.size());
+        CHECK(Rejects(bytes));
+
+        bytes = saved.substr(0, archetype + 4);
+        Set<std::uint64_t>(bytes, HEADER_FILE_SIZE, bytes.size());
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        bytes[0] = 'X';
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        Set<std::uint32_t>(bytes, HEADER_VERSION, 3);
+        CHECK(Rejects(bytes));
+
+        // a column type past the type table
+        bytes = saved;
+        Set<std::uint64_t>(bytes, archetype + ARCHETYPE_BYTES, 1000);
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        Set<std::uint64_t>(bytes, archetype + ARCHETYPE_CAPACITY, 0);
+        CHECK(Rejects(bytes));
+
+        // a chunk fuller than the archetype allows, one that is not aligned
+        // and one past the end of the file
+        bytes = saved;
+        Set<std::uint64_t>(bytes, chunk + CHUNK_COUNT, Get<std::uint64_t>(saved, archetype + ARCHETYPE_CAPACITY) + 1);
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        Set<std::uint64_t>(bytes, chunk, Get<std::uint64_t>(saved, chunk) + 8);
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        Set<std::uint64_t>(bytes, chunk, saved.size());
+        CHECK(Rejects(bytes));
+
+        // entity handles in the chunk that are out of range, of another
+        // generation or there twice
+        bytes = saved;
+        Set<EntityHandle>(bytes, entities, EntityHandle(Get<std::uint64_t>(saved, HEADER_SLOT_COUNT), 1));
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        Set<EntityHandle>(bytes, entities, EntityHandle(first.Index(), first.Generation() + 1));
+        CHECK(Rejects(bytes));
+
+        bytes = saved;
+        Set<EntityHandle>(bytes, entities + sizeof(EntityHandle), first);
+        CHECK(Rejects(bytes));
+
+        // and the file itself was fine
+        World loaded;
+        loaded.LoadSnapshot(SAVED);
+        CHECK(SameWorld(world, loaded, handles));
+
+        // nor is a file that is not there
+        World missing;
+        bool threw = false;
+
+        try
+        {
+            missing.LoadSnapshot("Test_Snapshot_missing.snap");
+        }
+        catch(std::runtime_error&)
+        {
+            threw = true;
+        }
+
+        CHECK(threw && missing.EntityCount() == 0);
+    }
+}
+
+void TestSnapshot()
+{
+    RoundTrip();
+    BorrowedChanges();
+    Damaged();
+
+    std::remove(SAVED);
+    std::remove(RESAVED);
+    std::remove(DAMAGED);
+}
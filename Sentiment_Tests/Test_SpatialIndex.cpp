@@ -0,0 +1,330 @@
+// File: Test_SpatialIndex.cpp
+// SpatialIndex against brute force over every box: box, sphere, frustum and
+// ray queries after random inserts, moves inside and past the tree margin,
+// removals and entities switching between the tree and the grid. The grid
+// cells hold enough boxes that their blocks of four are rarely full.
+
+#include "Root/Engine/Entity System/SpatialIndex.h"
+#include "Tests.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+    struct Entry
+    {
+        AABB box;
+        bool isStatic;
+    };
+
+    typedef std::map<EntityHandle, Entry> Reference;
+
+    float Random(std::mt19937& random, float low, float high)
+    {
+        return low + (high - low) * float(random() % 1000003) / 1000003.0f;
+    }
+
+    AABB RandomBox(std::mt19937& random, float low, float high, float size)
+    {
+        AABB box;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            box.min[i] = Random(random, low, high);
+            box.max[i] = box.min[i] + Random(random, 0.05f, size);
+        }
+
+        return box;
+    }
+
+    // small boxes, now and then one wider than a grid cell, which goes into
+    // the tree even when static
+    Entry RandomEntry(std::mt19937& random)
+    {
+        Entry entry;
+        entry.isStatic = random() % 2 == 0;
+        entry.box = RandomBox(random, -200.0f, 200.0f, random() % 50 == 0 ? 80.0f : 6.0f);
+
+        return entry;
+    }
+
+    bool InSphere(const AABB& box, const float center[3], float radius)
+    {
+        float distance = 0.0f;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            float d = std::max(std::max(box.min[i] - center[i], center[i] - box.max[i]), 0.0f);
+            distance += d * d;
+        }
+
+        return distance <= radius * radius;
+    }
+
+    bool InFrustum(const AABB& box, const Frustum& frustum)
+    {
+        for(int p = 0; p < 6; ++p)
+        {
+            const Plane& plane = frustum.planes[p];
+            float furthest = plane.distance;
+
+            for(int i = 0; i < 3; ++i)
+                furthest += plane.normal[i] * (plane.normal[i] >= 0.0f ? box.max[i] : box.min[i]);
+
+            if(furthest < 0.0f)
+                return false;
+        }
+
+        return true;
+    }
+
+    // slab test, the distance is where the ray enters the box
+    bool HitByRay(const AABB& box, const float origin[3], const float direction[3], float maxDistance, float& distance)
+    {
+        float enter = 0.0f;
+        float leave = maxDistance;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            float t1 = (box.min[i] - origin[i]) / direction[i];
+            float t2 = (box.max[i] - origin[i]) / direction[i];
+
+            enter = std::max(enter, std::min(t1, t2));
+            leave = std::min(leave, std::max(t1, t2));
+        }
+
+        distance = enter;
+
+        return enter <= leave;
+    }
+
+    template<class TTest>
+    std::vector<EntityHandle> BruteForce(const Reference& reference, const TTest& test)
+    {
+        std::vector<EntityHandle> results;
+
+        for(Reference::const_iterator it = reference.begin(); it != reference.end(); ++it)
+            if(test(it->second.box))
+                results.push_back(it->first);
+
+        return results;
+    }
+
+    // the same entities, each once, in any order
+    bool SameEntities(std::vector<EntityHandle> results, const std::vector<EntityHandle>& expected)
+    {
+        std::sort(results.begin(), results.end());
+
+        return results == expected;
+    }
+
+    bool SameHits(const std::vector<RayHit>& results, const std::vector<RayHit>& expected)
+    {
+        if(results.size() != expected.size())
+            return false;
+
+        for(unsigned int i = 1; i < results.size(); ++i)
+            if(results[i].distance < results[i - 1].distance)
+                return false;
+
+        std::map<EntityHandle, float> distances;
+
+        for(unsigned int i = 0; i < expected.size(); ++i)
+            distances[expected[i].entity] = expected[i].distance;
+
+        for(unsigned int i = 0; i < results.size(); ++i)
+        {
+            std::map<EntityHandle, float>::iterator found = distances.find(results[i].entity);
+
+            if(found == distances.end() || std::fabs(found->second - results[i].distance) > 1e-3f * (1.0f + found->second))
+                return false;
+
+            distances.erase(found);
+        }
+
+        return true;
+    }
+
+    // six planes facing inwards around a random point, tilted so they are
+    // not just a box
+    Frustum RandomFrustum(std::mt19937& random)
+    {
+        Frustum frustum;
+        float center[3] = {Random(random, -150.0f, 150.0f), Random(random, -150.0f, 150.0f), Random(random, -150.0f, 150.0f)};
+
+        for(int p = 0; p < 6; ++p)
+        {
+            Plane& plane = frustum.planes[p];
+            float length = 0.0f;
+
+            for(int i = 0; i < 3; ++i)
+            {
+                plane.normal[i] = (i == p / 2 ? (p % 2 ? -1.0f : 1.0f) : 0.0f) + Random(random, -0.4f, 0.4f);
+                length += plane.normal[i] * plane.normal[i];
+            }
+
+            length = std::sqrt(length);
+            plane.distance = Random(random, 10.0f, 60.0f);
+
+            for(int i = 0; i < 3; ++i)
+            {
+                plane.normal[i] /= length;
+                plane.distance -= plane.normal[i] * center[i];
+            }
+        }
+
+        return frustum;
+    }
+
+    bool Queries(const SpatialIndex& index, const Reference& reference, std::mt19937& random)
+    {
+        bool passed = true;
+
+        for(int query = 0; query < 40 && passed; ++query)
+        {
+            std::vector<EntityHandle> results;
+
+            AABB box = RandomBox(random, -220.0f, 200.0f, query % 4 == 0 ? 120.0f : 30.0f);
+            index.QueryBox(box, results);
+            passed = passed && SameEntities(results, BruteForce(reference, [&](const AABB& other) {return other.Overlaps(box);}));
+
+            float center[3] = {Random(random, -200.0f, 200.0f), Random(random, -200.0f, 200.0f), Random(random, -200.0f, 200.0f)};
+            float radius = Random(random, 0.0f, query % 4 == 0 ? 100.0f : 20.0f);
+
+            results.clear();
+            index.QuerySphere(center, radius, results);
+            passed = passed && SameEntities(results, BruteForce(reference, [&](const AABB& other) {return InSphere(other, center, radius);}));
+
+            Frustum frustum = RandomFrustum(random);
+
+            results.clear();
+            index.QueryFrustum(frustum, results);
+            passed = passed && SameEntities(results, BruteForce(reference, [&](const AABB& other) {return InFrustum(other, frustum);}));
+
+            // rays from anywhere, some of them axis parallel
+            float origin[3] = {Random(random, -250.0f, 250.0f), Random(random, -250.0f, 250.0f), Random(random, -250.0f, 250.0f)};
+            float direction[3];
+            float length = 0.0f;
+
+            for(int i = 0; i < 3; ++i)
+            {
+                direction[i] = (query % 5 == 0 && i != query % 3) ? 0.0f : Random(random, -1.0f, 1.0f);
+                length += direction[i] * direction[i];
+            }
+
+            length = std::sqrt(std::max(length, 1e-6f));
+
+            for(int i = 0; i < 3; ++i)
+                direction[i] = direction[i] != 0.0f ? direction[i] / length : 1e-30f;
+
+            float maxDistance = Random(random, 10.0f, 600.0f);
+
+            std::vector<RayHit> hits;
+            index.Raycast(origin, direction, maxDistance, hits);
+
+            std::vector<RayHit> expected;
+
+            for(Reference::const_iterator it = reference.begin(); it != reference.end(); ++it)
+            {
+                RayHit hit = {it->first, 0.0f};
+
+                if(HitByRay(it->second.box, origin, direction, maxDistance, hit.distance))
+                    expected.push_back(hit);
+            }
+
+            passed = passed && SameHits(hits, expected);
+        }
+
+        return passed;
+    }
+
+    void RandomChanges()
+    {
+        const int COUNT = 4000;
+
+        SpatialIndex index;
+        Reference reference;
+        std::mt19937 random(11);
+
+        for(int round = 0; round < 12; ++round)
+        {
+            int changes = round == 0 ? COUNT : 600;
+
+            for(int change = 0; change < changes; ++change)
+            {
+                EntityHandle entity(EntityHandle::value_type(random() % COUNT + 1), 1);
+                unsigned int operation = random() % 10;
+                Reference::iterator found = reference.find(entity);
+
+                if(round != 0 && operation < 2)
+                {
+                    index.Remove(entity);
+
+                    if(found != reference.end())
+                        reference.erase(found);
+
+                    continue;
+                }
+
+                Entry entry = RandomEntry(random);
+
+                // most moves are small, within the fattened leaf or the cell
+                if(found != reference.end() && operation < 8)
+                {
+                    entry = found->second;
+                    float step = operation < 5 ? 0.05f : 3.0f;
+
+                    for(int i = 0; i < 3; ++i)
+                    {
+                        float offset = Random(random, -step, step);
+                        entry.box.min[i] += offset;
+                        entry.box.max[i] += offset;
+                    }
+
+                    if(operation == 7)
+                        entry.isStatic = !entry.isStatic;
+                }
+
+                index.Set(entity, entry.box, entry.isStatic);
+                reference[entity] = entry;
+            }
+
+            CHECK(index.Size() == long(reference.size()));
+
+            bool contained = true;
+
+            for(int i = 1; i <= COUNT; ++i)
+            {
+                EntityHandle entity(EntityHandle::value_type(i), 1);
+                contained = contained && index.Contains(entity) == (reference.count(entity) == 1);
+            }
+
+            CHECK(contained);
+            CHECK(Queries(index, reference, random));
+        }
+
+        // a balanced tree, a few thousand leaves deep would mean it is not
+        CHECK(index.TreeHeight() > 0 && index.TreeHeight() < 40);
+
+        // a stale handle is not the entity in its slot
+        EntityHandle stale(reference.begin()->first.Index(), 2);
+        CHECK(!index.Contains(stale));
+        index.Remove(stale);
+        CHECK(index.Size() == long(reference.size()));
+
+        index.Clear();
+        reference.clear();
+
+        CHECK(index.Size() == 0 && index.TreeHeight() == 0);
+        CHECK(Queries(index, reference, random));
+    }
+}
+
+void TestSpatialIndex()
+{
+    RandomChanges();
+}
@@ -0,0 +1,328 @@
+// File: Test_TransformHierarchy.cpp
+// TransformHierarchy against a naive reference that multiplies each local
+// matrix into its parent's world matrix in double precision. Random edits,
+// reparenting and removals between updates keep Rebuild() busy, trees past
+// SPLIT_SIZE get split over the workers, and the counts are rarely a
+// multiple of the four rows Propagate() builds at once.
+
+#include "Root/Engine/Entity System/TransformHierarchy.h"
+#include "Root/Engine/Jobs/JobSystem.h"
+#include "Tests.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    struct Local
+    {
+        float position[3];
+        float rotation[4];
+        float scale[3];
+        EntityHandle parent;
+    };
+
+    typedef std::map<EntityHandle, Local> Reference;
+
+    float Random(std::mt19937& random)
+    {
+        return float(random() % 2001) / 1000.0f - 1.0f;
+    }
+
+    void RandomLocal(std::mt19937& random, Local& local)
+    {
+        float length;
+
+        do
+        {
+            length = 0.0f;
+
+            for(int i = 0; i < 4; ++i)
+            {
+                local.rotation[i] = Random(random);
+                length += local.rotation[i] * local.rotation[i];
+            }
+        }
+        while(length < 0.01f);
+
+        length = std::sqrt(length);
+
+        for(int i = 0; i < 4; ++i)
+            local.rotation[i] /= length;
+
+        for(int i = 0; i < 3; ++i)
+        {
+            local.position[i] = Random(random) * 3.0f;
+            local.scale[i] = 1.0f + Random(random) * 0.2f;
+        }
+    }
+
+    void Apply(TransformHierarchy& hierarchy, EntityHandle entity, const Local& local)
+    {
+        hierarchy.SetPosition(entity, local.position[0], local.position[1], local.position[2]);
+        hierarchy.SetRotation(entity, local.rotation[0], local.rotation[1], local.rotation[2], local.rotation[3]);
+        hierarchy.SetScale(entity, local.scale[0], local.scale[1], local.scale[2]);
+    }
+
+    // translation * rotation * scale, row major, for column vectors
+    void LocalMatrix(const Local& local, double m[16])
+    {
+        double x = local.rotation[0], y = local.rotation[1], z = local.rotation[2], w = local.rotation[3];
+        double rotation[9] = {1 - 2 * (y * y + z * z), 2 * (x * y - w * z),     2 * (x * z + w * y),
+                              2 * (x * y + w * z),     1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+                              2 * (x * z - w * y),     2 * (y * z + w * x),     1 - 2 * (x * x + y * y)};
+
+        for(int row = 0; row < 3; ++row)
+        {
+            for(int column = 0; column < 3; ++column)
+                m[row * 4 + column] = rotation[row * 3 + column] * local.scale[column];
+
+            m[row * 4 + 3] = local.position[row];
+        }
+
+        m[12] = m[13] = m[14] = 0.0;
+        m[15] = 1.0;
+    }
+
+    void WorldMatrix(const Reference& reference, EntityHandle entity, double m[16])
+    {
+        const Local& local = reference.find(entity)->second;
+        double own[16];
+        LocalMatrix(local, own);
+
+        if(local.parent.IsNull())
+        {
+            std::copy(own, own + 16, m);
+            return;
+        }
+
+        double parent[16];
+        WorldMatrix(reference, local.parent, parent);
+
+        for(int row = 0; row < 4; ++row)
+        {
+            for(int column = 0; column < 4; ++column)
+            {
+                double sum = 0.0;
+
+                for(int k = 0; k < 4; ++k)
+                    sum += parent[row * 4 + k] * own[k * 4 + column];
+
+                m[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    bool IsAncestor(const Reference& reference, EntityHandle ancestor, EntityHandle entity)
+    {
+        for( ; !entity.IsNull(); entity = reference.find(entity)->second.parent)
+            if(entity == ancestor)
+                return true;
+
+        return false;
+    }
+
+    // parents and world matrices as the reference has them, relative to the
+    // largest element of each matrix since deep chains drift far out
+    bool Matches(const TransformHierarchy& hierarchy, const Reference& reference)
+    {
+        if(hierarchy.Size() != long(reference.size()))
+            return false;
+
+        for(Reference::const_iterator it = reference.begin(); it != reference.end(); ++it)
+        {
+            const float* actual = hierarchy.WorldMatrix(it->first);
+
+            if(actual == nullptr || hierarchy.GetParent(it->first) != it->second.parent)
+                return false;
+
+            double expected[16];
+            WorldMatrix(reference, it->first, expected);
+
+            double largest = 1.0;
+
+            for(int i = 0; i < 16; ++i)
+                largest = std::max(largest, std::fabs(expected[i]));
+
+            for(int i = 0; i < 16; ++i)
+                if(std::fabs(expected[i] - actual[i]) > largest * 1e-4)
+                    return false;
+        }
+
+        return true;
+    }
+
+    EntityHandle Add(TransformHierarchy& hierarchy, Reference& reference, std::mt19937& random,
+                     std::vector<EntityHandle>& handles, EntityHandle parent)
+    {
+        EntityHandle entity(EntityHandle::value_type(handles.size() + 1), 1);
+        handles.push_back(entity);
+
+        hierarchy.Add(entity, parent);
+
+        Local& local = reference[entity];
+        RandomLocal(random, local);
+        local.parent = parent;
+
+        Apply(hierarchy, entity, local);
+
+        return entity;
+    }
+
+    void RandomChanges(IJobSystem * jobs)
+    {
+        TransformHierarchy hierarchy;
+        Reference reference;
+        std::vector<EntityHandle> handles;
+        std::mt19937 random(12);
+
+        // three trees well past SPLIT_SIZE, with chains a few hundred deep,
+        // and a scatter of small ones
+        for(int tree = 0; tree < 3; ++tree)
+        {
+            unsigned int root = (unsigned int)handles.size();
+            Add(hierarchy, reference, random, handles, EntityHandle());
+
+            for(int i = 1; i < 3001; ++i)
+            {
+                unsigned int parent = random() % 3 == 0 ? (unsigned int)handles.size() - 1 :
+                                      root + random() % (handles.size() - root);
+
+                Add(hierarchy, reference, random, handles, handles[parent]);
+            }
+        }
+
+        for(int i = 0; i < 203; ++i)
+        {
+            EntityHandle parent = i % 4 == 0 ? EntityHandle() : handles[handles.size() - 1];
+            Add(hierarchy, reference, random, handles, parent);
+        }
+
+        for(int round = 0; round < 30; ++round)
+        {
+            hierarchy.Update(jobs);
+            CHECK(Matches(hierarchy, reference));
+
+            // every fifth round touches most subtrees, the others a few
+            int changes = (round % 5 == 0) ? 2000 : 20;
+
+            for(int change = 0; change < changes; ++change)
+            {
+                EntityHandle entity = handles[random() % handles.size()];
+
+                if(reference.count(entity) == 0)
+                    continue;
+
+                unsigned int operation = random() % 10;
+
+                if(operation < 6)
+                {
+                    RandomLocal(random, reference[entity]);
+                    Apply(hierarchy, entity, reference[entity]);
+                }
+                else if(operation < 8)
+                {
+                    EntityHandle parent = random() % 3 ? handles[random() % handles.size()] : EntityHandle();
+
+                    if(!parent.IsNull() && reference.count(parent) == 0)
+                        continue;
+
+                    bool cycle = !parent.IsNull() && IsAncestor(reference, entity, parent);
+                    bool threw = false;
+
+                    try
+                    {
+                        hierarchy.SetParent(entity, parent);
+                        reference[entity].parent = parent;
+                    }
+                    catch(std::runtime_error&)
+                    {
+                        threw = true;
+                    }
+
+                    CHECK(threw == cycle);
+                }
+                else if(operation < 9)
+                {
+                    // the children become roots and keep their local transform
+                    hierarchy.Remove(entity);
+
+                    for(Reference::iterator it = reference.begin(); it != reference.end(); ++it)
+                        if(it->second.parent == entity)
+                            it->second.parent = EntityHandle();
+
+                    reference.erase(entity);
+                }
+                else
+                    Add(hierarchy, reference, random, handles, entity);
+            }
+        }
+
+        hierarchy.Update(jobs);
+        CHECK(Matches(hierarchy, reference));
+
+        // an update with nothing changed leaves everything as it was
+        hierarchy.Update(jobs);
+        CHECK(Matches(hierarchy, reference));
+
+        hierarchy.Clear();
+        CHECK(hierarchy.Size() == 0 && hierarchy.WorldMatrix(handles[0]) == nullptr);
+    }
+
+    void Errors()
+    {
+        TransformHierarchy hierarchy;
+        EntityHandle root(1, 1);
+        EntityHandle child(2, 1);
+        EntityHandle missing(3, 1);
+
+        hierarchy.Add(root);
+        hierarchy.Add(child, root);
+
+        int threw = 0;
+
+        try {hierarchy.Add(child);} catch(std::runtime_error&) {++threw;}
+        try {hierarchy.Add(missing, EntityHandle(4, 1));} catch(std::out_of_range&) {++threw;}
+        try {hierarchy.SetParent(root, child);} catch(std::runtime_error&) {++threw;}
+        try {hierarchy.SetParent(root, root);} catch(std::runtime_error&) {++threw;}
+        try {hierarchy.SetParent(missing, root);} catch(std::out_of_range&) {++threw;}
+        try {hierarchy.SetPosition(missing, 1.0f, 2.0f, 3.0f);} catch(std::out_of_range&) {++threw;}
+        try {hierarchy.GetWorldMatrix(missing);} catch(std::out_of_range&) {++threw;}
+
+        CHECK(threw == 7);
+        CHECK(hierarchy.Size() == 2 && hierarchy.GetParent(child) == root);
+
+        // a stale handle to the same slot is not the entity
+        CHECK(!hierarchy.Contains(EntityHandle(2, 2)));
+        CHECK(hierarchy.WorldMatrix(missing) == nullptr);
+
+        hierarchy.Remove(missing);
+        hierarchy.SetPosition(root, 1.0f, 2.0f, 3.0f);
+        hierarchy.SetPosition(child, 10.0f, 0.0f, 0.0f);
+        hierarchy.Update();
+
+        const float* world = hierarchy.WorldMatrix(child);
+        CHECK(world[3] == 11.0f && world[7] == 2.0f && world[11] == 3.0f);
+
+        // the child keeps its local transform as a root
+        hierarchy.Remove(root);
+        hierarchy.Update();
+
+        CHECK(hierarchy.Size() == 1 && hierarchy.GetParent(child).IsNull());
+        CHECK(hierarchy.WorldMatrix(child)[3] == 10.0f);
+    }
+}
+
+void TestTransformHierarchy()
+{
+    RandomChanges(nullptr);
+
+    JobSystem jobs(3);
+    RandomChanges(&jobs);
+
+    Errors();
+}
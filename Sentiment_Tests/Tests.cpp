@@ -0,0 +1,74 @@
+// File: Tests.cpp
+// Runs the tests of the engine and its utilities and prints one line per
+// group.
+// Exits with 1 if any check failed. Usage:
+//
+//     Sentiment_Tests [--filter group]
+//
+// --filter runs a single group, as named in TESTS.
+
+#include "Tests.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    long failures = 0;
+
+    struct Test
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const Test TESTS[] =
+    {
+        {"map", &TestMap},
+        {"hash_map", &TestHashMap},
+        {"member_list", &TestMemberList},
+        {"queues", &TestQueues},
+        {"slab", &TestSlabAllocator},
+        {"snapshot", &TestSnapshot},
+        {"spatial", &TestSpatialIndex},
+        {"transforms", &TestTransformHierarchy}
+    };
+}
+
+bool Check(bool passed, const char* condition, const char* file, int line)
+{
+    if(!passed)
+    {
+        std::printf("%s:%d: CHECK(%s) failed\n", file, line, condition);
+        ++failures;
+    }
+
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    std::string filter;
+
+    if(argc == 3 && std::strcmp(argv[1], "--filter") == 0)
+        filter = argv[2];
+    else if(argc != 1)
+    {
+        std::fprintf(stderr, "usage: %s [--filter group]\n", argv[0]);
+        return 1;
+    }
+
+    for(unsigned int i = 0; i < sizeof(TESTS) / sizeof(TESTS[0]); ++i)
+    {
+        if(!filter.empty() && filter != TESTS[i].name)
+            continue;
+
+        long before = failures;
+        TESTS[i].run();
+
+        std::printf("%s: %s\n", TESTS[i].name, failures == before ? "ok" : "FAILED");
+    }
+
+    return failures == 0 ? 0 : 1;
+}
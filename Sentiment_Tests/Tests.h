@@ -0,0 +1,30 @@
+// File: Tests.h
+// The checks behind Sentiment_Tests. Every group of tests is a function
+// listed in TESTS in Tests.cpp that reports failures through CHECK and
+// carries on, so one run lists every failure instead of the first one.
+
+#ifndef SENTIMENT_TESTS_H
+#define SENTIMENT_TESTS_H
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+// prints the condition and where it is if it did not pass
+bool Check(bool passed, const char* condition, const char* file, int line);
+
+void TestMap();
+
+void TestHashMap();
+
+void TestMemberList();
+
+void TestQueues();
+
+void TestSlabAllocator();
+
+void TestSnapshot();
+
+void TestSpatialIndex();
+
+void TestTransformHierarchy();
+
+#endif